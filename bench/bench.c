@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "mock_source.h"
+#include "mysql_service.h"
+#include "schema_diff.h"
+#include "app_context.h"
+#include "logger.h"
+#include "metrics.h"
+
+#define DEFAULT_COLUMNS 8
+#define DEFAULT_CHURN 0.01
+#define DEFAULT_CYCLES 5
+
+// Allocations are counted by wrapping the allocator at link time (see the
+// bench target of the Makefile), so calls made inside libc itself, e.g. by
+// qsort or fopen, are not seen.
+static atomic_ulong g_allocs;
+// The watcher prints what it captures on stdout; bench_size() moves that to
+// a file so the report stays readable.
+static FILE *g_report;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size) {
+    atomic_fetch_add_explicit(&g_allocs, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&g_allocs, 1, memory_order_relaxed);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&g_allocs, 1, memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s) {
+    atomic_fetch_add_explicit(&g_allocs, 1, memory_order_relaxed);
+    return __real_strdup(s);
+}
+
+typedef struct {
+    int columns;
+    double churn;
+    int cycles;
+    int pack;
+} BenchOptions;
+
+// Counters read before a measured step; bench_report() prints the
+// difference.
+typedef struct {
+    uint64_t start_us;
+    unsigned long allocs;
+} BenchMark;
+
+static void bench_mark(BenchMark *mark) {
+    mark->allocs = atomic_load(&g_allocs);
+    mark->start_us = metrics_now_us();
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss;
+}
+
+// One line per step: throughput over the tables it covered, the latency
+// per table, allocations per table and the peak RSS of the run so far.
+static void bench_report(const char *step, int tables, int items, const BenchMark *mark) {
+    uint64_t elapsed_us = metrics_now_us() - mark->start_us;
+    unsigned long allocs = atomic_load(&g_allocs) - mark->allocs;
+    double seconds = elapsed_us / 1e6;
+    fprintf(g_report, "%8d  %-16s %12.0f tables/s %10.2f us/table %9.1f allocs/table %8ld MB peak RSS\n", tables, step,
+           seconds > 0 ? items / seconds : 0.0, items > 0 ? (double)elapsed_us / items : 0.0,
+           items > 0 ? (double)allocs / items : 0.0, peak_rss_kb() / 1024);
+}
+
+static void bench_normalize(char **ddl, int tables) {
+    BenchMark mark;
+    bench_mark(&mark);
+    for (int i = 0; i < tables; i++) {
+        free(normalize_schema(ddl[i]));
+    }
+    bench_report("normalize", tables, tables, &mark);
+}
+
+// Diffs every table from version 0 to version 1, which changes a column
+// type, adds a column and adds an index.
+static void bench_alter(MockSource *mock, char **ddl, int tables) {
+    char **before = malloc((size_t)tables * sizeof(char *));
+    char **after = malloc((size_t)tables * sizeof(char *));
+    if (!before || !after) {
+        free(before);
+        free(after);
+        return;
+    }
+    for (int i = 0; i < tables; i++) {
+        char *next = mock_source_ddl(mock, i, 1);
+        before[i] = normalize_schema(ddl[i]);
+        after[i] = next ? normalize_schema(next) : NULL;
+        free(next);
+    }
+
+    StrBuf up = STR_BUF_INIT;
+    StrBuf down = STR_BUF_INIT;
+    char name[32];
+    BenchMark mark;
+    bench_mark(&mark);
+    for (int i = 0; i < tables; i++) {
+        snprintf(name, sizeof(name), "t%07d", i);
+        sb_reset(&up);
+        sb_reset(&down);
+        generate_alter_statements(name, before[i], after[i], &up, &down);
+    }
+    bench_report("alter", tables, tables, &mark);
+
+    sb_free(&up);
+    sb_free(&down);
+    for (int i = 0; i < tables; i++) {
+        free(before[i]);
+        free(after[i]);
+    }
+    free(before);
+    free(after);
+}
+
+static void phase_totals(unsigned long counts[PHASE_COUNT], uint64_t sums[PHASE_COUNT]) {
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        metrics_phase_total((MetricsPhase)phase, &counts[phase], &sums[phase]);
+    }
+}
+
+// Prints the mean latency of each phase over the passes since counts and
+// sums were taken. Fetch, normalize and diff are per changed table.
+static void report_phases(const unsigned long counts[PHASE_COUNT], const uint64_t sums[PHASE_COUNT]) {
+    static const char *names[PHASE_COUNT] = { "cycle", "enumerate", "fetch", "normalize", "diff", "write" };
+    unsigned long now_counts[PHASE_COUNT];
+    uint64_t now_sums[PHASE_COUNT];
+    phase_totals(now_counts, now_sums);
+    fprintf(g_report, "%10s", "");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        unsigned long count = now_counts[phase] - counts[phase];
+        uint64_t sum_us = now_sums[phase] - sums[phase];
+        fprintf(g_report, " %s %.3f ms", names[phase], count > 0 ? sum_us / 1e3 / count : 0.0);
+    }
+    fprintf(g_report, "\n");
+}
+
+// A cold pass captures every table; each warm cycle then churns the mock
+// and runs a full pass, as the watcher does after a git change.
+static void bench_cycles(MockSource *mock, const BenchOptions *options, int tables) {
+    AppContext ctx;
+    if (app_context_init(&ctx) != 0) {
+        return;
+    }
+    app_set_branch(&ctx, "main");
+
+    DBConfig config = {0};
+    config.name = "bench";
+    config.workers = 1;
+    config.poll_hot_ms = 2000;
+    config.poll_cold_ms = 300000;
+    config.poll_budget = 100;
+    config.capture_memory_mb = 256;
+    config.catalog_page_size = 1000;
+    config.snapshot_pack = options->pack ? "dbtables/snapshots.pack" : NULL;
+
+    WatchTarget *t = watch_target_create(NULL, &config, &ctx, 1);
+    if (!t) {
+        app_context_destroy(&ctx);
+        return;
+    }
+    watch_target_set_source(t, &mock->source);
+
+    unsigned long counts[PHASE_COUNT];
+    uint64_t sums[PHASE_COUNT];
+    BenchMark mark;
+    phase_totals(counts, sums);
+    bench_mark(&mark);
+    track_changes(t, NULL);
+    bench_report("cycle cold", tables, tables, &mark);
+    report_phases(counts, sums);
+
+    int churned = 0;
+    phase_totals(counts, sums);
+    bench_mark(&mark);
+    for (int i = 0; i < options->cycles; i++) {
+        churned += mock_source_churn(mock);
+        track_changes(t, NULL);
+    }
+    // Every pass looks at the whole catalog, so throughput counts them all.
+    bench_report("cycle warm", tables, tables * options->cycles, &mark);
+    report_phases(counts, sums);
+    fprintf(g_report, "%10s %d table(s) churned over %d cycle(s)\n", "", churned, options->cycles);
+
+    watch_target_destroy(t);
+    app_context_destroy(&ctx);
+}
+
+// Runs in a child of its own, in a scratch directory, so the peak RSS and
+// the files written belong to this size alone.
+static int bench_size(const BenchOptions *options, int tables) {
+    char dir[64];
+    snprintf(dir, sizeof(dir), "bench_%d", tables);
+    if (mkdir(dir, 0755) != 0 || chdir(dir) != 0) {
+        perror("Failed to create the bench directory");
+        return 1;
+    }
+    fflush(stdout);
+    int report_fd = dup(STDOUT_FILENO);
+    g_report = report_fd >= 0 ? fdopen(report_fd, "w") : NULL;
+    if (!g_report || !freopen("stdout.log", "w", stdout)) {
+        perror("Failed to redirect stdout");
+        return 1;
+    }
+    LoggerConfig log_config = {
+        .path = "app.log",
+        .min_level = LOG_LEVEL_WARN,
+        .max_bytes = 0,
+        .max_files = 0
+    };
+    logger_start(&log_config);
+
+    MockConfig mock_config = { tables, options->columns, options->churn, 1 };
+    MockSource mock;
+    char **ddl = malloc((size_t)tables * sizeof(char *));
+    if (!ddl || mock_source_init(&mock, &mock_config) != 0) {
+        free(ddl);
+        logger_stop();
+        return 1;
+    }
+    for (int i = 0; i < tables; i++) {
+        ddl[i] = mock_source_ddl(&mock, i, 0);
+    }
+
+    bench_normalize(ddl, tables);
+    bench_alter(&mock, ddl, tables);
+    for (int i = 0; i < tables; i++) {
+        free(ddl[i]);
+    }
+    free(ddl);
+    bench_cycles(&mock, options, tables);
+
+    mock_source_free(&mock);
+    logger_stop();
+    fclose(g_report);
+    return 0;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [-c columns] [-r churn] [-n cycles] [-p] [tables ...]\n", program);
+}
+
+// `bench [options] [tables ...]` measures normalize_schema(),
+// generate_alter_statements() and full watch cycles against a mock schema
+// source, for each catalog size given (default 100, 10000 and 100000).
+int main(int argc, char **argv) {
+    BenchOptions options = { DEFAULT_COLUMNS, DEFAULT_CHURN, DEFAULT_CYCLES, 0 };
+    int opt;
+    while ((opt = getopt(argc, argv, "c:r:n:p")) != -1) {
+        switch (opt) {
+        case 'c':
+            options.columns = atoi(optarg);
+            break;
+        case 'r':
+            options.churn = atof(optarg);
+            break;
+        case 'n':
+            options.cycles = atoi(optarg);
+            break;
+        case 'p':
+            options.pack = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.columns < 1 || options.churn < 0 || options.churn > 1 || options.cycles < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    static const int default_sizes[] = { 100, 10000, 100000 };
+    int size_count = argc > optind ? argc - optind : (int)(sizeof(default_sizes) / sizeof(default_sizes[0]));
+    char root[] = "/tmp/k_git_sql_bench.XXXXXX";
+    if (!mkdtemp(root) || chdir(root) != 0) {
+        perror("Failed to create the bench directory");
+        return 1;
+    }
+    printf("bench: %d column(s), churn %.3f, %d warm cycle(s), %s snapshots, output in %s\n", options.columns,
+           options.churn, options.cycles, options.pack ? "packed" : "file", root);
+    printf("%8s  %-16s %21s %20s %22s %22s\n", "tables", "step", "throughput", "latency", "allocations", "memory");
+    fflush(stdout);
+
+    int failed = 0;
+    for (int i = 0; i < size_count; i++) {
+        int tables = argc > optind ? atoi(argv[optind + i]) : default_sizes[i];
+        if (tables < 1) {
+            usage(argv[0]);
+            return 1;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            _exit(bench_size(&options, tables));
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Benchmark of %d tables failed\n", tables);
+            failed = 1;
+        }
+    }
+    return failed;
+}
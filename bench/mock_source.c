@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mock_source.h"
+
+#define NAME_DIGITS 7
+#define FIELD_SIZE 64
+
+// Column i (from 1) at a version. The varchar width follows the version so
+// that a churned table changes a column type, and every fourth version
+// cycles the column count back.
+static int column_count(const MockSource *mock, int version) {
+    return mock->config.columns + version % 4;
+}
+
+static const char *column_type(int column, int version, char *out, size_t size) {
+    switch (column % 5) {
+    case 0:
+        return "int";
+    case 1:
+        snprintf(out, size, "varchar(%d)", 32 + 8 * (version % 8));
+        return out;
+    case 2:
+        return "datetime";
+    case 3:
+        return "decimal(10,2)";
+    default:
+        return "text";
+    }
+}
+
+static int is_text(int column) {
+    return column % 5 == 1 || column % 5 == 4;
+}
+
+// Odd versions add an index on the first column.
+static int has_index(const MockSource *mock, int version) {
+    return version % 2 == 1 && column_count(mock, version) >= 1;
+}
+
+static int table_index(const MockSource *mock, const char *name) {
+    if (name[0] != 't' || strlen(name) != NAME_DIGITS + 1) {
+        return -1;
+    }
+    char *end;
+    long index = strtol(name + 1, &end, 10);
+    if (*end || index < 0 || index >= mock->config.tables) {
+        return -1;
+    }
+    return (int)index;
+}
+
+static void table_name(int index, char *out, size_t size) {
+    snprintf(out, size, "t%0*d", NAME_DIGITS, index);
+}
+
+typedef int (*VisitFn)(MockSource *mock, int index, SourceRowFn row, void *arg);
+
+// Visits the tables a read covers in name order, which the zero-padded
+// names make index order. Returns the rows delivered or -1.
+static int each_table(MockSource *mock, char **names, int count, const char *after, int limit,
+                      VisitFn visit, SourceRowFn row, void *arg) {
+    int first = after ? table_index(mock, after) + 1 : 0;
+    int end = names ? count : mock->config.tables;
+    int rows = 0;
+    int tables = 0;
+    for (int i = names ? 0 : first; i < end; i++) {
+        int index = names ? table_index(mock, names[i]) : i;
+        if (index < first) {
+            continue;
+        }
+        if (limit > 0 && tables == limit) {
+            break;
+        }
+        int delivered = visit(mock, index, row, arg);
+        if (delivered < 0) {
+            return -1;
+        }
+        rows += delivered;
+        tables++;
+    }
+    return rows;
+}
+
+static int visit_fingerprint(MockSource *mock, int index, SourceRowFn row, void *arg) {
+    char name[FIELD_SIZE];
+    char fingerprint[FIELD_SIZE];
+    int version = mock->versions[index];
+    table_name(index, name, sizeof(name));
+    snprintf(fingerprint, sizeof(fingerprint), "BASE TABLE/InnoDB/v%d/%d:%d", version,
+             column_count(mock, version) + 1, has_index(mock, version) ? 2 : 1);
+    char *values[] = { name, fingerprint };
+    return row(values, 2, arg) == 0 ? 1 : -1;
+}
+
+static int visit_name(MockSource *mock, int index, SourceRowFn row, void *arg) {
+    (void)mock;
+    char name[FIELD_SIZE];
+    table_name(index, name, sizeof(name));
+    char *values[] = { name };
+    return row(values, 1, arg) == 0 ? 1 : -1;
+}
+
+static int visit_table(MockSource *mock, int index, SourceRowFn row, void *arg) {
+    (void)mock;
+    char name[FIELD_SIZE];
+    table_name(index, name, sizeof(name));
+    char *values[] = { name, "BASE TABLE", "InnoDB", "utf8mb4_0900_ai_ci", "", "" };
+    return row(values, 6, arg) == 0 ? 1 : -1;
+}
+
+static int visit_columns(MockSource *mock, int index, SourceRowFn row, void *arg) {
+    char name[FIELD_SIZE];
+    char position[16];
+    char column[16];
+    char type[FIELD_SIZE];
+    int version = mock->versions[index];
+    int columns = column_count(mock, version);
+    table_name(index, name, sizeof(name));
+
+    char *id[] = { name, "1", "id", "bigint unsigned", "NO", NULL, "auto_increment", NULL, NULL, "" };
+    if (row(id, 10, arg) != 0) {
+        return -1;
+    }
+    for (int c = 1; c <= columns; c++) {
+        snprintf(position, sizeof(position), "%d", c + 1);
+        snprintf(column, sizeof(column), "c%02d", c);
+        char *values[] = {
+            name, position, column, (char *)column_type(c, version, type, sizeof(type)), "YES", NULL, "",
+            is_text(c) ? "utf8mb4" : NULL, is_text(c) ? "utf8mb4_0900_ai_ci" : NULL, ""
+        };
+        if (row(values, 10, arg) != 0) {
+            return -1;
+        }
+    }
+    return columns + 1;
+}
+
+static int visit_indexes(MockSource *mock, int index, SourceRowFn row, void *arg) {
+    char name[FIELD_SIZE];
+    table_name(index, name, sizeof(name));
+    char *primary[] = { name, "PRIMARY", "1", "id", "0", NULL, "A", "BTREE", "" };
+    if (row(primary, 9, arg) != 0) {
+        return -1;
+    }
+    if (!has_index(mock, mock->versions[index])) {
+        return 1;
+    }
+    char *key[] = { name, "idx_c01", "1", "c01", "1", NULL, "A", "BTREE", "" };
+    return row(key, 9, arg) == 0 ? 2 : -1;
+}
+
+static int visit_constraints(MockSource *mock, int index, SourceRowFn row, void *arg) {
+    (void)mock;
+    char name[FIELD_SIZE];
+    table_name(index, name, sizeof(name));
+    char *values[] = { name, "PRIMARY", "PRIMARY KEY", "1", "id", NULL, NULL, NULL, NULL };
+    return row(values, 9, arg) == 0 ? 1 : -1;
+}
+
+static int mock_fingerprints(SchemaSource *source, const char *db_name, char **names, int count,
+                             const char *after, int limit, SourceRowFn row, void *arg) {
+    (void)db_name;
+    return each_table(source->impl, names, count, after, limit, visit_fingerprint, row, arg);
+}
+
+static int mock_table_names(SchemaSource *source, const char *db_name, const char *after, int limit,
+                            SourceRowFn row, void *arg) {
+    (void)db_name;
+    return each_table(source->impl, NULL, 0, after, limit, visit_name, row, arg);
+}
+
+static int mock_model(SchemaSource *source, const char *db_name, SourceModel model, char **names, int count,
+                      SourceRowFn row, void *arg) {
+    static const VisitFn visits[SOURCE_MODEL_COUNT] = {
+        visit_table, visit_columns, visit_indexes, visit_constraints
+    };
+    (void)db_name;
+    return each_table(source->impl, names, count, NULL, 0, visits[model], row, arg);
+}
+
+char *mock_source_ddl(const MockSource *mock, int index, int version) {
+    StrBuf ddl = STR_BUF_INIT;
+    char name[FIELD_SIZE];
+    char type[FIELD_SIZE];
+    table_name(index, name, sizeof(name));
+
+    sb_appendf(&ddl, "CREATE TABLE `%s` (\n  `id` bigint unsigned NOT NULL AUTO_INCREMENT,\n", name);
+    for (int c = 1; c <= column_count(mock, version); c++) {
+        sb_appendf(&ddl, "  `c%02d` %s%s,\n", c, column_type(c, version, type, sizeof(type)),
+                   c % 5 == 4 ? "" : " DEFAULT NULL");
+    }
+    sb_append(&ddl, "  PRIMARY KEY (`id`)");
+    if (has_index(mock, version)) {
+        sb_append(&ddl, ",\n  KEY `idx_c01` (`c01`)");
+    }
+    // The counter moves with every version, as on a live table, and is
+    // stripped by normalize_schema().
+    if (sb_appendf(&ddl, "\n) ENGINE=InnoDB AUTO_INCREMENT=%d DEFAULT CHARSET=utf8mb4 "
+                   "COLLATE=utf8mb4_0900_ai_ci", (version + 1) * 1000 + index) != 0) {
+        sb_free(&ddl);
+        return NULL;
+    }
+    return sb_detach(&ddl);
+}
+
+static char *mock_show_create(SchemaSource *source, const char *db_name, const char *table_name) {
+    MockSource *mock = source->impl;
+    (void)db_name;
+    int index = table_index(mock, table_name);
+    if (index < 0) {
+        return NULL;
+    }
+    return mock_source_ddl(mock, index, mock->versions[index]);
+}
+
+static const SchemaSourceOps MOCK_SOURCE_OPS = {
+    mock_fingerprints,
+    mock_table_names,
+    mock_model,
+    mock_show_create
+};
+
+int mock_source_init(MockSource *mock, const MockConfig *config) {
+    memset(mock, 0, sizeof(*mock));
+    mock->versions = calloc((size_t)config->tables, sizeof(int));
+    if (!mock->versions) {
+        return -1;
+    }
+    mock->config = *config;
+    mock->rng = config->seed ? config->seed : 1;
+    mock->source.ops = &MOCK_SOURCE_OPS;
+    mock->source.impl = mock;
+    return 0;
+}
+
+int mock_source_churn(MockSource *mock) {
+    int count = (int)(mock->config.churn * mock->config.tables + 0.5);
+    for (int i = 0; i < count; i++) {
+        // xorshift32; the same seed replays the same churn.
+        mock->rng ^= mock->rng << 13;
+        mock->rng ^= mock->rng >> 17;
+        mock->rng ^= mock->rng << 5;
+        mock->versions[mock->rng % (unsigned int)mock->config.tables]++;
+    }
+    return count;
+}
+
+void mock_source_free(MockSource *mock) {
+    free(mock->versions);
+    mock->versions = NULL;
+}
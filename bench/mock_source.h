@@ -0,0 +1,34 @@
+#ifndef MOCK_SOURCE_H
+#define MOCK_SOURCE_H
+
+#include "schema_source.h"
+
+typedef struct {
+    int tables;
+    // Columns of a table at version 0; later versions add up to three.
+    int columns;
+    // Fraction of the tables mock_source_churn() alters, 0 to 1.
+    double churn;
+    unsigned int seed;
+} MockConfig;
+
+// A synthetic database served from memory. Table i is named t<i> and has a
+// version; each version has its own columns, types and indexes, and the
+// fingerprint, model rows and CREATE TABLE all follow it, so the catalog
+// sees exactly the tables that churned.
+typedef struct {
+    SchemaSource source;
+    MockConfig config;
+    int *versions;
+    unsigned int rng;
+} MockSource;
+
+int mock_source_init(MockSource *mock, const MockConfig *config);
+// Moves churn * tables tables, picked at random, to their next version.
+// Returns how many moved.
+int mock_source_churn(MockSource *mock);
+// The CREATE TABLE of table index at version, as SHOW CREATE TABLE gives it.
+char *mock_source_ddl(const MockSource *mock, int index, int version);
+void mock_source_free(MockSource *mock);
+
+#endif // MOCK_SOURCE_H
@@ -4,15 +4,42 @@
 #include <pthread.h>
 #include <stddef.h>
 
+// State shared by the git and MySQL watchers. branch_generation moves every
+// time the checked out branch changes; change_seq moves on every branch or
+// commit change and is what the DB watcher sleeps on. wake_fd becomes
+// readable once stop is requested, for threads that block in poll().
+// head_oid is the hex id of the commit HEAD pointed at when last read, so
+// other threads can name it without touching the git watcher's repository.
 typedef struct {
     pthread_mutex_t lock;
     pthread_cond_t cond;
     int stop;
     char current_branch[256];
+    char head_oid[41];
+    unsigned long branch_generation;
+    unsigned long change_seq;
+    int wake_fd;
 } AppContext;
 
+int app_context_init(AppContext *ctx);
+void app_context_destroy(AppContext *ctx);
+
+// Sets the stop flag and wakes every thread waiting on the context.
+void app_request_stop(AppContext *ctx);
 void app_set_branch(AppContext *ctx, const char *branch_name);
-void app_get_branch(AppContext *ctx, char *out, size_t out_size);
+// Records a new commit on the current branch and wakes the DB watcher.
+void app_notify_commit(AppContext *ctx);
+void app_set_head(AppContext *ctx, const char *oid_hex);
+// Copies the hex id of HEAD, or an empty string before it was first read.
+void app_get_head(AppContext *ctx, char *out, size_t out_size);
+// Copies the branch name and returns the generation it belongs to.
+unsigned long app_get_branch(AppContext *ctx, char *out, size_t out_size);
+unsigned long app_branch_generation(AppContext *ctx);
+unsigned long app_change_seq(AppContext *ctx);
+// Sleeps until change_seq moves past *seen, stop is requested or timeout_ms
+// passes, then stores the current change_seq in *seen. Returns 1 when woken
+// by a change, 0 on timeout and -1 when stopping.
+int app_wait_for_change(AppContext *ctx, unsigned long *seen, unsigned int timeout_ms);
 void app_log(AppContext *ctx, const char *fmt, ...);
 
 #endif // APP_CONTEXT_H
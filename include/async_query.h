@@ -0,0 +1,54 @@
+#ifndef ASYNC_QUERY_H
+#define ASYNC_QUERY_H
+
+#include <mysql/mysql.h>
+#include "mysql_service.h"
+#include "db_connection.h"
+#include "str_buf.h"
+#include "app_context.h"
+
+// Builds the query of index into sql. Returns 0 to skip the index.
+typedef int (*AsyncQueryFn)(int index, StrBuf *sql, void *arg);
+// Gets the first row of the result of index, or NULL when the query failed
+// or returned no rows. Runs on the thread that called async_query_run().
+typedef void (*AsyncRowFn)(int index, MYSQL_ROW row, void *arg);
+
+typedef enum {
+    ASYNC_IDLE,
+    ASYNC_QUERY,
+    ASYNC_STORE
+} AsyncState;
+
+typedef struct {
+    DbConnection connection;
+    AsyncState state;
+    int index;
+    StrBuf sql;
+    MYSQL_RES *result;
+    int fd;
+} AsyncSlot;
+
+// Connections driven from one thread with the nonblocking client API. Each
+// connection has one query in flight and an epoll loop advances whichever
+// has data, so round trips to a distant server overlap without a thread per
+// connection.
+typedef struct {
+    AppContext *ctx;
+    AsyncSlot *slots;
+    int size;
+    int epoll_fd;
+    unsigned long queries;
+    unsigned long failures;
+    int max_in_flight;
+} AsyncQueryPool;
+
+// Sets up size connections; they are opened on first use.
+int async_query_start(AsyncQueryPool *pool, DBConfig *config, AppContext *ctx, int size);
+// Runs the query of every index in [0, count) and returns once all of them
+// finished. Returns the number of queries that failed. Indices left over
+// because no connection could be opened are not run, never reach row() and
+// are not counted.
+int async_query_run(AsyncQueryPool *pool, int count, AsyncQueryFn query, AsyncRowFn row, void *arg);
+void async_query_stop(AsyncQueryPool *pool);
+
+#endif // ASYNC_QUERY_H
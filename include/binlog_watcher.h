@@ -0,0 +1,58 @@
+#ifndef BINLOG_WATCHER_H
+#define BINLOG_WATCHER_H
+
+#include <stdint.h>
+#include <mysql/mysql.h>
+#include "mysql_service.h"
+#include "hash_map.h"
+#include "app_context.h"
+
+#define BINLOG_NAME_SIZE 256
+#define BINLOG_PATH_SIZE 512
+
+typedef enum {
+    BINLOG_SOURCE_SERVER,
+    BINLOG_SOURCE_FILE
+} BinlogSourceKind;
+
+// Tails the binary log and collects the tables of config->name that DDL
+// statements touched. Events come either from the server, over a
+// replication connection (COM_BINLOG_DUMP), or from the local binlog files
+// listed in BINLOG_INDEX when the watcher runs on the database host.
+typedef struct {
+    DBConfig *config;
+    BinlogSourceKind kind;
+    MYSQL *conn;
+    MYSQL_RPL rpl;
+    int fd;
+    char index_path[BINLOG_PATH_SIZE];
+    char file_name[BINLOG_NAME_SIZE];
+    uint64_t position;
+    char rotate_to[BINLOG_NAME_SIZE];
+    uint64_t rotate_position;
+    int checksum;
+    unsigned char query_post_header_len;
+    unsigned char *event;
+    size_t event_cap;
+    HashMap tables;
+    int full_refresh;
+    unsigned long events;
+    unsigned long ddl_events;
+} BinlogWatcher;
+
+// Starts reading at the current end of the log, so only DDL that runs from
+// now on is reported. Returns -1 when binary logging is off, the user lacks
+// REPLICATION SLAVE/CLIENT, or the index file cannot be read.
+int binlog_watcher_open(BinlogWatcher *bw, DBConfig *config, AppContext *ctx);
+// Reads events until one carries DDL for the watched database (returns 1),
+// the source goes idle for about timeout_ms (returns 0) or reading fails
+// (returns -1, the watcher must be reopened).
+int binlog_watcher_poll(BinlogWatcher *bw, unsigned int timeout_ms);
+// Hands over the table names collected so far and clears them. *full is set
+// when the statement could not be narrowed to tables and the whole database
+// needs a rescan. Free the result with binlog_watcher_free_names().
+char **binlog_watcher_take(BinlogWatcher *bw, int *count, int *full);
+void binlog_watcher_free_names(char **names, int count);
+void binlog_watcher_close(BinlogWatcher *bw);
+
+#endif // BINLOG_WATCHER_H
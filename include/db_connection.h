@@ -0,0 +1,42 @@
+#ifndef DB_CONNECTION_H
+#define DB_CONNECTION_H
+
+#include <mysql/mysql.h>
+#include <time.h>
+#include "mysql_service.h"
+#include "app_context.h"
+
+typedef enum {
+    DB_CONN_DISCONNECTED,
+    DB_CONN_CONNECTED,
+    DB_CONN_BACKOFF
+} DbConnState;
+
+// Long-lived connection to one database. The handle is kept open between
+// polls, checked with mysql_ping() before use and re-established with
+// exponential backoff when the server goes away.
+typedef struct {
+    DBConfig *config;
+    MYSQL *conn;
+    DbConnState state;
+    unsigned int backoff_ms;
+    struct timespec next_attempt;
+    unsigned long connects;
+    unsigned long reconnects;
+    unsigned long connect_failures;
+    unsigned long ping_failures;
+    double last_connect_ms;
+    double total_connect_ms;
+} DbConnection;
+
+void db_connection_init(DbConnection *dc, DBConfig *config);
+// Returns a live handle, or NULL while the connection is backing off.
+MYSQL *db_connection_acquire(DbConnection *dc, AppContext *ctx);
+// Milliseconds until the next reconnect attempt is allowed, 0 when connected.
+unsigned int db_connection_retry_delay_ms(const DbConnection *dc);
+// Drops a handle that failed outside of acquire, e.g. on a query, so the
+// next acquire reconnects.
+void db_connection_reset(DbConnection *dc);
+void db_connection_close(DbConnection *dc);
+
+#endif // DB_CONNECTION_H
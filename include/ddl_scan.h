@@ -0,0 +1,26 @@
+#ifndef DDL_SCAN_H
+#define DDL_SCAN_H
+
+#include <stddef.h>
+
+typedef enum {
+    // Not a statement that can change a table definition (DML, BEGIN,
+    // GRANT, CREATE TRIGGER, ...).
+    DDL_NONE,
+    // Every affected table was reported through the callback.
+    DDL_TABLES,
+    // Schema DDL whose targets could not be narrowed down (views, unusual
+    // syntax); the caller should rescan the whole database.
+    DDL_UNKNOWN
+} DdlResult;
+
+// Called once per affected table. db is the qualifier written in the
+// statement or the session default database, and may be empty. table is
+// NULL when the statement creates or drops the database itself.
+typedef void (*DdlTableFn)(const char *db, const char *table, void *arg);
+
+// Looks at one statement as logged in a binlog QUERY_EVENT and reports the
+// tables it creates, alters, renames or drops. Temporary tables are skipped.
+DdlResult ddl_scan(const char *query, size_t len, const char *default_db, DdlTableFn fn, void *arg);
+
+#endif // DDL_SCAN_H
@@ -0,0 +1,15 @@
+#ifndef DUMP_DIFF_H
+#define DUMP_DIFF_H
+
+// Writes the migration from the schema in old_path to the one in new_path
+// to <out_dir>/<stamp>_dump_up.sql and <stamp>_dump_down.sql, without a
+// database. Both files may be `mysqldump --no-data` output or a
+// dbtables/main.sql snapshot: every CREATE TABLE statement in them is one
+// table, and a table defined twice keeps its last definition. The files are
+// memory-mapped and only indexed up front; tables are normalized and diffed
+// on up to threads threads, a window at a time, and the window is written
+// out in table name order before the next one starts. Returns the number of
+// tables that differ, or -1 on failure.
+int dump_diff(const char *old_path, const char *new_path, const char *out_dir, int threads);
+
+#endif // DUMP_DIFF_H
@@ -0,0 +1,33 @@
+#ifndef EMITTED_REGISTRY_H
+#define EMITTED_REGISTRY_H
+
+#include <stdint.h>
+#include "hash_map.h"
+
+// Last branch delta written for one (branch, table) pair, identified by a
+// digest of the normalized schema it was generated from.
+typedef struct {
+    uint64_t digest;
+} EmittedChange;
+
+// Hash-indexed set of emitted branch deltas. When state_path is set, updates
+// mark the registry dirty and emitted_registry_flush() writes it to that
+// file, so a restart does not re-emit deltas that are already on disk.
+typedef struct {
+    HashMap entries;
+    char *state_path;
+    int dirty;
+} EmittedRegistry;
+
+int emitted_registry_init(EmittedRegistry *registry, const char *state_path);
+int emitted_registry_has(EmittedRegistry *registry, const char *branch, const char *table, uint64_t digest);
+// Tells whether branch has a delta for table at all, whatever its digest.
+int emitted_registry_contains(EmittedRegistry *registry, const char *branch, const char *table);
+void emitted_registry_set(EmittedRegistry *registry, const char *branch, const char *table, uint64_t digest);
+void emitted_registry_clear(EmittedRegistry *registry, const char *branch, const char *table);
+// Rewrites the state file once if anything was set or cleared since the
+// last flush, however many updates that was.
+void emitted_registry_flush(EmittedRegistry *registry);
+void emitted_registry_free(EmittedRegistry *registry);
+
+#endif // EMITTED_REGISTRY_H
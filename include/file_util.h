@@ -0,0 +1,15 @@
+#ifndef FILE_UTIL_H
+#define FILE_UTIL_H
+
+#include <stddef.h>
+
+// Replaces path with data so that readers see either the old or the new
+// file, never a partial one: the data goes to a temp file in the same
+// directory that is then renamed over path. durable also flushes the temp
+// file to disk first, so a crash cannot leave an empty file behind.
+int write_file_atomic(const char *path, const char *data, size_t len, int durable);
+// Creates path and any missing parents, like mkdir -p. An existing path
+// costs one mkdir() call. Returns 0 when path exists afterwards, -1 if not.
+int create_directories(const char *path);
+
+#endif // FILE_UTIL_H
@@ -0,0 +1,16 @@
+#ifndef GIT_BACKFILL_H
+#define GIT_BACKFILL_H
+
+// Rebuilds tables/<t>/history.txt and tables/<t>/migrations/ under root
+// (NULL or "" for the current directory) from the schema files committed
+// under schema_dir, walking the first-parent history of HEAD oldest first.
+// schema_dir may hold <t>/schema.sql (the layout this tool writes) or flat
+// <t>.sql files. Each version of a table becomes one history entry and one
+// migration pair stamped with the commit time; every file is replaced
+// atomically. Reading trees and diffing versions is spread over threads,
+// each with its own repository handle. Only the per-table file layout is
+// written, never a snapshot pack. Returns the number of versions written,
+// or -1 on failure.
+int git_backfill(const char *schema_dir, const char *root, int threads);
+
+#endif // GIT_BACKFILL_H
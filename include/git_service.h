@@ -5,6 +5,11 @@
 #include <stdio.h>
 #include "app_context.h"
 
+// Opens the repository in the working directory. libgit2 objects must not
+// cross threads, so every thread that reads the repository opens its own.
+int git_open_repository(git_repository **repo);
+// Prints the failed libgit2 call and its last error to stderr.
+void log_git_error(const char *action, int error_code);
 void git_init(AppContext *ctx);
 
 #endif
@@ -0,0 +1,42 @@
+#ifndef GIT_SNAPSHOT_H
+#define GIT_SNAPSHOT_H
+
+#include <git2.h>
+#include <stddef.h>
+
+// Records the schemas of a branch as commits on refs/schema/<branch> in the
+// watched repository: one tree with a <table>.sql blob per table, committed
+// only when the tree changed. Git stores each distinct schema once and packs
+// the history, and `git diff refs/schema/main refs/schema/<branch>` compares
+// any two recorded states.
+//
+// The writer opens its own repository handle. libgit2 objects must not be
+// shared between threads, so it never touches the git watcher's repository;
+// the ref itself only moves if it still points at the parent the commit was
+// built on.
+typedef struct {
+    git_repository *repo;
+    git_treebuilder *builder;
+    git_commit *parent;
+    char ref_name[320];
+    char branch[256];
+    unsigned long commits;
+} GitSnapshot;
+
+int git_snapshot_open(GitSnapshot *gs);
+// Starts a tree for branch on top of its last commit. Returns 1 when the
+// branch has no schema commit yet, so every table has to be put, 0 when it
+// does and -1 on failure.
+int git_snapshot_begin(GitSnapshot *gs, const char *branch);
+// Adds or replaces the schema of table in the pending tree.
+int git_snapshot_put(GitSnapshot *gs, const char *table, const char *schema, size_t len);
+// Drops the tables for which keep() returns 0, then commits the pending tree
+// with source_oid, the commit HEAD was on, as a trailer of the message.
+// Returns 1 when committed, 0 when the tree did not change and -1 on failure.
+int git_snapshot_commit(GitSnapshot *gs, int (*keep)(const char *table, void *arg), void *arg,
+                        const char *source_oid, unsigned long generation);
+// Throws the pending tree away.
+void git_snapshot_abort(GitSnapshot *gs);
+void git_snapshot_close(GitSnapshot *gs);
+
+#endif // GIT_SNAPSHOT_H
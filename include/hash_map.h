@@ -0,0 +1,32 @@
+#ifndef HASH_MAP_H
+#define HASH_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// String-keyed hash map with separate chaining. Keys are copied; values are
+// owned by the caller unless a free function is handed to hash_map_free().
+typedef struct HashEntry {
+    char *key;
+    uint64_t hash;
+    void *value;
+    struct HashEntry *next;
+} HashEntry;
+
+typedef struct {
+    HashEntry **buckets;
+    size_t bucket_count;
+    size_t count;
+} HashMap;
+
+uint64_t hash_bytes(const void *data, size_t len);
+uint64_t hash_string(const char *str);
+
+int hash_map_init(HashMap *map, size_t initial_buckets);
+void *hash_map_get(const HashMap *map, const char *key);
+int hash_map_put(HashMap *map, const char *key, void *value);
+void *hash_map_remove(HashMap *map, const char *key);
+void hash_map_foreach(const HashMap *map, void (*fn)(const char *key, void *value, void *arg), void *arg);
+void hash_map_free(HashMap *map, void (*free_value)(void *value));
+
+#endif // HASH_MAP_H
@@ -0,0 +1,43 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+typedef enum {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR
+} LogLevel;
+
+typedef struct {
+    const char *path;
+    LogLevel min_level;
+    // The file is rotated to <path>.1 ... <path>.<max_files> once it grows
+    // past max_bytes; 0 disables rotation.
+    size_t max_bytes;
+    int max_files;
+} LoggerConfig;
+
+typedef struct {
+    unsigned long written;
+    unsigned long dropped;
+    unsigned long rotations;
+    unsigned long flushes;
+} LoggerStats;
+
+// Starts the writer thread. Until then, and after logger_stop(), messages
+// are appended synchronously so nothing logged at startup is lost.
+int logger_start(const LoggerConfig *config);
+// Drains the queue, closes the file and joins the writer thread.
+void logger_stop(void);
+// Formats the message and queues it without taking any lock. When the queue
+// is full the message is counted as dropped instead of blocking the caller.
+void log_message(LogLevel level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void log_vmessage(LogLevel level, const char *fmt, va_list args);
+void logger_get_stats(LoggerStats *out);
+// Parses "debug", "info", "warn" or "error"; anything else yields fallback.
+LogLevel log_level_parse(const char *name, LogLevel fallback);
+
+#endif // LOGGER_H
@@ -0,0 +1,27 @@
+#ifndef MAIN_SNAPSHOT_H
+#define MAIN_SNAPSHOT_H
+
+#include "hash_map.h"
+
+// The rendered block of every table in dbtables/main.sql, keyed by table
+// name. Blocks are only re-rendered for tables whose schema changed, and the
+// file is only rewritten when a block was added, changed or removed.
+typedef struct {
+    HashMap blocks;
+    int changed;
+    unsigned long writes;
+} MainSnapshot;
+
+int main_snapshot_init(MainSnapshot *snapshot);
+int main_snapshot_has(MainSnapshot *snapshot, const char *table);
+// Renders the block of table from its normalized schema.
+int main_snapshot_set(MainSnapshot *snapshot, const char *branch, const char *table, const char *schema);
+// Drops the blocks of tables for which keep() returns 0.
+void main_snapshot_retain(MainSnapshot *snapshot, int (*keep)(const char *table, void *arg), void *arg);
+// Atomically replaces path with header followed by every block in table
+// name order, if anything changed since the last write or path is missing.
+// Returns 1 when written, 0 when up to date and -1 on failure.
+int main_snapshot_write(MainSnapshot *snapshot, const char *path, const char *header);
+void main_snapshot_free(MainSnapshot *snapshot);
+
+#endif // MAIN_SNAPSHOT_H
@@ -0,0 +1,69 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define METRICS_MAX_TARGETS 256
+
+// Phases of a watch cycle. PHASE_CYCLE spans a whole pass, the others the
+// part of it named: reading the catalog, fetching DDL, normalizing it,
+// comparing it with the snapshots and writing the results.
+typedef enum {
+    PHASE_CYCLE,
+    PHASE_ENUMERATE,
+    PHASE_FETCH,
+    PHASE_NORMALIZE,
+    PHASE_DIFF,
+    PHASE_WRITE,
+    PHASE_COUNT
+} MetricsPhase;
+
+typedef enum {
+    COUNTER_PASSES,
+    COUNTER_QUERIES,
+    COUNTER_TABLES,
+    COUNTER_CHANGES,
+    COUNTER_ERRORS,
+    COUNTER_BYTES_WRITTEN,
+    COUNTER_CONNECTS,
+    COUNTER_RECONNECTS,
+    COUNTER_CONNECT_FAILURES,
+    COUNTER_COUNT
+} MetricsCounter;
+
+typedef struct {
+    // Serves GET /metrics on 127.0.0.1:port; 0 turns the endpoint off.
+    int port;
+    // Appends every phase as a Chrome trace event (chrome://tracing,
+    // Perfetto) to this file; NULL turns tracing off.
+    const char *trace_path;
+    // Tracing stops once the file holds this many bytes of events; 0 means
+    // 64 MB.
+    size_t trace_max_bytes;
+} MetricsConfig;
+
+// Recording works without metrics_start(); it only adds the endpoint and
+// the trace file. Every recording call is lock-free: trace events collect
+// in a buffer per thread and take a lock only when it is written out.
+int metrics_start(const MetricsConfig *config);
+// Stops the endpoint, writes out the trace buffers and closes the trace
+// file. Call it once the threads that record phases have stopped.
+void metrics_stop(void);
+uint64_t metrics_now_us(void);
+// Records a phase that began at start_us (from metrics_now_us()) and ends
+// now. target names the database in the trace and may be NULL.
+void metrics_observe(MetricsPhase phase, uint64_t start_us, const char *target);
+void metrics_add(MetricsCounter counter, unsigned long n);
+// Totals since the process started, for callers that report them directly.
+void metrics_phase_total(MetricsPhase phase, unsigned long *count, uint64_t *sum_us);
+// Adds a watched database to the git lag gauges and returns its id; the
+// same name gives the same id. Returns -1 once METRICS_MAX_TARGETS are in.
+int metrics_register_target(const char *name);
+// The git watcher moved to change seq; each registered target is behind
+// until a full pass of its own that started at seq or later reports
+// metrics_git_synced().
+void metrics_git_changed(unsigned long seq);
+void metrics_git_synced(int target, unsigned long seq);
+
+#endif // METRICS_H
@@ -5,6 +5,20 @@
 #include <time.h>
 #include <pthread.h>
 #include "app_context.h"
+#include "schema_source.h"
+
+typedef enum {
+    CAPTURE_POLL,
+    CAPTURE_BINLOG
+} CaptureMode;
+
+// How the DDL of changed tables is fetched: by DB_WORKERS threads with a
+// blocking connection each, or by one thread keeping DB_WORKERS nonblocking
+// queries in flight.
+typedef enum {
+    CAPTURE_ENGINE_THREADS,
+    CAPTURE_ENGINE_ASYNC
+} CaptureEngine;
 
 typedef struct {
     char *host;
@@ -12,8 +26,39 @@ typedef struct {
     char *pass;
     char *name;
     int port;
+    char *emitted_state_path;
+    int workers;
+    char *log_level;
+    long log_max_bytes;
+    int log_max_files;
+    CaptureMode capture_mode;
+    CaptureEngine capture_engine;
+    char *binlog_index;
+    unsigned int binlog_server_id;
+    unsigned int poll_hot_ms;
+    unsigned int poll_cold_ms;
+    int poll_budget;
+    char *snapshot_pack;
+    int git_snapshots;
+    int capture_memory_mb;
+    int catalog_page_size;
+    char *output_root;
+    int watch_threads;
+    int server_connections;
+    int metrics_port;
+    char *trace_file;
+    int trace_max_mb;
 } DBConfig;
 
+// One [name] section of a multi-target .env.
+typedef struct {
+    char *name;
+    DBConfig config;
+} TargetConfig;
+
+// One watched database and the state kept about it between passes.
+typedef struct WatchTarget WatchTarget;
+
 
 typedef struct {
     char *table;
@@ -37,9 +82,37 @@ typedef struct {
 
 int load_config(DBConfig *config);
 void free_config(DBConfig *config);
+// Reads the [name] sections of .env. Each target starts from defaults, the
+// keys above the first section, and overrides what its section sets. No
+// sections leaves count at 0: .env then describes a single database.
+int load_targets(const DBConfig *defaults, TargetConfig **targets, int *count);
+void free_targets(TargetConfig *targets, int count);
 MYSQL* connect_db(DBConfig *config);
 void test_connection(MYSQL *conn);
 void close_connection(MYSQL *conn);
-void track_changes(MYSQL *conn, DBConfig *config, AppContext *ctx);
+char *normalize_schema(const char *schema);
+// Captures every changed table of the target's database. Returns -1 when
+// the catalog could not be read.
+int track_changes(WatchTarget *target, MYSQL *conn);
+// Same as track_changes() but only re-reads the named tables.
+int track_table_changes(WatchTarget *target, MYSQL *conn, char **names, int count);
+// name labels a target of a multi-target .env in logs and schema refs and
+// is its default OUTPUT_ROOT; NULL watches into the working directory.
+// workers capture threads with their own connections are started; below 2
+// every pass runs on the connection handed to it. config must outlive the
+// target.
+WatchTarget *watch_target_create(const char *name, DBConfig *config, AppContext *ctx, int workers);
+// Reads the catalog and DDL from source instead of MySQL, e.g. a mock for
+// benchmarks; track_changes() then takes a NULL conn. Capture threads still
+// connect to MySQL, so create the target with fewer than 2 workers.
+void watch_target_set_source(WatchTarget *target, SchemaSource *source);
+// Runs one poll cycle on conn, or only notes that the server is away when
+// conn is NULL, and returns the milliseconds until the next one is due.
+unsigned int watch_target_poll(WatchTarget *target, MYSQL *conn);
+// Watches the target on connections of its own until stop is requested.
+void watch_target_run(WatchTarget *target);
+void watch_target_destroy(WatchTarget *target);
 void watch_database(DBConfig *config, AppContext *ctx);
+// Logs the schema memory and peak RSS of the process.
+void report_blob_usage(AppContext *ctx);
 #endif // MYSQL_SERVICE_H
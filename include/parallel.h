@@ -0,0 +1,25 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Runs one index. local is what open gave the calling thread, or NULL.
+typedef void (*ParallelFn)(void *local, int index, void *arg);
+
+// A loop over indices split across short-lived threads, for batch jobs
+// that have no pool of their own. Threads take chunk indices at a time.
+// open, when set, prepares the state a thread hands to fn, e.g. a handle
+// that must not cross threads; a thread whose open fails takes no work.
+// close releases that state once the thread runs out of work.
+typedef struct {
+    ParallelFn fn;
+    int (*open)(void **local, void *arg);
+    void (*close)(void *local, void *arg);
+    void *arg;
+    int chunk;
+} ParallelJob;
+
+// Calls job->fn for every index in [start, end) on up to threads threads,
+// or on the calling thread when none can be started. Returns -1 when some
+// indices were not run because no thread could open, 0 otherwise.
+int parallel_run(const ParallelJob *job, int threads, int start, int end);
+
+#endif // PARALLEL_H
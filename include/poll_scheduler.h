@@ -0,0 +1,53 @@
+#ifndef POLL_SCHEDULER_H
+#define POLL_SCHEDULER_H
+
+#include <stdint.h>
+#include "hash_map.h"
+
+typedef struct {
+    // Probe interval of a table that just changed or is pinned hot.
+    unsigned int hot_ms;
+    // Ceiling a quiet table backs off to.
+    unsigned int cold_ms;
+    // Most tables probed in one cycle; the rest wait for the next one.
+    int budget;
+} ScheduleConfig;
+
+// When one table is next fingerprinted. The interval doubles after every
+// quiet probe, from hot_ms up to cold_ms, and drops back to hot_ms as soon as
+// the fingerprint moves.
+typedef struct {
+    char *fingerprint;
+    unsigned int interval_ms;
+    uint64_t due_ms;
+    int gone;
+} TableSchedule;
+
+typedef struct {
+    ScheduleConfig config;
+    HashMap tables;
+    uint32_t rng;
+    unsigned long probes;
+    unsigned long changes;
+    unsigned long deferred;
+} PollScheduler;
+
+uint64_t poll_scheduler_now_ms(void);
+int poll_scheduler_init(PollScheduler *s, const ScheduleConfig *config);
+// Brings the table set in line with names, the current table list. New
+// tables are due at once; tables missing from the list are due at once too,
+// so the next probe records the drop.
+void poll_scheduler_sync(PollScheduler *s, char **names, int count, uint64_t now_ms);
+// Returns copies of the names due at now_ms, most overdue first and at most
+// config.budget of them. Free them with poll_scheduler_free_names().
+char **poll_scheduler_due(PollScheduler *s, uint64_t now_ms, int *count);
+void poll_scheduler_free_names(char **names, int count);
+// Records a probe of name. fingerprint is NULL when the table no longer
+// exists. hot keeps the table at hot_ms regardless of changes, e.g. for
+// tables the active feature branch has altered.
+void poll_scheduler_report(PollScheduler *s, const char *name, const char *fingerprint, int hot, uint64_t now_ms);
+// Milliseconds until the next table is due, at most max_ms.
+unsigned int poll_scheduler_next_wait(PollScheduler *s, uint64_t now_ms, unsigned int max_ms);
+void poll_scheduler_free(PollScheduler *s);
+
+#endif // POLL_SCHEDULER_H
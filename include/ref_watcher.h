@@ -0,0 +1,33 @@
+#ifndef REF_WATCHER_H
+#define REF_WATCHER_H
+
+#define REF_WATCHER_PATH_SIZE 512
+
+typedef struct {
+    int wd;
+    int kinds;
+    char path[REF_WATCHER_PATH_SIZE];
+} RefWatch;
+
+// inotify watches on the files git rewrites when HEAD or a branch moves:
+// HEAD and logs/HEAD in the git dir, packed-refs and refs/heads/** in the
+// common dir (they differ for linked worktrees). Directories are watched
+// rather than files because git replaces refs by renaming a .lock file.
+typedef struct {
+    int fd;
+    RefWatch *watches;
+    int watch_count;
+    int watch_capacity;
+    unsigned long events;
+} RefWatcher;
+
+// Returns -1 when inotify is unavailable; the caller then falls back to
+// polling and must still call ref_watcher_close().
+int ref_watcher_open(RefWatcher *watcher, const char *git_dir, const char *common_dir);
+// Blocks until a ref related change arrives, wake_fd (if not -1) becomes
+// readable or timeout_ms passes (-1 waits forever). Returns 1 when something
+// changed, 0 otherwise and -1 on error.
+int ref_watcher_wait(RefWatcher *watcher, int wake_fd, int timeout_ms);
+void ref_watcher_close(RefWatcher *watcher);
+
+#endif // REF_WATCHER_H
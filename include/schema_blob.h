@@ -0,0 +1,41 @@
+#ifndef SCHEMA_BLOB_H
+#define SCHEMA_BLOB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One normalized schema, stored once per distinct content no matter how many
+// tables, branches or snapshots refer to it. Two blobs are equal exactly when
+// they are the same pointer, so "differs from main" is a pointer or hash
+// comparison. hash is hash_string() of the text, the same digest the emitted
+// registry records.
+typedef struct SchemaBlob {
+    uint64_t hash;
+    size_t len;
+    unsigned long refs;
+    struct SchemaBlob *next;
+    char data[];
+} SchemaBlob;
+
+typedef struct {
+    unsigned long blobs;
+    unsigned long refs;
+    size_t bytes;
+    // Interns that found the content already held.
+    unsigned long shared;
+} SchemaBlobStats;
+
+// Returns the blob holding text, creating it on first use, with one more
+// reference. Safe to call from any thread.
+SchemaBlob *schema_blob_intern(const char *text);
+SchemaBlob *schema_blob_intern_len(const char *text, size_t len);
+// Returns the blob holding text, with one more reference, or NULL when no
+// such content is held. hash is hash_bytes() of text, already known to the
+// caller, so only the candidates with that hash are compared.
+SchemaBlob *schema_blob_find(uint64_t hash, const char *text, size_t len);
+SchemaBlob *schema_blob_retain(SchemaBlob *blob);
+// Drops one reference; the blob is freed with the last one. NULL is ignored.
+void schema_blob_release(SchemaBlob *blob);
+void schema_blob_get_stats(SchemaBlobStats *stats);
+
+#endif // SCHEMA_BLOB_H
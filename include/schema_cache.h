@@ -0,0 +1,45 @@
+#ifndef SCHEMA_CACHE_H
+#define SCHEMA_CACHE_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+#include "hash_map.h"
+#include "schema_blob.h"
+
+// Normalized content of one snapshot file on disk, e.g. the last known schema
+// in tables/<table>/schema.sql or the main baseline in
+// dbtables/main/schemas/<table>.sql. Files with the same content share one
+// blob. The file identity (inode, size, mtime) is remembered so that an
+// external edit invalidates the entry.
+typedef struct {
+    SchemaBlob *blob;
+    int present;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+} SchemaCacheEntry;
+
+// Process-wide cache of snapshot files keyed by path, which encodes the
+// branch directory and table the snapshot belongs to. Safe to call from the
+// capture workers; the lock only covers the map and the file reads.
+typedef struct {
+    HashMap entries;
+    pthread_mutex_t lock;
+    unsigned long hits;
+    unsigned long loads;
+} SchemaCache;
+
+int schema_cache_init(SchemaCache *cache);
+// Loads every <dir>/<name>/<leaf> file, or every <dir>/*.sql file when leaf
+// is NULL, so the watch loop starts warm.
+void schema_cache_preload(SchemaCache *cache, const char *dir, const char *leaf);
+// Returns a reference to the normalized content of path, which the caller
+// releases with schema_blob_release(), or NULL when the file does not exist.
+SchemaBlob *schema_cache_get_blob(SchemaCache *cache, const char *path);
+// Writes the blob to path unless the cached copy is already the same blob.
+// Returns 1 when the file was written, 0 when unchanged and -1 on failure.
+int schema_cache_put_blob(SchemaCache *cache, const char *path, SchemaBlob *blob);
+void schema_cache_free(SchemaCache *cache);
+
+#endif // SCHEMA_CACHE_H
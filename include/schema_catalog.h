@@ -0,0 +1,52 @@
+#ifndef SCHEMA_CATALOG_H
+#define SCHEMA_CATALOG_H
+
+#include "str_buf.h"
+#include "schema_blob.h"
+#include "schema_source.h"
+
+// One table as seen through information_schema. The fingerprint is a cheap
+// per-table hash computed server side; the signature is a canonical text model
+// of the table (columns, indexes, constraints and table options) built from
+// set-based queries; blob holds the normalized SHOW CREATE TABLE output
+// captured for that signature, or NULL when it still has to be fetched. The
+// raw DDL is not kept: tables with the same definition share one blob.
+typedef struct {
+    char *name;
+    char *fingerprint;
+    StrBuf signature;
+    SchemaBlob *blob;
+    int dirty;
+} CatalogTable;
+
+// Tables are kept sorted by name so lookups are a binary search. Results are
+// read from the schema source row by row; page_size > 0 also splits the table
+// enumeration into pages of that many tables (keyset pagination on the
+// name), so neither side materializes the whole catalog at once.
+typedef struct {
+    CatalogTable *tables;
+    int tables_count;
+    int capacity;
+    int page_size;
+} SchemaCatalog;
+
+// Compares the fingerprint of every table in db_name against the last seen
+// one. Only tables whose fingerprint moved have their model re-read, and the
+// captured schema is carried over whenever the model did not change, so a
+// quiet poll costs a single query. Tables left without a schema are flagged
+// dirty. Returns the number of dirty plus dropped tables, or -1 on failure,
+// leaving the catalog untouched.
+int catalog_refresh(SchemaSource *source, const char *db_name, SchemaCatalog *catalog);
+// Same as catalog_refresh() but only looks at the named tables, e.g. the ones
+// a DDL statement in the binlog touched; every other table is carried over
+// as is. names is sorted in place. Named tables that no longer exist count
+// as dropped.
+int catalog_refresh_tables(SchemaSource *source, const char *db_name, SchemaCatalog *catalog, char **names, int count);
+// Lists the table names of db_name without fingerprinting them, which is
+// cheap enough to spot created and dropped tables often, page_size names per
+// query (0 for one query). Free each name and the array.
+int catalog_list_tables(SchemaSource *source, const char *db_name, int page_size, char ***names, int *count);
+CatalogTable *catalog_find(SchemaCatalog *catalog, const char *table_name);
+void catalog_free(SchemaCatalog *catalog);
+
+#endif // SCHEMA_CATALOG_H
@@ -0,0 +1,47 @@
+#ifndef SCHEMA_DIFF_H
+#define SCHEMA_DIFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "str_buf.h"
+
+// One line of a CREATE TABLE statement, trimmed of surrounding whitespace and
+// trailing commas, with its hash computed once at tokenization time.
+typedef struct {
+    const char *text;
+    size_t len;
+    uint64_t hash;
+} SchemaLine;
+
+// A schema split into lines. All line texts point into buffer.
+typedef struct {
+    char *buffer;
+    SchemaLine *lines;
+    int count;
+} SchemaLines;
+
+// Result of comparing two schemas as sets of lines: a line is added when
+// only the new side has it and removed when only the old side has it. A
+// changed column is one removed and one added line; the table model pairs
+// them up by name. Order is not compared, as a reorder alone is not turned
+// into an ALTER.
+typedef struct {
+    int added_count;
+    int removed_count;
+} SchemaLineDiff;
+
+int schema_lines_parse(const char *schema, SchemaLines *out);
+void schema_lines_free(SchemaLines *lines);
+
+// Returns the column name of a column definition line (the first backtick
+// quoted identifier) without copying it, or 0 when the line has none.
+size_t schema_line_column(const SchemaLine *line, const char **name);
+
+// Matches lines through a hash index of each side, so the cost is O(n + m)
+// in the number of lines rather than O(n * m). Either side may be empty.
+int schema_diff_lines(const SchemaLines *old_lines, const SchemaLines *new_lines, SchemaLineDiff *diff);
+
+// Appends the up and down migration between two normalized schemas.
+void generate_alter_statements(const char *table_name, const char *old_schema, const char *new_schema, StrBuf *up_sql, StrBuf *down_sql);
+
+#endif // SCHEMA_DIFF_H
@@ -0,0 +1,71 @@
+#ifndef SCHEMA_MODEL_H
+#define SCHEMA_MODEL_H
+
+#include "schema_diff.h"
+#include "str_buf.h"
+
+// Structured view of one SHOW CREATE TABLE statement. All strings are owned
+// by the model; line points at the trimmed source line in the SchemaLines the
+// model was built from.
+typedef struct {
+    char *name;
+    char *definition;
+    char *type;
+    char *default_value;
+    char *attributes;
+    int nullable;
+    int position;
+    const SchemaLine *line;
+} ColumnDef;
+
+typedef enum {
+    INDEX_PRIMARY,
+    INDEX_UNIQUE,
+    INDEX_PLAIN,
+    INDEX_FULLTEXT,
+    INDEX_SPATIAL
+} IndexKind;
+
+typedef struct {
+    char *name;
+    char *definition;
+    IndexKind kind;
+    const SchemaLine *line;
+} IndexDef;
+
+typedef enum {
+    CONSTRAINT_FOREIGN_KEY,
+    CONSTRAINT_CHECK
+} ConstraintKind;
+
+typedef struct {
+    char *name;
+    char *definition;
+    ConstraintKind kind;
+    const SchemaLine *line;
+} ConstraintDef;
+
+typedef struct {
+    ColumnDef *columns;
+    int column_count;
+    IndexDef *indexes;
+    int index_count;
+    ConstraintDef *constraints;
+    int constraint_count;
+} TableModel;
+
+// Builds the model from already tokenized lines. Lines that are not column,
+// index or constraint definitions (header, table options, partitioning) are
+// ignored. Returns -1 when the schema is not a CREATE TABLE statement.
+int table_model_parse(const SchemaLines *lines, TableModel *model);
+void table_model_free(TableModel *model);
+
+// Appends the statements that turn from into to, one ALTER TABLE per line.
+// Changes MySQL can apply online carry ALGORITHM=INPLACE, LOCK=NONE (or
+// LOCK=SHARED for full-text and spatial indexes); the rest carry no hint
+// and let the server choose. A column is never renamed on a guess: a
+// dropped and an added column that look like a rename stay a DROP and an
+// ADD, preceded by a "-- possible rename" comment line.
+void table_model_alter(const char *table_name, const TableModel *from, const TableModel *to, StrBuf *out_sql);
+
+#endif // SCHEMA_MODEL_H
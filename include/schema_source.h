@@ -0,0 +1,59 @@
+#ifndef SCHEMA_SOURCE_H
+#define SCHEMA_SOURCE_H
+
+#include <mysql/mysql.h>
+#include "str_buf.h"
+
+// The row sets that make up a table's model, in the order the catalog reads
+// them. Rows follow the information_schema views they come from, table name
+// first: TABLES (type, engine, collation, options, comment), COLUMNS
+// (position, name, type, nullable, default, extra, charset, collation,
+// comment, generation expression) ordered by position, INDEXES (name, seq,
+// column, non_unique, sub_part, collation, type, comment, visible,
+// expression) and CONSTRAINTS (name, type, position, column, referenced
+// table and column, update and delete rules, check clause, enforced). Every
+// field the fingerprint hashes is part of the model, so a moved fingerprint
+// with an unchanged model really is unchanged.
+typedef enum {
+    SOURCE_TABLES,
+    SOURCE_COLUMNS,
+    SOURCE_INDEXES,
+    SOURCE_CONSTRAINTS,
+    SOURCE_MODEL_COUNT
+} SourceModel;
+
+// Gets one row. Returns non-zero to abandon the read as failed.
+typedef int (*SourceRowFn)(char **row, unsigned int fields, void *arg);
+
+typedef struct SchemaSource SchemaSource;
+
+// Where the catalog and the capture read schemas from. names, when not
+// NULL, limits a read to those count tables (sorted); after and limit page
+// by table name, after NULL being the first page and limit 0 no paging.
+// Reads return the number of rows passed to row, or -1 on failure.
+typedef struct {
+    // (table name, fingerprint), where the fingerprint moves whenever
+    // anything in the table's model does.
+    int (*fingerprints)(SchemaSource *source, const char *db_name, char **names, int count,
+                        const char *after, int limit, SourceRowFn row, void *arg);
+    int (*table_names)(SchemaSource *source, const char *db_name, const char *after, int limit,
+                       SourceRowFn row, void *arg);
+    int (*model)(SchemaSource *source, const char *db_name, SourceModel model, char **names, int count,
+                 SourceRowFn row, void *arg);
+    // The CREATE TABLE statement of the table, or NULL. Called from the
+    // capture workers at once, each on the source of its own connection.
+    char *(*show_create)(SchemaSource *source, const char *db_name, const char *table_name);
+} SchemaSourceOps;
+
+struct SchemaSource {
+    const SchemaSourceOps *ops;
+    void *impl;
+};
+
+// Reads from the server over conn. Nothing is allocated, so a source can be
+// set up on the stack for each connection as it is used.
+void schema_source_mysql(SchemaSource *source, MYSQL *conn);
+// Appends SHOW CREATE TABLE for db_name.table_name to query.
+void schema_source_append_show_create(StrBuf *query, const char *db_name, const char *table_name);
+
+#endif // SCHEMA_SOURCE_H
@@ -0,0 +1,88 @@
+#ifndef SNAPSHOT_STORE_H
+#define SNAPSHOT_STORE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "hash_map.h"
+
+// Scope of the records that back tables/<t>/; any other scope is a branch
+// whose baseline schemas export to dbtables/<scope>/schemas/<t>.sql.
+#define SNAPSHOT_SCOPE_LIVE "live"
+
+typedef enum {
+    SNAPSHOT_SCHEMA = 1,
+    SNAPSHOT_HISTORY = 2,
+    SNAPSHOT_MIGRATION_UP = 3,
+    SNAPSHOT_MIGRATION_DOWN = 4,
+    SNAPSHOT_TOC = 5,
+    SNAPSHOT_BLOB = 6
+} SnapshotKind;
+
+// One record as seen through the mapping. The strings point into the mapped
+// file and stay valid until the next append.
+typedef struct {
+    uint64_t offset;
+    SnapshotKind kind;
+    time_t timestamp;
+    const char *scope;
+    const char *table;
+    const char *label;
+    const char *data;
+    size_t data_len;
+    // Set by snapshot_store_scan() for schema records, whose data is then the
+    // hex hash of the SNAPSHOT_BLOB record holding the text.
+    int blob_ref;
+} SnapshotRecord;
+
+typedef void (*SnapshotRecordFn)(const SnapshotRecord *record, void *arg);
+
+// Append-only file of versioned records keyed by (kind, scope, table). Every
+// record links to the previous version of its key, and the table of contents
+// maps each key to its newest record, so the latest version is one hash
+// lookup and one pointer into the mapping away. The table of contents is
+// written out on close; a store that was not closed cleanly is rebuilt by
+// scanning the records after the last one.
+typedef struct {
+    int fd;
+    char *path;
+    unsigned char *map;
+    size_t map_size;
+    uint64_t file_size;
+    uint64_t toc_offset;
+    HashMap toc;
+    pthread_mutex_t lock;
+    int read_only;
+    unsigned long appends;
+} SnapshotStore;
+
+// read_only opens an existing store without ever writing to it, e.g. to
+// export it while the watcher keeps appending.
+int snapshot_store_open(SnapshotStore *store, const char *path, int read_only);
+// Returns the newest data for the key, or NULL. The pointer stays valid
+// until the next append, so lookups must not race with the write phase.
+const char *snapshot_store_get(SnapshotStore *store, SnapshotKind kind, const char *scope, const char *table);
+// Gives the hash_bytes() digest of the newest data for the key without
+// reading it; for schemas it is the content address. Returns 0 when the key
+// has no data.
+int snapshot_store_get_hash(SnapshotStore *store, SnapshotKind kind, const char *scope, const char *table,
+                            uint64_t *hash);
+// Appends a version unless it is identical to the newest one. label names
+// the version, e.g. the timestamp of a migration. Schema text is stored
+// once per distinct content and shared by every (branch, table) holding it.
+// Returns 1 when appended, 0 when unchanged and -1 on failure.
+int snapshot_store_put(SnapshotStore *store, SnapshotKind kind, const char *scope, const char *table,
+                       const char *label, const char *data);
+// Calls fn for every version of the key, oldest first.
+int snapshot_store_history(SnapshotStore *store, SnapshotKind kind, const char *scope, const char *table,
+                           SnapshotRecordFn fn, void *arg);
+// Calls fn for every record in file order.
+void snapshot_store_scan(SnapshotStore *store, SnapshotRecordFn fn, void *arg);
+// Materializes the directory layout of the file backend under root:
+// tables/<t>/{schema.sql,history.txt,migrations/} and
+// dbtables/<branch>/schemas/<t>.sql. Returns the number of files written.
+int snapshot_store_export(SnapshotStore *store, const char *root);
+void snapshot_store_close(SnapshotStore *store);
+
+#endif // SNAPSHOT_STORE_H
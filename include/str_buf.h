@@ -0,0 +1,38 @@
+#ifndef STR_BUF_H
+#define STR_BUF_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+// Growable, always NUL-terminated string. Capacity doubles, so appends are
+// amortized O(1) and never rescan what is already in the buffer.
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} StrBuf;
+
+#define STR_BUF_INIT { NULL, 0, 0 }
+#define STR_BUF_SCRATCH_SLOTS 4
+
+void sb_init(StrBuf *sb);
+int sb_reserve(StrBuf *sb, size_t extra);
+int sb_append(StrBuf *sb, const char *text);
+int sb_append_len(StrBuf *sb, const char *text, size_t len);
+int sb_appendf(StrBuf *sb, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int sb_vappendf(StrBuf *sb, const char *fmt, va_list args);
+// Returns the contents, or "" for a buffer that never grew.
+const char *sb_str(const StrBuf *sb);
+// Empties the buffer but keeps its capacity for reuse.
+void sb_reset(StrBuf *sb);
+// Hands the heap string to the caller and leaves the buffer empty.
+char *sb_detach(StrBuf *sb);
+void sb_free(StrBuf *sb);
+
+// Per-thread scratch buffers that keep their capacity between uses, so hot
+// paths do not allocate once they have warmed up. The returned buffer is
+// reset and never NULL; slot must be below STR_BUF_SCRATCH_SLOTS and callers
+// must not hold the same slot twice.
+StrBuf *sb_scratch(int slot);
+
+#endif // STR_BUF_H
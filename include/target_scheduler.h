@@ -0,0 +1,55 @@
+#ifndef TARGET_SCHEDULER_H
+#define TARGET_SCHEDULER_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "mysql_service.h"
+#include "db_connection.h"
+#include "app_context.h"
+
+// Connections to one server (host, port and user), shared by every target
+// on it. At most size of them exist; a target borrows one for a poll cycle
+// and hands it back, so a server with many databases costs no more
+// connections than it has cycles running at once.
+typedef struct {
+    DBConfig config;
+    DbConnection *slots;
+    int *busy;
+    int size;
+    int in_use;
+} ServerPool;
+
+typedef struct {
+    TargetConfig *config;
+    WatchTarget *target;
+    ServerPool *server;
+    uint64_t due_ms;
+    int running;
+    pthread_t thread;
+    int has_thread;
+} ScheduledTarget;
+
+// Multiplexes the poll targets of a multi-target .env over watch_threads
+// threads: each thread runs the cycle of the most overdue target whose
+// server has a free connection. Binlog targets hold a stream open for good
+// and get a thread and connection of their own.
+typedef struct {
+    AppContext *ctx;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int stopping;
+    ScheduledTarget *targets;
+    int count;
+    ServerPool *servers;
+    int server_count;
+    pthread_t *threads;
+    int thread_count;
+    unsigned long cycles;
+} TargetScheduler;
+
+// Watches every target until stop is requested. defaults supplies
+// WATCH_THREADS; SERVER_MAX_CONNECTIONS is taken from the first target on
+// each server.
+void watch_targets(TargetConfig *targets, int count, const DBConfig *defaults, AppContext *ctx);
+
+#endif // TARGET_SCHEDULER_H
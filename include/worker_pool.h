@@ -0,0 +1,50 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <pthread.h>
+#include <mysql/mysql.h>
+#include "mysql_service.h"
+#include "db_connection.h"
+#include "app_context.h"
+
+// Runs one job. conn is the calling worker's connection, or NULL while that
+// connection is backing off; jobs that need the server must then skip it.
+typedef void (*WorkerJobFn)(MYSQL *conn, int index, void *arg);
+
+struct WorkerPool;
+
+typedef struct {
+    struct WorkerPool *pool;
+    pthread_t thread;
+    DbConnection connection;
+    int started;
+} Worker;
+
+// Fixed set of capture threads, each owning one connection from the pool, so
+// per-table round trips overlap instead of queueing on a single handle. Jobs
+// are indices into the caller's work list and are handed out one at a time.
+typedef struct WorkerPool {
+    AppContext *ctx;
+    Worker *workers;
+    int size;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    unsigned long batch;
+    int shutdown;
+    WorkerJobFn fn;
+    void *arg;
+    int job_count;
+    int next_job;
+    int active;
+} WorkerPool;
+
+// Starts size workers. A size below 2 starts none and runs every batch on
+// the caller's connection instead.
+int worker_pool_start(WorkerPool *pool, DBConfig *config, AppContext *ctx, int size);
+// Calls fn for every index in [0, count) and returns once all of them ran.
+// conn is only used when the pool has no workers.
+void worker_pool_run(WorkerPool *pool, MYSQL *conn, int count, WorkerJobFn fn, void *arg);
+void worker_pool_stop(WorkerPool *pool);
+
+#endif // WORKER_POOL_H
@@ -1,15 +1,65 @@
+#include <errno.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
-#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include "app_context.h"
+#include "logger.h"
+#include "metrics.h"
 
-static void ensure_logs_dir(void)
+int app_context_init(AppContext *ctx)
 {
-    struct stat st = {0};
-    if (stat("logs", &st) == -1) {
-        mkdir("logs", 0700);
+    pthread_condattr_t attr;
+
+    memset(ctx, 0, sizeof(*ctx));
+    snprintf(ctx->current_branch, sizeof(ctx->current_branch), "%s", "unknown");
+    pthread_mutex_init(&ctx->lock, NULL);
+
+    // Timed waits are measured on the monotonic clock so that a wall clock
+    // jump does not stretch or cut short the poll interval.
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ctx->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    ctx->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ctx->wake_fd < 0) {
+        perror("eventfd");
+        return -1;
+    }
+    return 0;
+}
+
+void app_context_destroy(AppContext *ctx)
+{
+    if (ctx->wake_fd >= 0) {
+        close(ctx->wake_fd);
+        ctx->wake_fd = -1;
+    }
+    pthread_cond_destroy(&ctx->cond);
+    pthread_mutex_destroy(&ctx->lock);
+}
+
+void app_request_stop(AppContext *ctx)
+{
+    if (!ctx) {
+        return;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->stop = 1;
+    pthread_cond_broadcast(&ctx->cond);
+    pthread_mutex_unlock(&ctx->lock);
+
+    // The counter is never read back, so the fd stays readable for good.
+    if (ctx->wake_fd >= 0) {
+        uint64_t one = 1;
+        if (write(ctx->wake_fd, &one, sizeof(one)) < 0) {
+            perror("eventfd write");
+        }
     }
 }
 
@@ -19,56 +69,146 @@ void app_set_branch(AppContext *ctx, const char *branch_name)
         return;
     }
 
+    const char *name = branch_name ? branch_name : "unknown";
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->branch_generation == 0 || strcmp(ctx->current_branch, name) != 0) {
+        snprintf(ctx->current_branch, sizeof(ctx->current_branch), "%s", name);
+        ctx->branch_generation++;
+        ctx->change_seq++;
+        metrics_git_changed(ctx->change_seq);
+        pthread_cond_broadcast(&ctx->cond);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+void app_notify_commit(AppContext *ctx)
+{
+    if (!ctx) {
+        return;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->change_seq++;
+    metrics_git_changed(ctx->change_seq);
+    pthread_cond_broadcast(&ctx->cond);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+void app_set_head(AppContext *ctx, const char *oid_hex)
+{
+    if (!ctx || !oid_hex) {
+        return;
+    }
+
     pthread_mutex_lock(&ctx->lock);
-    snprintf(ctx->current_branch, sizeof(ctx->current_branch), "%s",
-             branch_name ? branch_name : "unknown");
+    snprintf(ctx->head_oid, sizeof(ctx->head_oid), "%s", oid_hex);
     pthread_mutex_unlock(&ctx->lock);
 }
 
-void app_get_branch(AppContext *ctx, char *out, size_t out_size)
+void app_get_head(AppContext *ctx, char *out, size_t out_size)
 {
     if (!out || out_size == 0) {
         return;
     }
     out[0] = '\0';
+    if (!ctx) {
+        return;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    snprintf(out, out_size, "%s", ctx->head_oid);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+unsigned long app_get_branch(AppContext *ctx, char *out, size_t out_size)
+{
+    unsigned long generation = 0;
+    if (!out || out_size == 0) {
+        return 0;
+    }
+    out[0] = '\0';
 
     if (!ctx) {
         snprintf(out, out_size, "%s", "unknown");
-        return;
+        return 0;
     }
 
     pthread_mutex_lock(&ctx->lock);
     snprintf(out, out_size, "%s",
              ctx->current_branch[0] ? ctx->current_branch : "unknown");
+    generation = ctx->branch_generation;
     pthread_mutex_unlock(&ctx->lock);
+    return generation;
 }
 
-void app_log(AppContext *ctx, const char *fmt, ...)
+unsigned long app_branch_generation(AppContext *ctx)
 {
-    char message[1024];
-    va_list args;
-    va_start(args, fmt);
-    vsnprintf(message, sizeof(message), fmt, args);
-    va_end(args);
+    unsigned long generation = 0;
+    if (!ctx) {
+        return 0;
+    }
 
-    ensure_logs_dir();
+    pthread_mutex_lock(&ctx->lock);
+    generation = ctx->branch_generation;
+    pthread_mutex_unlock(&ctx->lock);
+    return generation;
+}
 
-    if (ctx) {
-        pthread_mutex_lock(&ctx->lock);
+unsigned long app_change_seq(AppContext *ctx)
+{
+    unsigned long seq = 0;
+    if (!ctx) {
+        return 0;
     }
 
-    FILE *fp = fopen("logs/app.log", "a");
-    if (fp) {
-        time_t now = time(NULL);
-        struct tm tm_now;
-        localtime_r(&now, &tm_now);
-        char ts[32];
-        strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &tm_now);
-        fprintf(fp, "[%s] %s\n", ts, message);
-        fclose(fp);
+    pthread_mutex_lock(&ctx->lock);
+    seq = ctx->change_seq;
+    pthread_mutex_unlock(&ctx->lock);
+    return seq;
+}
+
+int app_wait_for_change(AppContext *ctx, unsigned long *seen, unsigned int timeout_ms)
+{
+    struct timespec deadline;
+    int rc = 0;
+
+    if (!ctx) {
+        struct timespec ts = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L };
+        nanosleep(&ts, NULL);
+        return 0;
     }
 
-    if (ctx) {
-        pthread_mutex_unlock(&ctx->lock);
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    while (!ctx->stop && ctx->change_seq == *seen) {
+        if (pthread_cond_timedwait(&ctx->cond, &ctx->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
     }
+    if (ctx->stop) {
+        rc = -1;
+    } else if (ctx->change_seq != *seen) {
+        rc = 1;
+    }
+    *seen = ctx->change_seq;
+    pthread_mutex_unlock(&ctx->lock);
+    return rc;
+}
+
+void app_log(AppContext *ctx, const char *fmt, ...)
+{
+    // Logging never takes ctx->lock: the record is queued for the log
+    // writer thread, so stop and branch checks are not held up by disk I/O.
+    (void)ctx;
+    va_list args;
+    va_start(args, fmt);
+    log_vmessage(LOG_LEVEL_INFO, fmt, args);
+    va_end(args);
 }
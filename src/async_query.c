@@ -0,0 +1,218 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "async_query.h"
+#include "logger.h"
+#include "metrics.h"
+
+#define MAX_EVENTS 64
+// How long the loop sleeps before it drives every busy connection anyway,
+// in case the client already buffered the reply it is waiting for.
+#define ASYNC_WAIT_MS 100
+// Error codes from 2000 up come from the client library: the connection
+// itself is broken, not just the query.
+#define CLIENT_ERROR_MIN 2000
+
+typedef struct {
+    AsyncQueryPool *pool;
+    int count;
+    int next;
+    int in_flight;
+    int failed;
+    AsyncQueryFn query;
+    AsyncRowFn row;
+    void *arg;
+} AsyncRun;
+
+int async_query_start(AsyncQueryPool *pool, DBConfig *config, AppContext *ctx, int size) {
+    memset(pool, 0, sizeof(*pool));
+    pool->ctx = ctx;
+    pool->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (pool->epoll_fd < 0) {
+        perror("epoll_create1");
+        return -1;
+    }
+    pool->slots = calloc((size_t)size, sizeof(AsyncSlot));
+    if (!pool->slots) {
+        close(pool->epoll_fd);
+        return -1;
+    }
+    for (int i = 0; i < size; i++) {
+        db_connection_init(&pool->slots[i].connection, config);
+        pool->slots[i].fd = -1;
+    }
+    pool->size = size;
+    app_log(ctx, "MySQL: async capture over %d connection(s) on one thread", size);
+    return 0;
+}
+
+static void drop_slot(AsyncQueryPool *pool, AsyncSlot *slot) {
+    if (slot->fd >= 0) {
+        epoll_ctl(pool->epoll_fd, EPOLL_CTL_DEL, slot->fd, NULL);
+        slot->fd = -1;
+    }
+    db_connection_reset(&slot->connection);
+}
+
+// Connects the slot if needed. An open connection is not pinged: a dead one
+// shows up as a client error on the query and is reopened for the next.
+static MYSQL *open_slot(AsyncQueryPool *pool, AsyncSlot *slot, int index) {
+    if (slot->connection.state == DB_CONN_CONNECTED) {
+        return slot->connection.conn;
+    }
+    MYSQL *conn = db_connection_acquire(&slot->connection, pool->ctx);
+    if (!conn) {
+        return NULL;
+    }
+    // The client library only exposes the socket as net.fd.
+    struct epoll_event event = { .events = EPOLLIN, .data.u32 = (uint32_t)index };
+    if (epoll_ctl(pool->epoll_fd, EPOLL_CTL_ADD, conn->net.fd, &event) != 0) {
+        perror("epoll_ctl");
+        db_connection_reset(&slot->connection);
+        return NULL;
+    }
+    slot->fd = conn->net.fd;
+    return conn;
+}
+
+static void finish(AsyncRun *run, AsyncSlot *slot, MYSQL_ROW row) {
+    run->row(slot->index, row, run->arg);
+    if (slot->result) {
+        mysql_free_result(slot->result);
+        slot->result = NULL;
+    }
+    slot->state = ASYNC_IDLE;
+    run->in_flight--;
+    run->pool->queries++;
+    metrics_add(COUNTER_QUERIES, 1);
+}
+
+static void fail(AsyncRun *run, AsyncSlot *slot) {
+    MYSQL *conn = slot->connection.conn;
+    log_message(LOG_LEVEL_WARN, "MySQL: async query failed (%u): %s", mysql_errno(conn), mysql_error(conn));
+    int broken = mysql_errno(conn) >= CLIENT_ERROR_MIN;
+    run->failed++;
+    run->pool->failures++;
+    metrics_add(COUNTER_ERRORS, 1);
+    finish(run, slot, NULL);
+    if (broken) {
+        drop_slot(run->pool, slot);
+    }
+}
+
+// Moves the slot's query as far as it goes without blocking.
+static void advance(AsyncRun *run, AsyncSlot *slot) {
+    MYSQL *conn = slot->connection.conn;
+    enum net_async_status status;
+    if (slot->state == ASYNC_QUERY) {
+        status = mysql_real_query_nonblocking(conn, sb_str(&slot->sql), (unsigned long)slot->sql.len);
+        if (status == NET_ASYNC_NOT_READY) {
+            return;
+        }
+        if (status == NET_ASYNC_ERROR) {
+            fail(run, slot);
+            return;
+        }
+        slot->state = ASYNC_STORE;
+    }
+    if (slot->state == ASYNC_STORE) {
+        status = mysql_store_result_nonblocking(conn, &slot->result);
+        if (status == NET_ASYNC_NOT_READY) {
+            return;
+        }
+        // Every query run here returns rows, so no result set means the
+        // query failed even when the status says it completed.
+        if (status == NET_ASYNC_ERROR || !slot->result) {
+            fail(run, slot);
+            return;
+        }
+        finish(run, slot, mysql_fetch_row(slot->result));
+    }
+}
+
+// Hands the next index to an idle slot. Returns 0 once none is left.
+static int begin(AsyncRun *run, AsyncSlot *slot, int slot_index) {
+    while (run->next < run->count) {
+        int index = run->next++;
+        sb_reset(&slot->sql);
+        if (!run->query(index, &slot->sql, run->arg)) {
+            continue;
+        }
+        if (!open_slot(run->pool, slot, slot_index)) {
+            // Left for a slot that is connected.
+            run->next--;
+            return 0;
+        }
+        slot->index = index;
+        slot->state = ASYNC_QUERY;
+        run->in_flight++;
+        if (run->in_flight > run->pool->max_in_flight) {
+            run->pool->max_in_flight = run->in_flight;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+int async_query_run(AsyncQueryPool *pool, int count, AsyncQueryFn query, AsyncRowFn row, void *arg) {
+    AsyncRun run = { pool, count, 0, 0, 0, query, row, arg };
+    struct epoll_event events[MAX_EVENTS];
+
+    for (;;) {
+        for (int i = 0; i < pool->size; i++) {
+            AsyncSlot *slot = &pool->slots[i];
+            // A query can complete without waiting, e.g. on an error, so the
+            // slot may be idle again straight away.
+            while (slot->state == ASYNC_IDLE && begin(&run, slot, i)) {
+                advance(&run, slot);
+            }
+        }
+        if (run.in_flight == 0) {
+            // Either done or no connection could be opened; indices never
+            // handed to a slot did not fail, they were not run.
+            if (run.next < run.count) {
+                log_message(LOG_LEVEL_WARN, "MySQL: no async connection available, %d index(es) not queried",
+                            run.count - run.next);
+            }
+            break;
+        }
+
+        int ready = epoll_wait(pool->epoll_fd, events, MAX_EVENTS, ASYNC_WAIT_MS);
+        if (ready < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            ready = 0;
+        }
+        if (ready > 0) {
+            for (int i = 0; i < ready; i++) {
+                AsyncSlot *slot = &pool->slots[events[i].data.u32];
+                if (slot->state != ASYNC_IDLE) {
+                    advance(&run, slot);
+                }
+            }
+        } else {
+            for (int i = 0; i < pool->size; i++) {
+                if (pool->slots[i].state != ASYNC_IDLE) {
+                    advance(&run, &pool->slots[i]);
+                }
+            }
+        }
+    }
+    return run.failed;
+}
+
+void async_query_stop(AsyncQueryPool *pool) {
+    for (int i = 0; i < pool->size; i++) {
+        drop_slot(pool, &pool->slots[i]);
+        sb_free(&pool->slots[i].sql);
+    }
+    free(pool->slots);
+    pool->slots = NULL;
+    pool->size = 0;
+    if (pool->epoll_fd >= 0) {
+        close(pool->epoll_fd);
+        pool->epoll_fd = -1;
+    }
+}
@@ -0,0 +1,511 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "binlog_watcher.h"
+#include "ddl_scan.h"
+
+// Binlog v4 event layout, see the MySQL internals manual.
+#define EVENT_HEADER_LEN 19
+#define EVENT_TYPE_OFFSET 4
+#define EVENT_SIZE_OFFSET 9
+#define EVENT_LOG_POS_OFFSET 13
+#define CHECKSUM_LEN 4
+#define BINLOG_MAGIC_LEN 4
+
+#define QUERY_EVENT 2
+#define ROTATE_EVENT 4
+#define FORMAT_DESCRIPTION_EVENT 15
+#define HEARTBEAT_LOG_EVENT 27
+
+// Offsets inside FORMAT_DESCRIPTION_EVENT: binlog version (2), server
+// version (50), create timestamp (4), common header length (1), then one
+// post-header length per event type.
+#define FDE_POST_HEADER_LENS_OFFSET (EVENT_HEADER_LEN + 2 + 50 + 4 + 1)
+#define QUERY_POST_HEADER_LEN 13
+
+#define HEARTBEAT_PERIOD_NS "500000000"
+#define READ_TIMEOUT_SECONDS 10
+#define FILE_POLL_MS 100
+
+static uint32_t read_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read_le16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint64_t read_le64(const unsigned char *p) {
+    return (uint64_t)read_le32(p) | ((uint64_t)read_le32(p + 4) << 32);
+}
+
+static void sleep_ms(unsigned int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+typedef struct {
+    BinlogWatcher *bw;
+    int matched;
+} ScanResult;
+
+static void on_table(const char *db, const char *table, void *arg) {
+    ScanResult *result = arg;
+    BinlogWatcher *bw = result->bw;
+    if (strcmp(db, bw->config->name) != 0) {
+        return;
+    }
+    result->matched = 1;
+    if (!table) {
+        bw->full_refresh = 1;
+    } else if (!hash_map_get(&bw->tables, table)) {
+        hash_map_put(&bw->tables, table, bw);
+    }
+}
+
+// QUERY_EVENT body: thread id (4), exec time (4), db length (1), error code
+// (2), status vars length (2), status vars, db name, NUL, statement.
+static int handle_query(BinlogWatcher *bw, const unsigned char *event, size_t len) {
+    const unsigned char *body = event + EVENT_HEADER_LEN;
+    size_t body_len = len - EVENT_HEADER_LEN;
+    size_t post = bw->query_post_header_len;
+    if (body_len < post) {
+        return 0;
+    }
+
+    size_t db_len = body[8];
+    size_t status_len = read_le16(body + 11);
+    size_t db_offset = post + status_len;
+    size_t query_offset = db_offset + db_len + 1;
+    if (query_offset > body_len) {
+        return 0;
+    }
+
+    char db[BINLOG_NAME_SIZE];
+    snprintf(db, sizeof(db), "%.*s", (int)db_len, (const char *)body + db_offset);
+
+    ScanResult result = { bw, 0 };
+    DdlResult kind = ddl_scan((const char *)body + query_offset, body_len - query_offset, db,
+                              on_table, &result);
+    if (kind == DDL_UNKNOWN && (db[0] == '\0' || strcmp(db, bw->config->name) == 0)) {
+        bw->full_refresh = 1;
+        result.matched = 1;
+    }
+    if (result.matched) {
+        bw->ddl_events++;
+    }
+    return result.matched;
+}
+
+#define EVENT_OTHER 0
+#define EVENT_DDL 1
+#define EVENT_HEARTBEAT 2
+#define EVENT_ROTATE 3
+
+// Returns EVENT_DDL when the event carried DDL for the watched database,
+// EVENT_ROTATE when the log moved to the file named in bw->rotate_to,
+// EVENT_HEARTBEAT for a heartbeat and EVENT_OTHER otherwise. Checksums are
+// stripped, not verified: the server checks them before sending or writing.
+static int handle_event(BinlogWatcher *bw, const unsigned char *event, size_t len) {
+    if (len < EVENT_HEADER_LEN) {
+        return EVENT_OTHER;
+    }
+    bw->events++;
+    unsigned char type = event[EVENT_TYPE_OFFSET];
+    uint32_t log_pos = read_le32(event + EVENT_LOG_POS_OFFSET);
+    if (log_pos != 0) {
+        bw->position = log_pos;
+    }
+
+    if (type == FORMAT_DESCRIPTION_EVENT) {
+        // The algorithm byte and a checksum slot are always present.
+        if (len >= FDE_POST_HEADER_LENS_OFFSET + QUERY_EVENT + 1 + CHECKSUM_LEN) {
+            bw->checksum = event[len - CHECKSUM_LEN - 1] == 1;
+            bw->query_post_header_len = event[FDE_POST_HEADER_LENS_OFFSET + QUERY_EVENT - 1];
+        }
+        return EVENT_OTHER;
+    }
+
+    size_t payload_len = len;
+    if (bw->checksum && payload_len >= EVENT_HEADER_LEN + CHECKSUM_LEN) {
+        payload_len -= CHECKSUM_LEN;
+    }
+
+    switch (type) {
+    case QUERY_EVENT:
+        return handle_query(bw, event, payload_len) ? EVENT_DDL : EVENT_OTHER;
+    case ROTATE_EVENT:
+        if (payload_len < EVENT_HEADER_LEN + 8) {
+            return EVENT_OTHER;
+        }
+        snprintf(bw->rotate_to, sizeof(bw->rotate_to), "%.*s", (int)(payload_len - EVENT_HEADER_LEN - 8),
+                 (const char *)event + EVENT_HEADER_LEN + 8);
+        bw->rotate_position = read_le64(event + EVENT_HEADER_LEN);
+        return EVENT_ROTATE;
+    case HEARTBEAT_LOG_EVENT:
+        return EVENT_HEARTBEAT;
+    default:
+        return EVENT_OTHER;
+    }
+}
+
+// Runs a statement whose failure is tolerated, e.g. setting a session
+// variable only one server version knows.
+static int run_optional(MYSQL *conn, const char *sql) {
+    if (mysql_query(conn, sql)) {
+        return -1;
+    }
+    MYSQL_RES *result = mysql_store_result(conn);
+    if (result) {
+        mysql_free_result(result);
+    }
+    return 0;
+}
+
+// Reads the current binlog file and position; the statement was renamed in
+// MySQL 8.4.
+static int read_log_status(BinlogWatcher *bw) {
+    const char *queries[] = { "SHOW BINARY LOG STATUS", "SHOW MASTER STATUS" };
+    for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++) {
+        if (mysql_query(bw->conn, queries[i])) {
+            continue;
+        }
+        MYSQL_RES *result = mysql_store_result(bw->conn);
+        if (!result) {
+            continue;
+        }
+        MYSQL_ROW row = mysql_fetch_row(result);
+        int ok = row && row[0] && row[1];
+        if (ok) {
+            snprintf(bw->file_name, sizeof(bw->file_name), "%s", row[0]);
+            bw->position = strtoull(row[1], NULL, 10);
+        }
+        mysql_free_result(result);
+        if (ok) {
+            return 0;
+        }
+    }
+    fprintf(stderr, "Binlog: binary logging is not enabled on the server\n");
+    return -1;
+}
+
+static int read_checksum_setting(BinlogWatcher *bw) {
+    if (mysql_query(bw->conn, "SELECT @@global.binlog_checksum")) {
+        return -1;
+    }
+    MYSQL_RES *result = mysql_store_result(bw->conn);
+    if (!result) {
+        return -1;
+    }
+    MYSQL_ROW row = mysql_fetch_row(result);
+    bw->checksum = row && row[0] && strcasecmp(row[0], "CRC32") == 0;
+    mysql_free_result(result);
+    return 0;
+}
+
+static int open_server(BinlogWatcher *bw) {
+    DBConfig *config = bw->config;
+    unsigned int read_timeout = READ_TIMEOUT_SECONDS;
+
+    bw->conn = mysql_init(NULL);
+    if (!bw->conn) {
+        return -1;
+    }
+    // Heartbeats arrive every 500 ms on an idle log, so a read that takes
+    // longer than this means the server is gone.
+    mysql_options(bw->conn, MYSQL_OPT_READ_TIMEOUT, &read_timeout);
+    if (!mysql_real_connect(bw->conn, config->host, config->user, config->pass, NULL, config->port, NULL, 0)) {
+        fprintf(stderr, "Binlog: connect failed: %s\n", mysql_error(bw->conn));
+        return -1;
+    }
+    if (read_checksum_setting(bw) != 0 || read_log_status(bw) != 0) {
+        return -1;
+    }
+
+    // Declare checksum support so the server does not refuse the dump, and
+    // ask for heartbeats so an idle log still lets the poll return. Both the
+    // pre- and post-8.0.26 variable names are set; one of each is ignored.
+    run_optional(bw->conn, "SET @master_binlog_checksum = @@global.binlog_checksum");
+    run_optional(bw->conn, "SET @source_binlog_checksum = @@global.binlog_checksum");
+    run_optional(bw->conn, "SET @master_heartbeat_period = " HEARTBEAT_PERIOD_NS);
+    run_optional(bw->conn, "SET @source_heartbeat_period = " HEARTBEAT_PERIOD_NS);
+
+    memset(&bw->rpl, 0, sizeof(bw->rpl));
+    bw->rpl.file_name = bw->file_name;
+    bw->rpl.file_name_length = strlen(bw->file_name);
+    bw->rpl.start_position = bw->position;
+    bw->rpl.server_id = config->binlog_server_id;
+    bw->rpl.flags = 0;
+    if (mysql_binlog_open(bw->conn, &bw->rpl)) {
+        fprintf(stderr, "Binlog: dump request failed: %s\n", mysql_error(bw->conn));
+        return -1;
+    }
+    return 0;
+}
+
+static int poll_server(BinlogWatcher *bw) {
+    for (;;) {
+        if (mysql_binlog_fetch(bw->conn, &bw->rpl)) {
+            fprintf(stderr, "Binlog: read failed: %s\n", mysql_error(bw->conn));
+            return -1;
+        }
+        if (bw->rpl.size == 0) {
+            return -1;
+        }
+        // The packet starts with the OK byte of the protocol.
+        int rc = handle_event(bw, bw->rpl.buffer + 1, bw->rpl.size - 1);
+        if (rc == EVENT_DDL) {
+            return 1;
+        }
+        if (rc == EVENT_HEARTBEAT) {
+            return 0;
+        }
+        if (rc == EVENT_ROTATE) {
+            snprintf(bw->file_name, sizeof(bw->file_name), "%s", bw->rotate_to);
+            bw->position = bw->rotate_position;
+        }
+    }
+}
+
+// Returns the last file listed in the index, i.e. the one being written.
+static int read_index_tail(BinlogWatcher *bw, char *out, size_t out_size) {
+    FILE *fp = fopen(bw->index_path, "r");
+    if (!fp) {
+        perror("Failed to open binlog index");
+        return -1;
+    }
+    char line[BINLOG_PATH_SIZE];
+    out[0] = '\0';
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0]) {
+            const char *slash = strrchr(line, '/');
+            snprintf(out, out_size, "%s", slash ? slash + 1 : line);
+        }
+    }
+    fclose(fp);
+    return out[0] ? 0 : -1;
+}
+
+static ssize_t read_at(int fd, unsigned char *buf, size_t len, uint64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, (off_t)(offset + done));
+        if (n <= 0) {
+            return n < 0 ? -1 : (ssize_t)done;
+        }
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+static int reserve_event(BinlogWatcher *bw, size_t len) {
+    if (len <= bw->event_cap) {
+        return 0;
+    }
+    unsigned char *grown = realloc(bw->event, len);
+    if (!grown) {
+        return -1;
+    }
+    bw->event = grown;
+    bw->event_cap = len;
+    return 0;
+}
+
+// Reads the event at bw->position. Returns its length, 0 when it has not
+// been written completely yet and -1 on error.
+static ssize_t read_file_event(BinlogWatcher *bw) {
+    unsigned char header[EVENT_HEADER_LEN];
+    ssize_t n = read_at(bw->fd, header, sizeof(header), bw->position);
+    if (n < 0) {
+        return -1;
+    }
+    if ((size_t)n < sizeof(header)) {
+        return 0;
+    }
+    uint32_t size = read_le32(header + EVENT_SIZE_OFFSET);
+    if (size < EVENT_HEADER_LEN || reserve_event(bw, size) != 0) {
+        return -1;
+    }
+    n = read_at(bw->fd, bw->event, size, bw->position);
+    if (n < 0) {
+        return -1;
+    }
+    return (size_t)n < size ? 0 : (ssize_t)size;
+}
+
+// Opens name from the index directory and reads its format description
+// event, which says whether events carry checksums.
+static int open_log_file(BinlogWatcher *bw, const char *name) {
+    char path[BINLOG_PATH_SIZE * 2];
+    const char *slash = strrchr(bw->index_path, '/');
+    if (slash) {
+        snprintf(path, sizeof(path), "%.*s/%s", (int)(slash - bw->index_path), bw->index_path, name);
+    } else {
+        snprintf(path, sizeof(path), "%s", name);
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror("Failed to open binlog file");
+        return -1;
+    }
+    if (bw->fd >= 0) {
+        close(bw->fd);
+    }
+    bw->fd = fd;
+    snprintf(bw->file_name, sizeof(bw->file_name), "%s", name);
+    bw->position = BINLOG_MAGIC_LEN;
+
+    ssize_t len = read_file_event(bw);
+    if (len > 0) {
+        handle_event(bw, bw->event, (size_t)len);
+        bw->position = BINLOG_MAGIC_LEN + (uint64_t)len;
+    }
+    return 0;
+}
+
+static int open_file(BinlogWatcher *bw) {
+    char name[BINLOG_NAME_SIZE];
+    snprintf(bw->index_path, sizeof(bw->index_path), "%s", bw->config->binlog_index);
+    if (read_index_tail(bw, name, sizeof(name)) != 0 || open_log_file(bw, name) != 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(bw->fd, &st) != 0) {
+        return -1;
+    }
+    bw->position = (uint64_t)st.st_size;
+    return 0;
+}
+
+static int poll_file(BinlogWatcher *bw, unsigned int timeout_ms) {
+    unsigned int waited = 0;
+    for (;;) {
+        ssize_t len = read_file_event(bw);
+        if (len < 0) {
+            return -1;
+        }
+        if (len > 0) {
+            uint64_t start = bw->position;
+            int rc = handle_event(bw, bw->event, (size_t)len);
+            if (bw->position <= start) {
+                bw->position = start + (uint64_t)len;
+            }
+            if (rc == EVENT_ROTATE && open_log_file(bw, bw->rotate_to) != 0) {
+                return -1;
+            }
+            if (rc == EVENT_DDL) {
+                return 1;
+            }
+            continue;
+        }
+
+        // The server may have moved to a new file without a rotate event
+        // we could read (restart, FLUSH LOGS racing with us).
+        char name[BINLOG_NAME_SIZE];
+        if (read_index_tail(bw, name, sizeof(name)) == 0 && strcmp(name, bw->file_name) != 0) {
+            if (open_log_file(bw, name) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        if (waited >= timeout_ms) {
+            return 0;
+        }
+        sleep_ms(FILE_POLL_MS);
+        waited += FILE_POLL_MS;
+    }
+}
+
+int binlog_watcher_open(BinlogWatcher *bw, DBConfig *config, AppContext *ctx) {
+    memset(bw, 0, sizeof(*bw));
+    bw->config = config;
+    bw->fd = -1;
+    bw->query_post_header_len = QUERY_POST_HEADER_LEN;
+    bw->kind = config->binlog_index ? BINLOG_SOURCE_FILE : BINLOG_SOURCE_SERVER;
+    if (hash_map_init(&bw->tables, 64) != 0) {
+        return -1;
+    }
+
+    int rc = bw->kind == BINLOG_SOURCE_FILE ? open_file(bw) : open_server(bw);
+    if (rc != 0) {
+        binlog_watcher_close(bw);
+        return -1;
+    }
+    app_log(ctx, "MySQL: tailing binlog %s from %s:%llu", bw->kind == BINLOG_SOURCE_FILE ? bw->index_path : "stream",
+            bw->file_name, (unsigned long long)bw->position);
+    return 0;
+}
+
+int binlog_watcher_poll(BinlogWatcher *bw, unsigned int timeout_ms) {
+    if (bw->kind == BINLOG_SOURCE_FILE) {
+        return poll_file(bw, timeout_ms);
+    }
+    return poll_server(bw);
+}
+
+typedef struct {
+    char **names;
+    int count;
+} NameList;
+
+static void collect_name(const char *key, void *value, void *arg) {
+    (void)value;
+    NameList *list = arg;
+    char *copy = strdup(key);
+    if (copy) {
+        list->names[list->count++] = copy;
+    }
+}
+
+char **binlog_watcher_take(BinlogWatcher *bw, int *count, int *full) {
+    NameList list = { NULL, 0 };
+    *full = bw->full_refresh;
+    bw->full_refresh = 0;
+
+    if (bw->tables.count > 0) {
+        list.names = calloc(bw->tables.count, sizeof(char *));
+        if (list.names) {
+            hash_map_foreach(&bw->tables, collect_name, &list);
+        } else {
+            *full = 1;
+        }
+    }
+    hash_map_free(&bw->tables, NULL);
+    hash_map_init(&bw->tables, 64);
+
+    *count = list.count;
+    return list.names;
+}
+
+void binlog_watcher_free_names(char **names, int count) {
+    for (int i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+void binlog_watcher_close(BinlogWatcher *bw) {
+    if (bw->conn) {
+        if (bw->rpl.file_name) {
+            mysql_binlog_close(bw->conn, &bw->rpl);
+        }
+        mysql_close(bw->conn);
+        bw->conn = NULL;
+    }
+    if (bw->fd >= 0) {
+        close(bw->fd);
+        bw->fd = -1;
+    }
+    free(bw->event);
+    bw->event = NULL;
+    bw->event_cap = 0;
+    hash_map_free(&bw->tables, NULL);
+}
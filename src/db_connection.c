@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "db_connection.h"
+#include "logger.h"
+#include "metrics.h"
+
+#define BACKOFF_INITIAL_MS 1000
+#define BACKOFF_MAX_MS 60000
+
+static double elapsed_ms(const struct timespec *start, const struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1000.0 +
+           (double)(end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static void schedule_retry(DbConnection *dc) {
+    if (dc->backoff_ms == 0) {
+        dc->backoff_ms = BACKOFF_INITIAL_MS;
+    } else if (dc->backoff_ms < BACKOFF_MAX_MS) {
+        dc->backoff_ms *= 2;
+        if (dc->backoff_ms > BACKOFF_MAX_MS) {
+            dc->backoff_ms = BACKOFF_MAX_MS;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &dc->next_attempt);
+    dc->next_attempt.tv_sec += dc->backoff_ms / 1000;
+    dc->next_attempt.tv_nsec += (long)(dc->backoff_ms % 1000) * 1000000L;
+    if (dc->next_attempt.tv_nsec >= 1000000000L) {
+        dc->next_attempt.tv_sec++;
+        dc->next_attempt.tv_nsec -= 1000000000L;
+    }
+    dc->state = DB_CONN_BACKOFF;
+}
+
+static void drop_handle(DbConnection *dc) {
+    if (dc->conn) {
+        close_connection(dc->conn);
+        dc->conn = NULL;
+    }
+    dc->state = DB_CONN_DISCONNECTED;
+}
+
+static MYSQL *open_handle(DbConnection *dc, AppContext *ctx) {
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    MYSQL *conn = connect_db(dc->config);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (!conn) {
+        dc->connect_failures++;
+        metrics_add(COUNTER_CONNECT_FAILURES, 1);
+        schedule_retry(dc);
+        fprintf(stderr, "Retrying connection in %u ms...\n", dc->backoff_ms);
+        log_message(LOG_LEVEL_WARN, "MySQL: connect failed (%lu failures), retrying in %u ms",
+                    dc->connect_failures, dc->backoff_ms);
+        return NULL;
+    }
+
+    dc->last_connect_ms = elapsed_ms(&start, &end);
+    dc->total_connect_ms += dc->last_connect_ms;
+    if (dc->connects > 0) {
+        dc->reconnects++;
+        metrics_add(COUNTER_RECONNECTS, 1);
+    }
+    dc->connects++;
+    metrics_add(COUNTER_CONNECTS, 1);
+    dc->backoff_ms = 0;
+    dc->conn = conn;
+    dc->state = DB_CONN_CONNECTED;
+    app_log(ctx, "MySQL: connected in %.1f ms (connects=%lu reconnects=%lu failures=%lu)",
+            dc->last_connect_ms, dc->connects, dc->reconnects, dc->connect_failures);
+    return conn;
+}
+
+void db_connection_init(DbConnection *dc, DBConfig *config) {
+    memset(dc, 0, sizeof(*dc));
+    dc->config = config;
+    dc->state = DB_CONN_DISCONNECTED;
+}
+
+MYSQL *db_connection_acquire(DbConnection *dc, AppContext *ctx) {
+    switch (dc->state) {
+    case DB_CONN_CONNECTED:
+        if (mysql_ping(dc->conn) == 0) {
+            return dc->conn;
+        }
+        dc->ping_failures++;
+        log_message(LOG_LEVEL_WARN, "MySQL: connection lost: %s", mysql_error(dc->conn));
+        drop_handle(dc);
+        // A dropped connection gets one immediate reconnect attempt before
+        // the backoff schedule kicks in.
+        return open_handle(dc, ctx);
+    case DB_CONN_BACKOFF:
+        if (db_connection_retry_delay_ms(dc) > 0) {
+            return NULL;
+        }
+        return open_handle(dc, ctx);
+    case DB_CONN_DISCONNECTED:
+    default:
+        return open_handle(dc, ctx);
+    }
+}
+
+unsigned int db_connection_retry_delay_ms(const DbConnection *dc) {
+    if (dc->state != DB_CONN_BACKOFF) {
+        return 0;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double remaining = elapsed_ms(&now, &dc->next_attempt);
+    return remaining > 0 ? (unsigned int)remaining + 1 : 0;
+}
+
+void db_connection_reset(DbConnection *dc) {
+    drop_handle(dc);
+}
+
+void db_connection_close(DbConnection *dc) {
+    drop_handle(dc);
+}
@@ -0,0 +1,362 @@
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include "ddl_scan.h"
+
+// Identifiers are at most 64 characters, i.e. 256 bytes of utf8mb4.
+#define IDENT_SIZE 257
+
+typedef struct {
+    const char *p;
+    const char *end;
+} Cursor;
+
+// Objects whose DDL never changes the definition of a table.
+static const char *IGNORED_OBJECTS[] = {
+    "USER", "ROLE", "FUNCTION", "PROCEDURE", "EVENT", "TRIGGER", "SERVER",
+    "TABLESPACE", "LOGFILE", "RESOURCE", "INSTANCE", "UNDO", "AGGREGATE",
+    NULL
+};
+
+static int is_word_char(unsigned char c) {
+    return isalnum(c) || c == '_' || c == '$' || c >= 0x80;
+}
+
+static void skip_space(Cursor *c) {
+    while (c->p < c->end) {
+        if (isspace((unsigned char)*c->p)) {
+            c->p++;
+        } else if (c->end - c->p >= 3 && strncmp(c->p, "/*!", 3) == 0) {
+            // Versioned comments hold SQL the server executes: step inside.
+            c->p += 3;
+            while (c->p < c->end && isdigit((unsigned char)*c->p)) {
+                c->p++;
+            }
+        } else if (c->end - c->p >= 2 && strncmp(c->p, "*/", 2) == 0) {
+            c->p += 2;
+        } else if (c->end - c->p >= 2 && strncmp(c->p, "/*", 2) == 0) {
+            const char *close = c->p + 2;
+            while (close + 1 < c->end && strncmp(close, "*/", 2) != 0) {
+                close++;
+            }
+            c->p = close + 1 < c->end ? close + 2 : c->end;
+        } else if (*c->p == '#' ||
+                   (c->end - c->p >= 3 && strncmp(c->p, "-- ", 3) == 0)) {
+            while (c->p < c->end && *c->p != '\n') {
+                c->p++;
+            }
+        } else {
+            return;
+        }
+    }
+}
+
+// Reads an unquoted or quoted identifier into out. Returns 0 when the cursor
+// is not on an identifier.
+static int read_ident(Cursor *c, char *out) {
+    size_t n = 0;
+    skip_space(c);
+    if (c->p >= c->end) {
+        return 0;
+    }
+
+    char quote = *c->p;
+    if (quote == '`' || quote == '"') {
+        c->p++;
+        while (c->p < c->end) {
+            if (*c->p == quote) {
+                if (c->p + 1 < c->end && c->p[1] == quote) {
+                    c->p++;
+                } else {
+                    break;
+                }
+            }
+            if (n + 1 < IDENT_SIZE) {
+                out[n++] = *c->p;
+            }
+            c->p++;
+        }
+        if (c->p >= c->end) {
+            return 0;
+        }
+        c->p++;
+    } else {
+        while (c->p < c->end && is_word_char((unsigned char)*c->p)) {
+            if (n + 1 < IDENT_SIZE) {
+                out[n++] = *c->p;
+            }
+            c->p++;
+        }
+    }
+    out[n] = '\0';
+    return n > 0;
+}
+
+// Reads [db.]table. db is left empty when the name is not qualified.
+static int read_name(Cursor *c, char *db, char *table) {
+    db[0] = '\0';
+    if (!read_ident(c, table)) {
+        return 0;
+    }
+    skip_space(c);
+    if (c->p < c->end && *c->p == '.') {
+        c->p++;
+        memcpy(db, table, IDENT_SIZE);
+        return read_ident(c, table);
+    }
+    return 1;
+}
+
+// Consumes keyword kw if it is the next word.
+static int accept(Cursor *c, const char *kw) {
+    size_t len = strlen(kw);
+    skip_space(c);
+    if ((size_t)(c->end - c->p) < len || strncasecmp(c->p, kw, len) != 0) {
+        return 0;
+    }
+    if (c->p + len < c->end && is_word_char((unsigned char)c->p[len])) {
+        return 0;
+    }
+    c->p += len;
+    return 1;
+}
+
+static int accept_char(Cursor *c, char ch) {
+    skip_space(c);
+    if (c->p < c->end && *c->p == ch) {
+        c->p++;
+        return 1;
+    }
+    return 0;
+}
+
+static int accept_ignored_object(Cursor *c) {
+    for (int i = 0; IGNORED_OBJECTS[i]; i++) {
+        if (accept(c, IGNORED_OBJECTS[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Moves past the next token, skipping string literals and quoted names as a
+// whole so that their content is never mistaken for keywords.
+static void skip_token(Cursor *c) {
+    char ident[IDENT_SIZE];
+    skip_space(c);
+    if (c->p >= c->end) {
+        return;
+    }
+    char ch = *c->p;
+    if (ch == '\'') {
+        c->p++;
+        while (c->p < c->end && *c->p != '\'') {
+            if (*c->p == '\\' && c->p + 1 < c->end) {
+                c->p++;
+            }
+            c->p++;
+        }
+        if (c->p < c->end) {
+            c->p++;
+        }
+    } else if (ch == '`' || ch == '"' || is_word_char((unsigned char)ch)) {
+        if (!read_ident(c, ident)) {
+            c->p = c->end;
+        }
+    } else {
+        c->p++;
+    }
+}
+
+// Skips tokens up to and including the keyword kw.
+static int skip_past(Cursor *c, const char *kw) {
+    while (c->p < c->end) {
+        if (accept(c, kw)) {
+            return 1;
+        }
+        skip_token(c);
+    }
+    return 0;
+}
+
+// CREATE and ALTER may put ALGORITHM=, DEFINER= or SQL SECURITY clauses in
+// front of the object type; look a few tokens ahead for it.
+static DdlResult classify_other(Cursor *c) {
+    for (int i = 0; i < 16 && c->p < c->end; i++) {
+        if (accept(c, "VIEW")) {
+            return DDL_UNKNOWN;
+        }
+        if (accept_ignored_object(c)) {
+            return DDL_NONE;
+        }
+        skip_token(c);
+    }
+    return DDL_UNKNOWN;
+}
+
+typedef struct {
+    const char *default_db;
+    DdlTableFn fn;
+    void *arg;
+} Reporter;
+
+static void report(const Reporter *r, const char *db, const char *table) {
+    r->fn(db[0] ? db : r->default_db, table, r->arg);
+}
+
+static int report_name(Cursor *c, const Reporter *r) {
+    char db[IDENT_SIZE];
+    char table[IDENT_SIZE];
+    if (!read_name(c, db, table)) {
+        return 0;
+    }
+    report(r, db, table);
+    return 1;
+}
+
+static DdlResult scan_database(Cursor *c, const Reporter *r, int creating) {
+    char db[IDENT_SIZE];
+    if (creating) {
+        if (accept(c, "IF")) {
+            accept(c, "NOT");
+            accept(c, "EXISTS");
+        }
+    } else if (accept(c, "IF")) {
+        accept(c, "EXISTS");
+    }
+    if (!read_ident(c, db)) {
+        return DDL_UNKNOWN;
+    }
+    r->fn(db, NULL, r->arg);
+    return DDL_TABLES;
+}
+
+static DdlResult scan_index_target(Cursor *c, const Reporter *r) {
+    if (!skip_past(c, "ON") || !report_name(c, r)) {
+        return DDL_UNKNOWN;
+    }
+    return DDL_TABLES;
+}
+
+static DdlResult scan_alter(Cursor *c, const Reporter *r) {
+    if (!accept(c, "ONLINE")) {
+        accept(c, "OFFLINE");
+    }
+    accept(c, "IGNORE");
+    if (!accept(c, "TABLE")) {
+        if (accept(c, "DATABASE") || accept(c, "SCHEMA")) {
+            return DDL_NONE;
+        }
+        return classify_other(c);
+    }
+    if (!report_name(c, r)) {
+        return DDL_UNKNOWN;
+    }
+
+    // ALTER TABLE a RENAME [TO|AS] b moves the table to a new name.
+    while (skip_past(c, "RENAME")) {
+        if (accept(c, "COLUMN") || accept(c, "INDEX") || accept(c, "KEY")) {
+            continue;
+        }
+        if (!accept(c, "TO")) {
+            accept(c, "AS");
+        }
+        accept_char(c, '=');
+        if (!report_name(c, r)) {
+            return DDL_UNKNOWN;
+        }
+    }
+    return DDL_TABLES;
+}
+
+static DdlResult scan_create(Cursor *c, const Reporter *r) {
+    if (accept(c, "OR")) {
+        accept(c, "REPLACE");
+    }
+    if (accept(c, "TEMPORARY")) {
+        return DDL_NONE;
+    }
+    if (accept(c, "TABLE")) {
+        if (accept(c, "IF")) {
+            accept(c, "NOT");
+            accept(c, "EXISTS");
+        }
+        return report_name(c, r) ? DDL_TABLES : DDL_UNKNOWN;
+    }
+    if (accept(c, "DATABASE") || accept(c, "SCHEMA")) {
+        return scan_database(c, r, 1);
+    }
+
+    if (!accept(c, "ONLINE")) {
+        accept(c, "OFFLINE");
+    }
+    if (!accept(c, "UNIQUE") && !accept(c, "FULLTEXT")) {
+        accept(c, "SPATIAL");
+    }
+    if (accept(c, "INDEX")) {
+        return scan_index_target(c, r);
+    }
+    return classify_other(c);
+}
+
+static DdlResult scan_drop(Cursor *c, const Reporter *r) {
+    if (accept(c, "TEMPORARY")) {
+        return DDL_NONE;
+    }
+    if (accept(c, "TABLE") || accept(c, "TABLES")) {
+        if (accept(c, "IF")) {
+            accept(c, "EXISTS");
+        }
+        do {
+            if (!report_name(c, r)) {
+                return DDL_UNKNOWN;
+            }
+        } while (accept_char(c, ','));
+        return DDL_TABLES;
+    }
+    if (accept(c, "DATABASE") || accept(c, "SCHEMA")) {
+        return scan_database(c, r, 0);
+    }
+
+    if (!accept(c, "ONLINE")) {
+        accept(c, "OFFLINE");
+    }
+    if (accept(c, "INDEX")) {
+        return scan_index_target(c, r);
+    }
+    if (accept_ignored_object(c)) {
+        return DDL_NONE;
+    }
+    return DDL_UNKNOWN;
+}
+
+static DdlResult scan_rename(Cursor *c, const Reporter *r) {
+    if (!accept(c, "TABLE") && !accept(c, "TABLES")) {
+        return DDL_NONE;
+    }
+    do {
+        if (!report_name(c, r) || !accept(c, "TO") || !report_name(c, r)) {
+            return DDL_UNKNOWN;
+        }
+    } while (accept_char(c, ','));
+    return DDL_TABLES;
+}
+
+DdlResult ddl_scan(const char *query, size_t len, const char *default_db, DdlTableFn fn, void *arg) {
+    Cursor c = { query, query + len };
+    Reporter r = { default_db ? default_db : "", fn, arg };
+
+    if (accept(&c, "CREATE")) {
+        return scan_create(&c, &r);
+    }
+    if (accept(&c, "ALTER")) {
+        return scan_alter(&c, &r);
+    }
+    if (accept(&c, "DROP")) {
+        return scan_drop(&c, &r);
+    }
+    if (accept(&c, "RENAME")) {
+        return scan_rename(&c, &r);
+    }
+    return DDL_NONE;
+}
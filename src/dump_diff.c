@@ -0,0 +1,520 @@
+// memmem()
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dump_diff.h"
+#include "mysql_service.h"
+#include "parallel.h"
+#include "schema_diff.h"
+#include "str_buf.h"
+
+// Tables diffed before their migrations are written out and freed. Only a
+// window's ALTER text is held at once, whatever the size of the dumps.
+#define WINDOW_TABLES 1024
+// Tables handed to a worker at a time.
+#define JOB_CHUNK 16
+// The indexer gives back the pages it has scanned every this many bytes, so
+// a mapped dump never stays resident as a whole.
+#define RELEASE_STEP (16UL * 1024 * 1024)
+
+static const char CREATE_TABLE[] = "CREATE TABLE";
+
+typedef struct {
+    const char *path;
+    const char *data;
+    size_t size;
+} DumpFile;
+
+// One CREATE TABLE statement, pointing into the mapped file: text runs up to
+// (not including) the closing semicolon, as SHOW CREATE TABLE returns it.
+// name is a copy of the unqualified table name, so sorting and pairing the
+// index does not touch the mapping again.
+typedef struct {
+    char *name;
+    const char *text;
+    size_t len;
+} DumpTable;
+
+typedef struct {
+    DumpFile *file;
+    DumpTable *tables;
+    int count;
+    int capacity;
+    int failed;
+} DumpIndex;
+
+// A table of either side, or of both. The workers fill in everything after
+// new_table.
+typedef struct {
+    const DumpTable *old_table;
+    const DumpTable *new_table;
+    int changed;
+    StrBuf up;
+    StrBuf down;
+} TableDiff;
+
+typedef struct {
+    DumpFile *old_file;
+    DumpFile *new_file;
+    TableDiff *diffs;
+    int diff_count;
+} DumpDiff;
+
+static int map_dump(DumpFile *file, const char *path) {
+    memset(file, 0, sizeof(*file));
+    file->path = path;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    file->size = (size_t)st.st_size;
+    if (file->size > 0) {
+        void *map = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return -1;
+        }
+        madvise(map, file->size, MADV_SEQUENTIAL);
+        file->data = map;
+    }
+    close(fd);
+    return 0;
+}
+
+static void unmap_dump(DumpFile *file) {
+    if (file->data) {
+        munmap((void *)file->data, file->size);
+    }
+}
+
+// Drops the pages wholly inside [from, to) from the process. They are clean
+// file pages, so touching them again only faults them back in from the page
+// cache.
+static void release_range(const DumpFile *file, const char *from, const char *to) {
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)from + page - 1) & ~(page - 1);
+    uintptr_t end = (uintptr_t)to & ~(page - 1);
+    if (start < (uintptr_t)file->data) {
+        start = (uintptr_t)file->data;
+    }
+    if (end > start) {
+        madvise((void *)start, end - start, MADV_DONTNEED);
+    }
+}
+
+// Returns the first "CREATE TABLE" at the start of a line in [p, end).
+static const char *find_create(const char *p, const char *end, const char *start) {
+    size_t token_len = sizeof(CREATE_TABLE) - 1;
+    while (p < end) {
+        const char *hit = memmem(p, (size_t)(end - p), CREATE_TABLE, token_len);
+        if (!hit) {
+            return NULL;
+        }
+        if (hit == start || hit[-1] == '\n') {
+            return hit;
+        }
+        p = hit + 1;
+    }
+    return NULL;
+}
+
+// Returns the semicolon that ends the statement at p, skipping those inside
+// quoted strings and identifiers, or end when there is none.
+static const char *statement_end(const char *p, const char *end) {
+    char quote = 0;
+    for (; p < end; p++) {
+        char c = *p;
+        if (quote) {
+            if (c == '\\' && quote != '`' && p + 1 < end) {
+                p++;
+            } else if (c == quote) {
+                quote = 0;
+            }
+        } else if (c == '\'' || c == '"' || c == '`') {
+            quote = c;
+        } else if (c == ';') {
+            return p;
+        }
+    }
+    return end;
+}
+
+static const char *skip_space(const char *p, const char *end) {
+    while (p < end && isspace((unsigned char)*p)) {
+        p++;
+    }
+    return p;
+}
+
+static int starts_with_word(const char *p, const char *end, const char *word) {
+    size_t len = strlen(word);
+    return (size_t)(end - p) > len && strncasecmp(p, word, len) == 0 && isspace((unsigned char)p[len]);
+}
+
+// Reads one identifier, quoted or bare, and returns the position after it.
+static const char *read_identifier(const char *p, const char *end, const char **name, size_t *name_len) {
+    if (p < end && *p == '`') {
+        const char *q = ++p;
+        while (q < end && !(*q == '`' && (q + 1 >= end || q[1] != '`'))) {
+            q += *q == '`' ? 2 : 1;
+        }
+        *name = p;
+        *name_len = (size_t)(q - p);
+        return q < end ? q + 1 : q;
+    }
+    const char *q = p;
+    while (q < end && (isalnum((unsigned char)*q) || *q == '_' || *q == '$')) {
+        q++;
+    }
+    *name = p;
+    *name_len = (size_t)(q - p);
+    return q;
+}
+
+// Copies a name as written, undoing the doubled backticks of a quoted one.
+static char *copy_name(const char *text, size_t len) {
+    char *name = malloc(len + 1);
+    if (!name) {
+        return NULL;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        name[n++] = text[i];
+        if (text[i] == '`' && i + 1 < len && text[i + 1] == '`') {
+            i++;
+        }
+    }
+    name[n] = '\0';
+    return name;
+}
+
+// Finds the table name of the CREATE TABLE at p; a db.table name keeps only
+// the table. Returns NULL when there is none.
+static char *parse_table_name(const char *p, const char *end) {
+    const char *name;
+    size_t name_len;
+    p = skip_space(p + sizeof(CREATE_TABLE) - 1, end);
+    if (starts_with_word(p, end, "IF")) {
+        p = skip_space(p + 2, end);
+        if (starts_with_word(p, end, "NOT")) {
+            p = skip_space(p + 3, end);
+        }
+        if (starts_with_word(p, end, "EXISTS")) {
+            p = skip_space(p + 6, end);
+        }
+    }
+    p = read_identifier(p, end, &name, &name_len);
+    if (p < end && *p == '.') {
+        read_identifier(p + 1, end, &name, &name_len);
+    }
+    return name_len > 0 ? copy_name(name, name_len) : NULL;
+}
+
+static int add_dump_table(DumpIndex *index, const DumpTable *table) {
+    if (index->count == index->capacity) {
+        int capacity = index->capacity ? index->capacity * 2 : 256;
+        DumpTable *grown = realloc(index->tables, (size_t)capacity * sizeof(DumpTable));
+        if (!grown) {
+            return -1;
+        }
+        index->tables = grown;
+        index->capacity = capacity;
+    }
+    index->tables[index->count++] = *table;
+    return 0;
+}
+
+// Lists every CREATE TABLE of the file in one pass over the mapping. Only
+// the names are copied; the index points into the file.
+static void *index_dump(void *arg) {
+    DumpIndex *index = arg;
+    DumpFile *file = index->file;
+    const char *start = file->data;
+    const char *end = start + file->size;
+    const char *released = start;
+    const char *p = start;
+
+    while (p && p < end) {
+        const char *create = find_create(p, end, start);
+        if (!create) {
+            break;
+        }
+        const char *stop = statement_end(create, end);
+        DumpTable table;
+        table.name = parse_table_name(create, stop);
+        table.text = create;
+        table.len = (size_t)(stop - create);
+        if (table.name && add_dump_table(index, &table) != 0) {
+            free(table.name);
+            index->failed = 1;
+            break;
+        }
+        p = stop < end ? stop + 1 : end;
+        if ((size_t)(p - released) >= RELEASE_STEP) {
+            release_range(file, released, p);
+            released = p;
+        }
+    }
+    release_range(file, released, end);
+    return NULL;
+}
+
+// By name, then by position in the file.
+static int compare_dump_tables(const void *a, const void *b) {
+    const DumpTable *ta = a;
+    const DumpTable *tb = b;
+    int rc = strcmp(ta->name, tb->name);
+    if (rc != 0) {
+        return rc;
+    }
+    return ta->text < tb->text ? -1 : ta->text > tb->text;
+}
+
+// Sorts the index by name and keeps the last definition of every name.
+static void sort_index(DumpIndex *index) {
+    if (index->count < 2) {
+        return;
+    }
+    qsort(index->tables, (size_t)index->count, sizeof(DumpTable), compare_dump_tables);
+    int kept = 0;
+    for (int i = 0; i < index->count; i++) {
+        DumpTable *table = &index->tables[i];
+        if (kept > 0 && strcmp(index->tables[kept - 1].name, table->name) == 0) {
+            free(index->tables[--kept].name);
+        }
+        index->tables[kept++] = *table;
+    }
+    index->count = kept;
+}
+
+// Pairs the tables of both sides by name.
+static int pair_tables(DumpDiff *dd, const DumpIndex *old_index, const DumpIndex *new_index) {
+    dd->diffs = calloc((size_t)(old_index->count + new_index->count) + 1, sizeof(TableDiff));
+    if (!dd->diffs) {
+        return -1;
+    }
+    int i = 0;
+    int j = 0;
+    while (i < old_index->count || j < new_index->count) {
+        TableDiff *diff = &dd->diffs[dd->diff_count++];
+        const DumpTable *old_table = i < old_index->count ? &old_index->tables[i] : NULL;
+        const DumpTable *new_table = j < new_index->count ? &new_index->tables[j] : NULL;
+        int rc = !old_table ? 1 : !new_table ? -1 : strcmp(old_table->name, new_table->name);
+        if (rc <= 0) {
+            diff->old_table = old_table;
+            i++;
+        }
+        if (rc >= 0) {
+            diff->new_table = new_table;
+            j++;
+        }
+    }
+    return 0;
+}
+
+static char *normalize_table(const DumpTable *table) {
+    char *text = strndup(table->text, table->len);
+    if (!text) {
+        return NULL;
+    }
+    // The statement ends in a newline before its semicolon in mysqldump
+    // output but not in SHOW CREATE TABLE, which is what snapshots hold.
+    size_t len = table->len;
+    while (len > 0 && isspace((unsigned char)text[len - 1])) {
+        text[--len] = '\0';
+    }
+    char *normalized = normalize_schema(text);
+    free(text);
+    return normalized;
+}
+
+static void diff_table(DumpDiff *dd, int index) {
+    TableDiff *diff = &dd->diffs[index];
+    const char *name = (diff->new_table ? diff->new_table : diff->old_table)->name;
+    char *old_schema = diff->old_table ? normalize_table(diff->old_table) : NULL;
+    char *new_schema = diff->new_table ? normalize_table(diff->new_table) : NULL;
+
+    if (old_schema && new_schema) {
+        if (strcmp(old_schema, new_schema) != 0) {
+            generate_alter_statements(name, old_schema, new_schema, &diff->up, &diff->down);
+        }
+    } else if (new_schema) {
+        sb_appendf(&diff->up, "%s;\n", new_schema);
+        sb_appendf(&diff->down, "-- Table did not exist previously\nDROP TABLE IF EXISTS `%s`;\n", name);
+    } else if (old_schema) {
+        sb_appendf(&diff->up, "DROP TABLE IF EXISTS `%s`;\n", name);
+        sb_appendf(&diff->down, "%s;\n", old_schema);
+    }
+    diff->changed = diff->up.len > 0 || diff->down.len > 0;
+    free(old_schema);
+    free(new_schema);
+}
+
+static void diff_job(void *local, int index, void *arg) {
+    (void)local;
+    diff_table(arg, index);
+}
+
+static FILE *open_migration(const char *out_dir, const char *stamp, const char *direction,
+                            const char *from, const char *to, char *path, size_t path_size) {
+    snprintf(path, path_size, "%s/%s_dump_%s.sql", out_dir, stamp, direction);
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror("Failed to write migration");
+        return NULL;
+    }
+    fprintf(fp, "-- Migration from %s to %s\n\n", from, to);
+    return fp;
+}
+
+// Gives back the pages spanned by the window's tables of one side. Both
+// dumps are usually in name order, so later windows rarely touch them again.
+static void release_window(DumpDiff *dd, int start, int end, int old_side) {
+    const char *from = NULL;
+    const char *to = NULL;
+    for (int i = start; i < end; i++) {
+        const DumpTable *table = old_side ? dd->diffs[i].old_table : dd->diffs[i].new_table;
+        if (!table) {
+            continue;
+        }
+        if (!from || table->text < from) {
+            from = table->text;
+        }
+        if (!to || table->text + table->len > to) {
+            to = table->text + table->len;
+        }
+    }
+    if (from) {
+        release_range(old_side ? dd->old_file : dd->new_file, from, to);
+    }
+}
+
+// Appends the migrations of the window to the up and down files in table
+// name order and frees them.
+static int write_window(DumpDiff *dd, int start, int end, FILE *up, FILE *down) {
+    int changed = 0;
+    for (int i = start; i < end; i++) {
+        TableDiff *diff = &dd->diffs[i];
+        if (diff->changed) {
+            const char *name = (diff->new_table ? diff->new_table : diff->old_table)->name;
+            fprintf(up, "-- table: %s\n%s\n", name, sb_str(&diff->up));
+            fprintf(down, "-- table: %s\n%s\n", name, sb_str(&diff->down));
+            changed++;
+        }
+        sb_free(&diff->up);
+        sb_free(&diff->down);
+    }
+    return changed;
+}
+
+static void free_index(DumpIndex *index) {
+    for (int i = 0; i < index->count; i++) {
+        free(index->tables[i].name);
+    }
+    free(index->tables);
+}
+
+int dump_diff(const char *old_path, const char *new_path, const char *out_dir, int threads) {
+    DumpFile old_file;
+    DumpFile new_file;
+    if (map_dump(&old_file, old_path) != 0) {
+        return -1;
+    }
+    if (map_dump(&new_file, new_path) != 0) {
+        unmap_dump(&old_file);
+        return -1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    // The two files are indexed side by side.
+    DumpIndex old_index = { &old_file, NULL, 0, 0, 0 };
+    DumpIndex new_index = { &new_file, NULL, 0, 0, 0 };
+    pthread_t old_thread;
+    int threaded = pthread_create(&old_thread, NULL, index_dump, &old_index) == 0;
+    if (!threaded) {
+        index_dump(&old_index);
+    }
+    index_dump(&new_index);
+    if (threaded) {
+        pthread_join(old_thread, NULL);
+    }
+
+    DumpDiff dd;
+    memset(&dd, 0, sizeof(dd));
+    dd.old_file = &old_file;
+    dd.new_file = &new_file;
+    ParallelJob job = { diff_job, NULL, NULL, &dd, JOB_CHUNK };
+    FILE *up = NULL;
+    FILE *down = NULL;
+    char up_path[512];
+    char down_path[512];
+    int result = -1;
+
+    if (old_index.failed || new_index.failed) {
+        fprintf(stderr, "Out of memory while indexing %s and %s\n", old_path, new_path);
+        goto done;
+    }
+    sort_index(&old_index);
+    sort_index(&new_index);
+    if (pair_tables(&dd, &old_index, &new_index) != 0) {
+        goto done;
+    }
+
+    mkdir(out_dir, 0755);
+    time_t now = time(NULL);
+    struct tm tm_now;
+    char stamp[64];
+    localtime_r(&now, &tm_now);
+    strftime(stamp, sizeof(stamp), "%Y%m%d%H%M%S", &tm_now);
+    up = open_migration(out_dir, stamp, "up", old_path, new_path, up_path, sizeof(up_path));
+    down = open_migration(out_dir, stamp, "down", new_path, old_path, down_path, sizeof(down_path));
+    if (!up || !down) {
+        goto done;
+    }
+
+    result = 0;
+    for (int start = 0; start < dd.diff_count; start += WINDOW_TABLES) {
+        int end = start + WINDOW_TABLES < dd.diff_count ? start + WINDOW_TABLES : dd.diff_count;
+        parallel_run(&job, threads, start, end);
+        release_window(&dd, start, end, 1);
+        release_window(&dd, start, end, 0);
+        result += write_window(&dd, start, end, up, down);
+    }
+    printf("Compared %d table(s) of %s (%d) and %s (%d): %d differ\n", dd.diff_count, old_path, old_index.count,
+           new_path, new_index.count, result);
+    printf("Wrote %s and %s\n", up_path, down_path);
+
+done:
+    if (up && fclose(up) != 0) {
+        result = -1;
+    }
+    if (down && fclose(down) != 0) {
+        result = -1;
+    }
+    free(dd.diffs);
+    free_index(&old_index);
+    free_index(&new_index);
+    unmap_dump(&old_file);
+    unmap_dump(&new_file);
+    return result;
+}
@@ -0,0 +1,138 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emitted_registry.h"
+
+#define KEY_SIZE 512
+
+// Branch keys and table names are sanitized before they get here, so a tab
+// can never be part of either and is safe as a separator.
+static void make_key(char *key, size_t key_size, const char *branch, const char *table) {
+    snprintf(key, key_size, "%s\t%s", branch, table);
+}
+
+static void write_entry(const char *key, void *value, void *arg) {
+    FILE *fp = arg;
+    const EmittedChange *change = value;
+    fprintf(fp, "%s\t%016" PRIx64 "\n", key, change->digest);
+}
+
+// Rewrites the state file through a temporary file so a crash mid-write
+// leaves the previous state intact. A failed write stays dirty and is
+// retried by the next flush.
+void emitted_registry_flush(EmittedRegistry *registry) {
+    if (!registry->state_path || !registry->dirty) {
+        return;
+    }
+
+    char tmp_path[KEY_SIZE];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", registry->state_path);
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) {
+        perror("Failed to write emitted state");
+        return;
+    }
+    hash_map_foreach(&registry->entries, write_entry, fp);
+    if (fclose(fp) != 0 || rename(tmp_path, registry->state_path) != 0) {
+        perror("Failed to write emitted state");
+        remove(tmp_path);
+        return;
+    }
+    registry->dirty = 0;
+}
+
+static void load(EmittedRegistry *registry) {
+    FILE *fp = fopen(registry->state_path, "r");
+    if (!fp) {
+        return;
+    }
+
+    char line[KEY_SIZE + 32];
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        char *digest_text = strrchr(line, '\t');
+        if (!digest_text || digest_text == line) {
+            continue;
+        }
+        *digest_text++ = '\0';
+
+        EmittedChange *change = malloc(sizeof(EmittedChange));
+        if (!change) {
+            break;
+        }
+        change->digest = strtoull(digest_text, NULL, 16);
+        free(hash_map_remove(&registry->entries, line));
+        if (hash_map_put(&registry->entries, line, change) != 0) {
+            free(change);
+        }
+    }
+    fclose(fp);
+}
+
+int emitted_registry_init(EmittedRegistry *registry, const char *state_path) {
+    registry->state_path = NULL;
+    registry->dirty = 0;
+    if (hash_map_init(&registry->entries, 256) != 0) {
+        return -1;
+    }
+    if (state_path && state_path[0]) {
+        registry->state_path = strdup(state_path);
+        if (registry->state_path) {
+            load(registry);
+        }
+    }
+    return 0;
+}
+
+int emitted_registry_has(EmittedRegistry *registry, const char *branch, const char *table, uint64_t digest) {
+    char key[KEY_SIZE];
+    make_key(key, sizeof(key), branch, table);
+    const EmittedChange *change = hash_map_get(&registry->entries, key);
+    return change && change->digest == digest;
+}
+
+int emitted_registry_contains(EmittedRegistry *registry, const char *branch, const char *table) {
+    char key[KEY_SIZE];
+    make_key(key, sizeof(key), branch, table);
+    return hash_map_get(&registry->entries, key) != NULL;
+}
+
+void emitted_registry_set(EmittedRegistry *registry, const char *branch, const char *table, uint64_t digest) {
+    char key[KEY_SIZE];
+    make_key(key, sizeof(key), branch, table);
+    EmittedChange *change = hash_map_get(&registry->entries, key);
+    if (change) {
+        if (change->digest == digest) {
+            return;
+        }
+        change->digest = digest;
+    } else {
+        change = malloc(sizeof(EmittedChange));
+        if (!change) {
+            return;
+        }
+        change->digest = digest;
+        if (hash_map_put(&registry->entries, key, change) != 0) {
+            free(change);
+            return;
+        }
+    }
+    registry->dirty = 1;
+}
+
+void emitted_registry_clear(EmittedRegistry *registry, const char *branch, const char *table) {
+    char key[KEY_SIZE];
+    make_key(key, sizeof(key), branch, table);
+    EmittedChange *change = hash_map_remove(&registry->entries, key);
+    if (change) {
+        free(change);
+        registry->dirty = 1;
+    }
+}
+
+void emitted_registry_free(EmittedRegistry *registry) {
+    hash_map_free(&registry->entries, free);
+    free(registry->state_path);
+    registry->state_path = NULL;
+}
@@ -0,0 +1,75 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "file_util.h"
+#include "metrics.h"
+
+int write_file_atomic(const char *path, const char *data, size_t len, int durable) {
+    char tmp_path[1024];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid()) >= (int)sizeof(tmp_path)) {
+        fprintf(stderr, "Path too long: %s\n", path);
+        return -1;
+    }
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        perror("Failed to write SQL file");
+        return -1;
+    }
+    size_t written = len;
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to write SQL file");
+            close(fd);
+            unlink(tmp_path);
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    int synced = !durable || fsync(fd) == 0;
+    if (close(fd) != 0 || !synced) {
+        perror("Failed to flush SQL file");
+        unlink(tmp_path);
+        return -1;
+    }
+    if (rename(tmp_path, path) != 0) {
+        perror("Failed to replace SQL file");
+        unlink(tmp_path);
+        return -1;
+    }
+    metrics_add(COUNTER_BYTES_WRITTEN, written);
+    return 0;
+}
+
+int create_directories(const char *path) {
+    if (mkdir(path, 0700) == 0 || errno == EEXIST) {
+        return 0;
+    }
+    if (errno != ENOENT) {
+        return -1;
+    }
+    char partial[1024];
+    if (snprintf(partial, sizeof(partial), "%s", path) >= (int)sizeof(partial)) {
+        return -1;
+    }
+    for (char *p = partial + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(partial, 0700) != 0 && errno != EEXIST) {
+                return -1;
+            }
+            *p = '/';
+        }
+    }
+    if (mkdir(partial, 0700) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
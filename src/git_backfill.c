@@ -0,0 +1,615 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "git_backfill.h"
+#include "file_util.h"
+#include "git_service.h"
+#include "hash_map.h"
+#include "mysql_service.h"
+#include "parallel.h"
+#include "schema_diff.h"
+#include "str_buf.h"
+
+// Commits are handed to the workers in runs of this many. Neighbouring
+// commits mostly share their trees, so a run stays in one object cache.
+#define JOB_CHUNK 64
+
+typedef struct {
+    char *table;
+    git_oid blob;
+} SchemaFile;
+
+typedef struct {
+    git_oid id;
+    git_time_t time;
+    git_oid dir;
+    int has_dir;
+    // Set when the commit or its tree could not be read. Such a commit says
+    // nothing about the schema directory and is left out of the timeline.
+    int unreadable;
+    // Set when dir differs from the previous commit's, i.e. some table
+    // changed; only those commits have their files listed.
+    int changed;
+    int listed;
+    SchemaFile *files;
+    int file_count;
+} BackfillCommit;
+
+// One version of one table: created (no old blob), altered or dropped (no
+// new blob). The workers fill in everything after has_new.
+typedef struct {
+    char *table;
+    int commit;
+    git_oid old_blob;
+    int has_old;
+    git_oid new_blob;
+    int has_new;
+    char *schema;
+    int unchanged;
+    StrBuf up;
+    StrBuf down;
+} Transition;
+
+typedef struct Backfill Backfill;
+typedef void (*BackfillJobFn)(Backfill *bf, git_repository *repo, int index);
+
+struct Backfill {
+    const char *schema_dir;
+    const char *root;
+    BackfillCommit *commits;
+    int commit_count;
+    Transition *transitions;
+    int transition_count;
+    int transition_capacity;
+    BackfillJobFn fn;
+};
+
+static int open_repository(void **local, void *arg)
+{
+    (void)arg;
+    git_repository *repo = NULL;
+    if (git_open_repository(&repo) != 0) {
+        return -1;
+    }
+    *local = repo;
+    return 0;
+}
+
+static void close_repository(void *local, void *arg)
+{
+    (void)arg;
+    git_repository_free(local);
+}
+
+static void run_job(void *local, int index, void *arg)
+{
+    Backfill *bf = arg;
+    bf->fn(bf, local, index);
+}
+
+// Calls fn for every index in [0, count) on up to threads threads. libgit2
+// objects must stay on the thread that loaded them, so every thread reads
+// through its own repository handle. Returns -1 when some indices were not
+// run, e.g. because no thread could open the repository.
+static int run_parallel(Backfill *bf, int threads, int count, BackfillJobFn fn)
+{
+    ParallelJob job = { run_job, open_repository, close_repository, bf, JOB_CHUNK };
+    bf->fn = fn;
+    return parallel_run(&job, threads, 0, count);
+}
+
+static int collect_commits(Backfill *bf, git_repository *repo)
+{
+    git_revwalk *walk = NULL;
+    git_oid oid;
+    int capacity = 0;
+
+    int rc = git_revwalk_new(&walk, repo);
+    if (rc != 0) {
+        log_git_error("git_revwalk_new", rc);
+        return -1;
+    }
+    // The schema timeline is the history of the checked out branch, so merged
+    // side branches only count through their merge commit.
+    git_revwalk_sorting(walk, GIT_SORT_TOPOLOGICAL | GIT_SORT_REVERSE);
+    git_revwalk_simplify_first_parent(walk);
+    rc = git_revwalk_push_head(walk);
+    if (rc != 0) {
+        log_git_error("git_revwalk_push_head", rc);
+        git_revwalk_free(walk);
+        return -1;
+    }
+
+    while ((rc = git_revwalk_next(&oid, walk)) == 0) {
+        if (bf->commit_count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            BackfillCommit *grown = realloc(bf->commits, (size_t)capacity * sizeof(BackfillCommit));
+            if (!grown) {
+                git_revwalk_free(walk);
+                return -1;
+            }
+            bf->commits = grown;
+        }
+        BackfillCommit *commit = &bf->commits[bf->commit_count++];
+        memset(commit, 0, sizeof(*commit));
+        commit->id = oid;
+    }
+    git_revwalk_free(walk);
+    if (rc != GIT_ITEROVER) {
+        log_git_error("git_revwalk_next", rc);
+        return -1;
+    }
+    return 0;
+}
+
+static void locate_schema_dir(Backfill *bf, git_repository *repo, int index)
+{
+    BackfillCommit *commit = &bf->commits[index];
+    git_commit *object = NULL;
+    git_tree *tree = NULL;
+    git_tree_entry *entry = NULL;
+
+    if (git_commit_lookup(&object, repo, &commit->id) != 0) {
+        commit->unreadable = 1;
+        return;
+    }
+    commit->time = git_commit_time(object);
+    if (git_commit_tree(&tree, object) != 0) {
+        commit->unreadable = 1;
+        git_commit_free(object);
+        return;
+    }
+    // Only a missing path means the commit has no schema directory.
+    int rc = git_tree_entry_bypath(&entry, tree, bf->schema_dir);
+    if (rc == 0) {
+        if (git_tree_entry_type(entry) == GIT_OBJECT_TREE) {
+            commit->dir = *git_tree_entry_id(entry);
+            commit->has_dir = 1;
+        }
+        git_tree_entry_free(entry);
+    } else if (rc != GIT_ENOTFOUND) {
+        commit->unreadable = 1;
+    }
+    git_tree_free(tree);
+    git_commit_free(object);
+}
+
+static int compare_files(const void *a, const void *b)
+{
+    return strcmp(((const SchemaFile *)a)->table, ((const SchemaFile *)b)->table);
+}
+
+static void list_schema_files(Backfill *bf, git_repository *repo, int index)
+{
+    BackfillCommit *commit = &bf->commits[index];
+    git_tree *dir = NULL;
+
+    if (!commit->changed || !commit->has_dir || git_tree_lookup(&dir, repo, &commit->dir) != 0) {
+        return;
+    }
+
+    size_t count = git_tree_entrycount(dir);
+    commit->files = calloc(count ? count : 1, sizeof(SchemaFile));
+    if (!commit->files) {
+        git_tree_free(dir);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const git_tree_entry *entry = git_tree_entry_byindex(dir, i);
+        const char *name = git_tree_entry_name(entry);
+        size_t len = strlen(name);
+        SchemaFile *file = &commit->files[commit->file_count];
+
+        if (git_tree_entry_type(entry) == GIT_OBJECT_BLOB) {
+            // Flat layout: <t>.sql
+            if (len <= 4 || strcmp(name + len - 4, ".sql") != 0) {
+                continue;
+            }
+            file->table = strndup(name, len - 4);
+            file->blob = *git_tree_entry_id(entry);
+        } else if (git_tree_entry_type(entry) == GIT_OBJECT_TREE) {
+            // Watcher layout: <t>/schema.sql
+            char path[512];
+            git_tree_entry *schema = NULL;
+            snprintf(path, sizeof(path), "%s/schema.sql", name);
+            if (git_tree_entry_bypath(&schema, dir, path) != 0) {
+                continue;
+            }
+            file->table = strdup(name);
+            file->blob = *git_tree_entry_id(schema);
+            git_tree_entry_free(schema);
+        } else {
+            continue;
+        }
+        if (file->table) {
+            commit->file_count++;
+        }
+    }
+    git_tree_free(dir);
+    commit->listed = 1;
+    qsort(commit->files, (size_t)commit->file_count, sizeof(SchemaFile), compare_files);
+}
+
+static Transition *add_transition(Backfill *bf, const char *table, int commit)
+{
+    if (bf->transition_count == bf->transition_capacity) {
+        int capacity = bf->transition_capacity ? bf->transition_capacity * 2 : 256;
+        Transition *grown = realloc(bf->transitions, (size_t)capacity * sizeof(Transition));
+        if (!grown) {
+            return NULL;
+        }
+        bf->transitions = grown;
+        bf->transition_capacity = capacity;
+    }
+    Transition *t = &bf->transitions[bf->transition_count];
+    memset(t, 0, sizeof(*t));
+    t->table = strdup(table);
+    if (!t->table) {
+        return NULL;
+    }
+    t->commit = commit;
+    bf->transition_count++;
+    return t;
+}
+
+typedef struct {
+    HashMap *listed;
+    char **gone;
+    int gone_count;
+} DropScan;
+
+static void find_dropped(const char *key, void *value, void *arg)
+{
+    (void)value;
+    DropScan *scan = arg;
+    if (!hash_map_get(scan->listed, key)) {
+        scan->gone[scan->gone_count++] = strdup(key);
+    }
+}
+
+// Replays the listed commits in order against the blob each table had last,
+// turning every difference into a transition.
+static int build_timeline(Backfill *bf)
+{
+    HashMap current;
+    if (hash_map_init(&current, 256) != 0) {
+        return -1;
+    }
+
+    int result = 0;
+    for (int i = 0; i < bf->commit_count && result == 0; i++) {
+        BackfillCommit *commit = &bf->commits[i];
+        // A directory that could not be read says nothing about its tables;
+        // treating it as empty would record every table as dropped.
+        if (!commit->changed || (commit->has_dir && !commit->listed)) {
+            continue;
+        }
+
+        HashMap listed;
+        if (hash_map_init(&listed, (size_t)commit->file_count * 2 + 16) != 0) {
+            result = -1;
+            break;
+        }
+        for (int f = 0; f < commit->file_count; f++) {
+            SchemaFile *file = &commit->files[f];
+            hash_map_put(&listed, file->table, file);
+            git_oid *last = hash_map_get(&current, file->table);
+            if (last && git_oid_equal(last, &file->blob)) {
+                continue;
+            }
+            Transition *t = add_transition(bf, file->table, i);
+            git_oid *next = malloc(sizeof(git_oid));
+            if (!t || !next) {
+                free(next);
+                result = -1;
+                break;
+            }
+            if (last) {
+                t->old_blob = *last;
+                t->has_old = 1;
+            }
+            t->new_blob = file->blob;
+            t->has_new = 1;
+            *next = file->blob;
+            hash_map_put(&current, file->table, next);
+            free(last);
+        }
+
+        DropScan scan = { &listed, calloc(current.count + 1, sizeof(char *)), 0 };
+        if (result == 0 && scan.gone) {
+            hash_map_foreach(&current, find_dropped, &scan);
+        }
+        for (int g = 0; g < scan.gone_count; g++) {
+            git_oid *last = hash_map_remove(&current, scan.gone[g]);
+            Transition *t = scan.gone[g] && last ? add_transition(bf, scan.gone[g], i) : NULL;
+            if (t) {
+                t->old_blob = *last;
+                t->has_old = 1;
+            }
+            free(last);
+            free(scan.gone[g]);
+        }
+        free(scan.gone);
+        hash_map_free(&listed, NULL);
+    }
+    hash_map_free(&current, free);
+    return result;
+}
+
+static char *read_schema(git_repository *repo, const git_oid *oid)
+{
+    git_blob *blob = NULL;
+    if (git_blob_lookup(&blob, repo, oid) != 0) {
+        return NULL;
+    }
+    char *raw = strndup(git_blob_rawcontent(blob), (size_t)git_blob_rawsize(blob));
+    git_blob_free(blob);
+    if (!raw) {
+        return NULL;
+    }
+    // Committed files may end in a newline the live capture never has.
+    size_t len = strlen(raw);
+    while (len > 0 && (raw[len - 1] == '\n' || raw[len - 1] == '\r' || raw[len - 1] == ' ')) {
+        raw[--len] = '\0';
+    }
+    char *normalized = normalize_schema(raw);
+    free(raw);
+    return normalized;
+}
+
+static void diff_transition(Backfill *bf, git_repository *repo, int index)
+{
+    Transition *t = &bf->transitions[index];
+    char *old_schema = t->has_old ? read_schema(repo, &t->old_blob) : NULL;
+    if (t->has_new) {
+        t->schema = read_schema(repo, &t->new_blob);
+    }
+
+    if (t->schema && old_schema) {
+        if (strcmp(old_schema, t->schema) == 0) {
+            t->unchanged = 1;
+        } else {
+            generate_alter_statements(t->table, old_schema, t->schema, &t->up, &t->down);
+        }
+    } else if (t->schema) {
+        sb_appendf(&t->up, "%s;\n", t->schema);
+        sb_appendf(&t->down, "-- Table did not exist previously\nDROP TABLE IF EXISTS `%s`;\n", t->table);
+    } else if (old_schema) {
+        sb_appendf(&t->up, "DROP TABLE IF EXISTS `%s`;\n", t->table);
+        sb_appendf(&t->down, "%s;\n", old_schema);
+    } else {
+        // The blob could not be read; leave the version out.
+        t->unchanged = 1;
+    }
+    free(old_schema);
+}
+
+// Formats a path under the output root, as the watcher does for a target.
+static void output_path(const Backfill *bf, char *out, size_t size, const char *fmt, ...)
+{
+    va_list args;
+    size_t used = 0;
+    if (bf->root && bf->root[0]) {
+        snprintf(out, size, "%s/", bf->root);
+        used = strlen(out);
+    }
+    va_start(args, fmt);
+    vsnprintf(out + used, size - used, fmt, args);
+    va_end(args);
+}
+
+// Readers such as a running watcher see either the old or the new file.
+static int write_text(const char *path, const char *text, size_t len)
+{
+    if (write_file_atomic(path, text, len, 0) != 0) {
+        fprintf(stderr, "Failed to write backfill file %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// Per-table state while writing: the history is collected in memory and
+// replaces history.txt in one go, and migration stamps are kept strictly
+// increasing so two commits in the same second do not overwrite each
+// other's files.
+typedef struct {
+    time_t last_stamp;
+    const char *schema;
+    StrBuf history;
+} TableOutput;
+
+static void free_output(void *value)
+{
+    TableOutput *out = value;
+    sb_free(&out->history);
+    free(out);
+}
+
+typedef struct {
+    const Backfill *bf;
+    int failed;
+} OutputWriter;
+
+// Writes history.txt, and seeds schema.sql from the last committed version
+// where the watcher has not written one yet, so its first pass only records
+// real drift.
+static void write_table_output(const char *table, void *value, void *arg)
+{
+    TableOutput *out = value;
+    OutputWriter *writer = arg;
+    char path[640];
+
+    output_path(writer->bf, path, sizeof(path), "tables/%s/history.txt", table);
+    if (write_text(path, sb_str(&out->history), out->history.len) != 0) {
+        writer->failed = 1;
+    }
+    output_path(writer->bf, path, sizeof(path), "tables/%s/schema.sql", table);
+    if (out->schema && access(path, F_OK) != 0 && write_text(path, out->schema, strlen(out->schema)) != 0) {
+        writer->failed = 1;
+    }
+}
+
+static int write_timeline(Backfill *bf)
+{
+    HashMap tables;
+    if (hash_map_init(&tables, 256) != 0) {
+        return -1;
+    }
+
+    char tables_dir[512];
+    output_path(bf, tables_dir, sizeof(tables_dir), "tables");
+    create_directories(tables_dir);
+    int written = 0;
+    int failed = 0;
+    for (int i = 0; i < bf->transition_count; i++) {
+        Transition *t = &bf->transitions[i];
+        if (t->unchanged) {
+            continue;
+        }
+        BackfillCommit *commit = &bf->commits[t->commit];
+        char table_dir[512];
+        char path[640];
+        snprintf(table_dir, sizeof(table_dir), "%s/%s", tables_dir, t->table);
+
+        TableOutput *out = hash_map_get(&tables, t->table);
+        if (!out) {
+            out = calloc(1, sizeof(TableOutput));
+            if (!out || hash_map_put(&tables, t->table, out) != 0) {
+                free(out);
+                failed = 1;
+                continue;
+            }
+            create_directories(table_dir);
+        }
+        out->schema = t->schema;
+
+        time_t stamp = (time_t)commit->time;
+        if (stamp <= out->last_stamp) {
+            stamp = out->last_stamp + 1;
+        }
+        out->last_stamp = stamp;
+        struct tm tm_commit;
+        char timestamp[64];
+        char when[64];
+        char short_id[8];
+        localtime_r(&stamp, &tm_commit);
+        strftime(timestamp, sizeof(timestamp), "%Y%m%d%H%M%S", &tm_commit);
+        strftime(when, sizeof(when), "%a %b %e %H:%M:%S %Y", &tm_commit);
+        git_oid_tostr(short_id, sizeof(short_id), &commit->id);
+
+        if (t->up.len > 0 || t->down.len > 0) {
+            snprintf(path, sizeof(path), "%s/migrations", table_dir);
+            create_directories(path);
+            snprintf(path, sizeof(path), "%s/migrations/%s_%s_up.sql", table_dir, timestamp, t->table);
+            failed |= write_text(path, sb_str(&t->up), t->up.len) != 0;
+            snprintf(path, sizeof(path), "%s/migrations/%s_%s_down.sql", table_dir, timestamp, t->table);
+            failed |= write_text(path, sb_str(&t->down), t->down.len) != 0;
+        }
+
+        StrBuf *note = &out->history;
+        sb_appendf(note, "[%s] Schema changed (commit %s)\n", when, short_id);
+        if (!t->has_new) {
+            sb_append(note, "Table dropped.\n");
+        } else if (t->has_old) {
+            sb_append(note, "Previous schema was different. Generated ALTER statements.\n");
+        } else {
+            sb_append(note, "Initial schema saved.\n");
+        }
+        sb_append(note, "----------------------------------------\n");
+        written++;
+    }
+
+    OutputWriter writer = { bf, 0 };
+    hash_map_foreach(&tables, write_table_output, &writer);
+    hash_map_free(&tables, free_output);
+    return failed || writer.failed ? -1 : written;
+}
+
+static void free_backfill(Backfill *bf)
+{
+    for (int i = 0; i < bf->commit_count; i++) {
+        for (int f = 0; f < bf->commits[i].file_count; f++) {
+            free(bf->commits[i].files[f].table);
+        }
+        free(bf->commits[i].files);
+    }
+    free(bf->commits);
+    for (int i = 0; i < bf->transition_count; i++) {
+        free(bf->transitions[i].table);
+        free(bf->transitions[i].schema);
+        sb_free(&bf->transitions[i].up);
+        sb_free(&bf->transitions[i].down);
+    }
+    free(bf->transitions);
+}
+
+int git_backfill(const char *schema_dir, const char *root, int threads)
+{
+    Backfill bf;
+    git_repository *repo = NULL;
+    int result = -1;
+
+    memset(&bf, 0, sizeof(bf));
+    bf.schema_dir = schema_dir;
+    bf.root = root;
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    int rc = git_libgit2_init();
+    if (rc < 0) {
+        log_git_error("git_libgit2_init", rc);
+        return -1;
+    }
+    if (git_open_repository(&repo) != 0) {
+        goto done;
+    }
+    if (collect_commits(&bf, repo) != 0) {
+        goto done;
+    }
+    printf("Backfill: %d commit(s) on the first-parent history of HEAD\n", bf.commit_count);
+
+    if (run_parallel(&bf, threads, bf.commit_count, locate_schema_dir) != 0) {
+        goto done;
+    }
+    // Each commit is compared with the last one that could be read, so an
+    // unreadable commit neither drops every table nor hides a change.
+    BackfillCommit *prev = NULL;
+    int unreadable = 0;
+    for (int i = 0; i < bf.commit_count; i++) {
+        BackfillCommit *commit = &bf.commits[i];
+        if (commit->unreadable) {
+            unreadable++;
+            continue;
+        }
+        int prev_has_dir = prev && prev->has_dir;
+        if (commit->has_dir) {
+            commit->changed = !prev_has_dir || !git_oid_equal(&commit->dir, &prev->dir);
+        } else {
+            commit->changed = prev_has_dir;
+        }
+        prev = commit;
+    }
+    if (unreadable > 0) {
+        fprintf(stderr, "Backfill: skipped %d commit(s) that could not be read\n", unreadable);
+    }
+    if (run_parallel(&bf, threads, bf.commit_count, list_schema_files) != 0 ||
+        build_timeline(&bf) != 0 ||
+        run_parallel(&bf, threads, bf.transition_count, diff_transition) != 0) {
+        goto done;
+    }
+
+    result = write_timeline(&bf);
+    if (result >= 0) {
+        printf("Backfill: wrote %d schema version(s) from %s/\n", result, schema_dir);
+    }
+
+done:
+    git_repository_free(repo);
+    free_backfill(&bf);
+    git_libgit2_shutdown();
+    return result;
+}
@@ -2,12 +2,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <poll.h>
 #include <unistd.h>
 #include "app_context.h"
+#include "ref_watcher.h"
 
 #define BRANCH_NAME_SIZE 256
+#define POLL_INTERVAL_SECONDS 2
 
-static void log_git_error(const char *action, int error_code)
+void log_git_error(const char *action, int error_code)
 {
     const git_error *error = git_error_last();
     fprintf(stderr, "%s failed (%d): %s\n",
@@ -16,7 +19,7 @@ static void log_git_error(const char *action, int error_code)
             (error && error->message) ? error->message : "unknown error");
 }
 
-static int open_repository(git_repository **repo)
+int git_open_repository(git_repository **repo)
 {
     const char *path = getenv("PWD");
     if (!path) {
@@ -41,6 +44,14 @@ static int resolve_head_oid(git_repository *repo, git_oid *oid)
     return 0;
 }
 
+// Shares HEAD with the DB watcher, which tags its schema commits with it.
+static void publish_head_oid(AppContext *ctx, const git_oid *oid)
+{
+    char oid_hex[GIT_OID_HEXSZ + 1];
+    git_oid_tostr(oid_hex, sizeof(oid_hex), oid);
+    app_set_head(ctx, oid_hex);
+}
+
 static int should_stop(AppContext *ctx)
 {
     int stop = 0;
@@ -102,29 +113,85 @@ static void print_commit_info(git_repository *repo, const git_oid *commit_oid)
     git_commit_free(commit);
 }
 
-static void watch_repo_changes(git_repository *repo, git_oid *last_oid, char *last_branch_name, size_t branch_name_size, AppContext *ctx)
+static void check_repo_state(git_repository *repo, git_oid *last_oid, char *last_branch_name, size_t branch_name_size, AppContext *ctx)
 {
     git_oid current_oid;
     char current_branch_name[BRANCH_NAME_SIZE];
 
+    if (resolve_head_oid(repo, &current_oid) == 0 &&
+        git_oid_cmp(last_oid, &current_oid) != 0) {
+        *last_oid = current_oid;
+        publish_head_oid(ctx, &current_oid);
+        print_commit_info(repo, &current_oid);
+        app_log(ctx, "Git: new commit detected on branch %s", last_branch_name);
+        app_notify_commit(ctx);
+    }
+
+    if (get_current_branch_name(repo, current_branch_name, sizeof(current_branch_name)) == 0 &&
+        strcmp(last_branch_name, current_branch_name) != 0) {
+        printf("Branch changed: %s -> %s\n", last_branch_name, current_branch_name);
+        app_log(ctx, "Git: branch changed %s -> %s", last_branch_name, current_branch_name);
+        app_set_branch(ctx, current_branch_name);
+        snprintf(last_branch_name, branch_name_size, "%s", current_branch_name);
+    }
+}
+
+// libgit2 reports directories with a trailing slash.
+static void copy_dir_path(char *out, size_t out_size, const char *path)
+{
+    snprintf(out, out_size, "%s", path ? path : ".git");
+    size_t len = strlen(out);
+    while (len > 1 && out[len - 1] == '/') {
+        out[--len] = '\0';
+    }
+}
+
+static int open_ref_watcher(git_repository *repo, RefWatcher *watcher)
+{
+    char git_dir[REF_WATCHER_PATH_SIZE];
+    char common_dir[REF_WATCHER_PATH_SIZE];
+    copy_dir_path(git_dir, sizeof(git_dir), git_repository_path(repo));
+    copy_dir_path(common_dir, sizeof(common_dir), git_repository_commondir(repo));
+    return ref_watcher_open(watcher, git_dir, common_dir);
+}
+
+// Sleeps on inotify until HEAD, a branch ref, packed-refs or the HEAD reflog
+// changes, then re-reads HEAD. Falls back to polling every
+// POLL_INTERVAL_SECONDS when inotify cannot be used. Either way the wait also
+// ends as soon as a stop is requested through the context's wake fd.
+static void watch_repo_changes(git_repository *repo, git_oid *last_oid, char *last_branch_name, size_t branch_name_size, AppContext *ctx)
+{
+    RefWatcher watcher;
+    int use_inotify = open_ref_watcher(repo, &watcher) == 0;
+    if (use_inotify) {
+        app_log(ctx, "Git: watching refs with inotify (%d watches)", watcher.watch_count);
+        // Catch anything that moved between the initial read and the watches.
+        check_repo_state(repo, last_oid, last_branch_name, branch_name_size, ctx);
+    } else {
+        app_log(ctx, "Git: inotify unavailable, polling every %d s", POLL_INTERVAL_SECONDS);
+    }
+
     while (!should_stop(ctx)) {
-        if (resolve_head_oid(repo, &current_oid) == 0 &&
-            git_oid_cmp(last_oid, &current_oid) != 0) {
-            *last_oid = current_oid;
-            print_commit_info(repo, &current_oid);
-            app_log(ctx, "Git: new commit detected on branch %s", last_branch_name);
+        if (use_inotify) {
+            int rc = ref_watcher_wait(&watcher, ctx ? ctx->wake_fd : -1, -1);
+            if (rc == 0) {
+                continue;
+            }
+            if (rc < 0) {
+                app_log(ctx, "Git: inotify read failed, falling back to polling every %d s", POLL_INTERVAL_SECONDS);
+                ref_watcher_close(&watcher);
+                use_inotify = 0;
+            }
         }
 
-        if (get_current_branch_name(repo, current_branch_name, sizeof(current_branch_name)) == 0 &&
-            strcmp(last_branch_name, current_branch_name) != 0) {
-            printf("Branch changed: %s -> %s\n", last_branch_name, current_branch_name);
-            app_log(ctx, "Git: branch changed %s -> %s", last_branch_name, current_branch_name);
-            app_set_branch(ctx, current_branch_name);
-            snprintf(last_branch_name, branch_name_size, "%s", current_branch_name);
-        }
+        check_repo_state(repo, last_oid, last_branch_name, branch_name_size, ctx);
 
-        sleep(2);
+        if (!use_inotify) {
+            struct pollfd pfd = { .fd = ctx ? ctx->wake_fd : -1, .events = POLLIN };
+            poll(&pfd, pfd.fd >= 0 ? 1 : 0, POLL_INTERVAL_SECONDS * 1000);
+        }
     }
+    ref_watcher_close(&watcher);
 }
 
 void git_init(AppContext *ctx)
@@ -139,7 +206,7 @@ void git_init(AppContext *ctx)
         return;
     }
 
-    if (open_repository(&repo) != 0) {
+    if (git_open_repository(&repo) != 0) {
         git_libgit2_shutdown();
         return;
     }
@@ -149,6 +216,7 @@ void git_init(AppContext *ctx)
         git_libgit2_shutdown();
         return;
     }
+    publish_head_oid(ctx, &last_oid);
 
     if (get_current_branch_name(repo, last_branch_name, sizeof(last_branch_name)) != 0) {
         snprintf(last_branch_name, sizeof(last_branch_name), "%s", "unknown");
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <string.h>
+#include "git_snapshot.h"
+#include "git_service.h"
+
+#define SNAPSHOT_REF_PREFIX "refs/schema/"
+#define SNAPSHOT_AUTHOR "K_git_sql"
+#define SNAPSHOT_EMAIL "k_git_sql@localhost"
+
+int git_snapshot_open(GitSnapshot *gs)
+{
+    memset(gs, 0, sizeof(*gs));
+    int rc = git_libgit2_init();
+    if (rc < 0) {
+        log_git_error("git_libgit2_init", rc);
+        return -1;
+    }
+    if (git_open_repository(&gs->repo) != 0) {
+        git_libgit2_shutdown();
+        return -1;
+    }
+    return 0;
+}
+
+void git_snapshot_abort(GitSnapshot *gs)
+{
+    git_treebuilder_free(gs->builder);
+    gs->builder = NULL;
+    git_commit_free(gs->parent);
+    gs->parent = NULL;
+}
+
+int git_snapshot_begin(GitSnapshot *gs, const char *branch)
+{
+    git_oid tip;
+    git_tree *tree = NULL;
+
+    git_snapshot_abort(gs);
+    snprintf(gs->branch, sizeof(gs->branch), "%s", branch);
+    snprintf(gs->ref_name, sizeof(gs->ref_name), "%s%s", SNAPSHOT_REF_PREFIX, branch);
+
+    int rc = git_reference_name_to_id(&tip, gs->repo, gs->ref_name);
+    if (rc == 0) {
+        rc = git_commit_lookup(&gs->parent, gs->repo, &tip);
+        if (rc == 0) {
+            rc = git_commit_tree(&tree, gs->parent);
+        }
+        if (rc != 0) {
+            log_git_error("git_commit_lookup(schema ref)", rc);
+            git_snapshot_abort(gs);
+            return -1;
+        }
+    } else if (rc != GIT_ENOTFOUND) {
+        log_git_error("git_reference_name_to_id(schema ref)", rc);
+        return -1;
+    }
+
+    rc = git_treebuilder_new(&gs->builder, gs->repo, tree);
+    git_tree_free(tree);
+    if (rc != 0) {
+        log_git_error("git_treebuilder_new", rc);
+        git_snapshot_abort(gs);
+        return -1;
+    }
+    return gs->parent ? 0 : 1;
+}
+
+int git_snapshot_put(GitSnapshot *gs, const char *table, const char *schema, size_t len)
+{
+    git_oid blob;
+    char entry_name[300];
+
+    if (!gs->builder) {
+        return -1;
+    }
+    // Writing an object that already exists only hashes it, so unchanged
+    // schemas cost no disk I/O.
+    int rc = git_blob_create_from_buffer(&blob, gs->repo, schema, len);
+    if (rc != 0) {
+        log_git_error("git_blob_create_from_buffer", rc);
+        return -1;
+    }
+    snprintf(entry_name, sizeof(entry_name), "%s.sql", table);
+    rc = git_treebuilder_insert(NULL, gs->builder, entry_name, &blob, GIT_FILEMODE_BLOB);
+    if (rc != 0) {
+        log_git_error("git_treebuilder_insert", rc);
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    int (*keep)(const char *table, void *arg);
+    void *arg;
+} KeepFilter;
+
+static int drop_entry(const git_tree_entry *entry, void *payload)
+{
+    KeepFilter *filter = payload;
+    char table[300];
+    snprintf(table, sizeof(table), "%s", git_tree_entry_name(entry));
+    size_t len = strlen(table);
+    if (len > 4 && strcmp(table + len - 4, ".sql") == 0) {
+        table[len - 4] = '\0';
+    }
+    return !filter->keep(table, filter->arg);
+}
+
+int git_snapshot_commit(GitSnapshot *gs, int (*keep)(const char *table, void *arg), void *arg,
+                        const char *source_oid, unsigned long generation)
+{
+    git_oid tree_oid;
+    git_oid commit_oid;
+    git_tree *tree = NULL;
+    git_signature *signature = NULL;
+    char message[512];
+    int result = -1;
+
+    if (!gs->builder) {
+        return -1;
+    }
+    if (keep) {
+        KeepFilter filter = { keep, arg };
+        git_treebuilder_filter(gs->builder, drop_entry, &filter);
+    }
+
+    int rc = git_treebuilder_write(&tree_oid, gs->builder);
+    if (rc != 0) {
+        log_git_error("git_treebuilder_write", rc);
+        goto done;
+    }
+    if (gs->parent && git_oid_equal(&tree_oid, git_commit_tree_id(gs->parent))) {
+        result = 0;
+        goto done;
+    }
+
+    rc = git_tree_lookup(&tree, gs->repo, &tree_oid);
+    if (rc != 0) {
+        log_git_error("git_tree_lookup", rc);
+        goto done;
+    }
+    // user.name/user.email of the repository when set.
+    if (git_signature_default(&signature, gs->repo) != 0) {
+        rc = git_signature_now(&signature, SNAPSHOT_AUTHOR, SNAPSHOT_EMAIL);
+        if (rc != 0) {
+            log_git_error("git_signature_now", rc);
+            goto done;
+        }
+    }
+
+    snprintf(message, sizeof(message), "schema: %s (generation %lu)\n\nSource-Commit: %s\n",
+             gs->branch, generation, source_oid && source_oid[0] ? source_oid : "unknown");
+    const git_commit *parents[1] = { gs->parent };
+    // Passing the ref makes libgit2 move it only while it still points at
+    // parents[0], so a concurrent writer is reported instead of overwritten.
+    rc = git_commit_create(&commit_oid, gs->repo, gs->ref_name, signature, signature, NULL, message,
+                           tree, gs->parent ? 1 : 0, parents);
+    if (rc != 0) {
+        log_git_error("git_commit_create", rc);
+        goto done;
+    }
+    gs->commits++;
+    result = 1;
+
+done:
+    git_signature_free(signature);
+    git_tree_free(tree);
+    git_snapshot_abort(gs);
+    return result;
+}
+
+void git_snapshot_close(GitSnapshot *gs)
+{
+    git_snapshot_abort(gs);
+    if (gs->repo) {
+        git_repository_free(gs->repo);
+        gs->repo = NULL;
+        git_libgit2_shutdown();
+    }
+}
@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <string.h>
+#include "hash_map.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+uint64_t hash_bytes(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t hash_string(const char *str) {
+    return hash_bytes(str, strlen(str));
+}
+
+static HashEntry **find_slot(const HashMap *map, const char *key, uint64_t hash) {
+    HashEntry **slot = &map->buckets[hash & (map->bucket_count - 1)];
+    while (*slot) {
+        if ((*slot)->hash == hash && strcmp((*slot)->key, key) == 0) {
+            return slot;
+        }
+        slot = &(*slot)->next;
+    }
+    return slot;
+}
+
+static int grow(HashMap *map) {
+    size_t bucket_count = map->bucket_count * 2;
+    HashEntry **buckets = calloc(bucket_count, sizeof(HashEntry *));
+    if (!buckets) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < map->bucket_count; i++) {
+        HashEntry *entry = map->buckets[i];
+        while (entry) {
+            HashEntry *next = entry->next;
+            size_t index = entry->hash & (bucket_count - 1);
+            entry->next = buckets[index];
+            buckets[index] = entry;
+            entry = next;
+        }
+    }
+
+    free(map->buckets);
+    map->buckets = buckets;
+    map->bucket_count = bucket_count;
+    return 0;
+}
+
+int hash_map_init(HashMap *map, size_t initial_buckets) {
+    size_t bucket_count = 16;
+    while (bucket_count < initial_buckets) {
+        bucket_count *= 2;
+    }
+
+    map->buckets = calloc(bucket_count, sizeof(HashEntry *));
+    if (!map->buckets) {
+        return -1;
+    }
+    map->bucket_count = bucket_count;
+    map->count = 0;
+    return 0;
+}
+
+void *hash_map_get(const HashMap *map, const char *key) {
+    if (!map->buckets) {
+        return NULL;
+    }
+    HashEntry *entry = *find_slot(map, key, hash_string(key));
+    return entry ? entry->value : NULL;
+}
+
+int hash_map_put(HashMap *map, const char *key, void *value) {
+    if (!map->buckets && hash_map_init(map, 0) != 0) {
+        return -1;
+    }
+
+    uint64_t hash = hash_string(key);
+    HashEntry **slot = find_slot(map, key, hash);
+    if (*slot) {
+        (*slot)->value = value;
+        return 0;
+    }
+
+    HashEntry *entry = malloc(sizeof(HashEntry));
+    if (!entry) {
+        return -1;
+    }
+    entry->key = strdup(key);
+    if (!entry->key) {
+        free(entry);
+        return -1;
+    }
+    entry->hash = hash;
+    entry->value = value;
+    entry->next = NULL;
+    *slot = entry;
+    map->count++;
+
+    // Keep chains short; a failed grow only costs lookup speed.
+    if (map->count > map->bucket_count) {
+        grow(map);
+    }
+    return 0;
+}
+
+void *hash_map_remove(HashMap *map, const char *key) {
+    if (!map->buckets) {
+        return NULL;
+    }
+
+    HashEntry **slot = find_slot(map, key, hash_string(key));
+    HashEntry *entry = *slot;
+    if (!entry) {
+        return NULL;
+    }
+
+    void *value = entry->value;
+    *slot = entry->next;
+    free(entry->key);
+    free(entry);
+    map->count--;
+    return value;
+}
+
+void hash_map_foreach(const HashMap *map, void (*fn)(const char *key, void *value, void *arg), void *arg) {
+    if (!map->buckets) {
+        return;
+    }
+    for (size_t i = 0; i < map->bucket_count; i++) {
+        for (HashEntry *entry = map->buckets[i]; entry; entry = entry->next) {
+            fn(entry->key, entry->value, arg);
+        }
+    }
+}
+
+void hash_map_free(HashMap *map, void (*free_value)(void *value)) {
+    if (!map->buckets) {
+        return;
+    }
+    for (size_t i = 0; i < map->bucket_count; i++) {
+        HashEntry *entry = map->buckets[i];
+        while (entry) {
+            HashEntry *next = entry->next;
+            if (free_value) {
+                free_value(entry->value);
+            }
+            free(entry->key);
+            free(entry);
+            entry = next;
+        }
+    }
+    free(map->buckets);
+    map->buckets = NULL;
+    map->bucket_count = 0;
+    map->count = 0;
+}
@@ -0,0 +1,371 @@
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include "logger.h"
+
+#define LOG_QUEUE_SLOTS 1024
+#define LOG_QUEUE_MASK (LOG_QUEUE_SLOTS - 1)
+#define LOG_MESSAGE_SIZE 1024
+#define LOG_PATH_SIZE 256
+
+// One queued record. sequence implements the bounded MPMC ring described by
+// Dmitry Vyukov: a slot is free for position p when sequence == p and holds a
+// record for the reader when sequence == p + 1.
+typedef struct {
+    atomic_size_t sequence;
+    LogLevel level;
+    struct timespec time;
+    char message[LOG_MESSAGE_SIZE];
+} LogSlot;
+
+static LogSlot g_slots[LOG_QUEUE_SLOTS];
+static atomic_size_t g_enqueue_pos;
+static size_t g_dequeue_pos;
+static atomic_int g_running;
+// Set by the writer before it blocks on g_wake_fd. The producer that clears
+// it, i.e. the first one after the queue went empty, wakes the writer;
+// everyone else enqueues without a system call.
+static atomic_int g_writer_idle;
+static int g_wake_fd = -1;
+static atomic_int g_min_level = LOG_LEVEL_INFO;
+static atomic_ulong g_written;
+static atomic_ulong g_dropped;
+static atomic_ulong g_rotations;
+static atomic_ulong g_flushes;
+
+static pthread_t g_writer;
+static pthread_mutex_t g_sync_lock = PTHREAD_MUTEX_INITIALIZER;
+static char g_path[LOG_PATH_SIZE] = "logs/app.log";
+static size_t g_max_bytes;
+static int g_max_files;
+static FILE *g_fp;
+static size_t g_file_size;
+static unsigned long g_reported_drops;
+
+static const char *level_name(LogLevel level) {
+    switch (level) {
+    case LOG_LEVEL_DEBUG:
+        return "DEBUG";
+    case LOG_LEVEL_WARN:
+        return "WARN";
+    case LOG_LEVEL_ERROR:
+        return "ERROR";
+    case LOG_LEVEL_INFO:
+    default:
+        return "INFO";
+    }
+}
+
+static void ensure_log_dir(const char *path) {
+    char dir[LOG_PATH_SIZE];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash || slash == dir) {
+        return;
+    }
+    *slash = '\0';
+
+    struct stat st = {0};
+    if (stat(dir, &st) == -1) {
+        mkdir(dir, 0700);
+    }
+}
+
+static int format_record(char *out, size_t out_size, LogLevel level, const struct timespec *when,
+                         const char *message) {
+    struct tm tm_now;
+    char ts[32];
+    localtime_r(&when->tv_sec, &tm_now);
+    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &tm_now);
+    int n = snprintf(out, out_size, "[%s] [%s] %s\n", ts, level_name(level), message);
+    if (n < 0) {
+        return 0;
+    }
+    return (size_t)n < out_size ? n : (int)out_size - 1;
+}
+
+static void open_log(void) {
+    ensure_log_dir(g_path);
+    g_fp = fopen(g_path, "a");
+    g_file_size = 0;
+    if (!g_fp) {
+        return;
+    }
+    // Records are batched by the writer thread; let stdio buffer them.
+    setvbuf(g_fp, NULL, _IOFBF, 64 * 1024);
+    struct stat st;
+    if (stat(g_path, &st) == 0) {
+        g_file_size = (size_t)st.st_size;
+    }
+}
+
+// Shifts <path>.N-1 to <path>.N down to <path> -> <path>.1 and starts a new
+// file. Without a file count the log is simply truncated.
+static void rotate_log(void) {
+    if (g_fp) {
+        fclose(g_fp);
+        g_fp = NULL;
+    }
+
+    char from[LOG_PATH_SIZE + 16];
+    char to[LOG_PATH_SIZE + 16];
+    if (g_max_files > 0) {
+        for (int i = g_max_files; i > 1; i--) {
+            snprintf(from, sizeof(from), "%s.%d", g_path, i - 1);
+            snprintf(to, sizeof(to), "%s.%d", g_path, i);
+            rename(from, to);
+        }
+        snprintf(to, sizeof(to), "%s.1", g_path);
+        rename(g_path, to);
+    } else {
+        FILE *fp = fopen(g_path, "w");
+        if (fp) {
+            fclose(fp);
+        }
+    }
+    atomic_fetch_add_explicit(&g_rotations, 1, memory_order_relaxed);
+    open_log();
+}
+
+static void write_record(LogLevel level, const struct timespec *when, const char *message) {
+    char record[LOG_MESSAGE_SIZE + 64];
+    int len = format_record(record, sizeof(record), level, when, message);
+
+    if (g_max_bytes > 0 && g_file_size + (size_t)len > g_max_bytes && g_file_size > 0) {
+        rotate_log();
+    }
+    if (!g_fp) {
+        open_log();
+        if (!g_fp) {
+            return;
+        }
+    }
+    fwrite(record, 1, (size_t)len, g_fp);
+    g_file_size += (size_t)len;
+    atomic_fetch_add_explicit(&g_written, 1, memory_order_relaxed);
+}
+
+static int enqueue(LogLevel level, const char *fmt, va_list args) {
+    size_t pos = atomic_load_explicit(&g_enqueue_pos, memory_order_relaxed);
+    LogSlot *slot;
+    for (;;) {
+        slot = &g_slots[pos & LOG_QUEUE_MASK];
+        size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&g_enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&g_enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    clock_gettime(CLOCK_REALTIME, &slot->time);
+    vsnprintf(slot->message, sizeof(slot->message), fmt, args);
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return 0;
+}
+
+// Writes every record currently in the queue. Only the writer thread (or
+// logger_stop() after it has exited) calls this, holding g_sync_lock: a
+// caller that already saw g_running cleared writes g_fp from write_sync()
+// while the writer may still be finishing a batch.
+static int drain(void) {
+    int count = 0;
+    for (;;) {
+        LogSlot *slot = &g_slots[g_dequeue_pos & LOG_QUEUE_MASK];
+        size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (seq != g_dequeue_pos + 1) {
+            break;
+        }
+        write_record(slot->level, &slot->time, slot->message);
+        atomic_store_explicit(&slot->sequence, g_dequeue_pos + LOG_QUEUE_SLOTS, memory_order_release);
+        g_dequeue_pos++;
+        count++;
+    }
+
+    unsigned long dropped = atomic_load_explicit(&g_dropped, memory_order_relaxed);
+    if (dropped != g_reported_drops) {
+        char message[128];
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        snprintf(message, sizeof(message), "logger: queue full, dropped %lu messages (%lu total)",
+                 dropped - g_reported_drops, dropped);
+        write_record(LOG_LEVEL_WARN, &now, message);
+        g_reported_drops = dropped;
+        count++;
+    }
+
+    if (count > 0 && g_fp) {
+        fflush(g_fp);
+        atomic_fetch_add_explicit(&g_flushes, 1, memory_order_relaxed);
+    }
+    return count;
+}
+
+static void wake_writer(void) {
+    uint64_t one = 1;
+    if (write(g_wake_fd, &one, sizeof(one)) < 0) {
+        perror("eventfd write");
+    }
+}
+
+static int queue_empty(void) {
+    const LogSlot *slot = &g_slots[g_dequeue_pos & LOG_QUEUE_MASK];
+    return atomic_load_explicit(&slot->sequence, memory_order_acquire) != g_dequeue_pos + 1;
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    while (atomic_load_explicit(&g_running, memory_order_acquire)) {
+        pthread_mutex_lock(&g_sync_lock);
+        int count = drain();
+        pthread_mutex_unlock(&g_sync_lock);
+        if (count > 0) {
+            continue;
+        }
+        // Announce the sleep before the last look at the queue: a record
+        // published after that look finds the flag set and wakes us.
+        atomic_store(&g_writer_idle, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!queue_empty() || !atomic_load_explicit(&g_running, memory_order_acquire)) {
+            atomic_store(&g_writer_idle, 0);
+            continue;
+        }
+        // A wake-up left over from a producer that raced the check above
+        // only costs one extra pass.
+        uint64_t wakes;
+        if (read(g_wake_fd, &wakes, sizeof(wakes)) < 0) {
+            perror("eventfd read");
+        }
+        atomic_store(&g_writer_idle, 0);
+    }
+    pthread_mutex_lock(&g_sync_lock);
+    drain();
+    pthread_mutex_unlock(&g_sync_lock);
+    return NULL;
+}
+
+static void write_sync(LogLevel level, const char *fmt, va_list args) {
+    char message[LOG_MESSAGE_SIZE];
+    struct timespec now;
+    vsnprintf(message, sizeof(message), fmt, args);
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    pthread_mutex_lock(&g_sync_lock);
+    write_record(level, &now, message);
+    if (g_fp) {
+        fclose(g_fp);
+        g_fp = NULL;
+    }
+    pthread_mutex_unlock(&g_sync_lock);
+}
+
+int logger_start(const LoggerConfig *config) {
+    if (atomic_load(&g_running)) {
+        return 0;
+    }
+    if (config) {
+        if (config->path && config->path[0]) {
+            snprintf(g_path, sizeof(g_path), "%s", config->path);
+        }
+        atomic_store(&g_min_level, config->min_level);
+        g_max_bytes = config->max_bytes;
+        g_max_files = config->max_files;
+    }
+
+    for (size_t i = 0; i < LOG_QUEUE_SLOTS; i++) {
+        atomic_store_explicit(&g_slots[i].sequence, i, memory_order_relaxed);
+    }
+    atomic_store(&g_enqueue_pos, 0);
+    g_dequeue_pos = 0;
+
+    open_log();
+    atomic_store(&g_writer_idle, 0);
+    g_wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (g_wake_fd < 0) {
+        perror("eventfd");
+        fprintf(stderr, "Failed to start log writer, logging synchronously\n");
+        return -1;
+    }
+    atomic_store(&g_running, 1);
+    if (pthread_create(&g_writer, NULL, writer_main, NULL) != 0) {
+        atomic_store(&g_running, 0);
+        close(g_wake_fd);
+        g_wake_fd = -1;
+        fprintf(stderr, "Failed to start log writer, logging synchronously\n");
+        return -1;
+    }
+    return 0;
+}
+
+void logger_stop(void) {
+    if (!atomic_exchange(&g_running, 0)) {
+        return;
+    }
+    wake_writer();
+    pthread_join(g_writer, NULL);
+    close(g_wake_fd);
+    g_wake_fd = -1;
+    pthread_mutex_lock(&g_sync_lock);
+    drain();
+    if (g_fp) {
+        fclose(g_fp);
+        g_fp = NULL;
+    }
+    pthread_mutex_unlock(&g_sync_lock);
+}
+
+void log_vmessage(LogLevel level, const char *fmt, va_list args) {
+    if ((int)level < atomic_load_explicit(&g_min_level, memory_order_relaxed)) {
+        return;
+    }
+    if (!atomic_load_explicit(&g_running, memory_order_acquire)) {
+        write_sync(level, fmt, args);
+    } else if (enqueue(level, fmt, args) != 0) {
+        atomic_fetch_add_explicit(&g_dropped, 1, memory_order_relaxed);
+    } else {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&g_writer_idle, memory_order_relaxed) && atomic_exchange(&g_writer_idle, 0)) {
+            wake_writer();
+        }
+    }
+}
+
+void log_message(LogLevel level, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    log_vmessage(level, fmt, args);
+    va_end(args);
+}
+
+void logger_get_stats(LoggerStats *out) {
+    out->written = atomic_load(&g_written);
+    out->dropped = atomic_load(&g_dropped);
+    out->rotations = atomic_load(&g_rotations);
+    out->flushes = atomic_load(&g_flushes);
+}
+
+LogLevel log_level_parse(const char *name, LogLevel fallback) {
+    if (!name) {
+        return fallback;
+    }
+    if (strcasecmp(name, "debug") == 0) return LOG_LEVEL_DEBUG;
+    if (strcasecmp(name, "info") == 0) return LOG_LEVEL_INFO;
+    if (strcasecmp(name, "warn") == 0 || strcasecmp(name, "warning") == 0) return LOG_LEVEL_WARN;
+    if (strcasecmp(name, "error") == 0) return LOG_LEVEL_ERROR;
+    return fallback;
+}
@@ -1,12 +1,26 @@
+#include <signal.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <pthread.h>
 #include <mysql/mysql.h>
 #include "mysql_service.h"
 #include "git_service.h"
 #include "app_context.h"
+#include "logger.h"
+#include "metrics.h"
+#include "snapshot_store.h"
+#include "git_backfill.h"
+#include "dump_diff.h"
+#include "target_scheduler.h"
+
+#define LOG_DEFAULT_MAX_BYTES (10L * 1024 * 1024)
+#define LOG_DEFAULT_MAX_FILES 5
 
 typedef struct {
     DBConfig *config;
+    TargetConfig *targets;
+    int target_count;
     AppContext *ctx;
 } ServiceArgs;
 
@@ -18,18 +32,105 @@ static void *git_thread_main(void *arg) {
 
 static void *mysql_thread_main(void *arg) {
     ServiceArgs *args = (ServiceArgs *)arg;
-    watch_database(args->config, args->ctx);
+    if (args->target_count > 0) {
+        watch_targets(args->targets, args->target_count, args->config, args->ctx);
+    } else {
+        watch_database(args->config, args->ctx);
+    }
     return NULL;
 }
 
-int main() {
+// `main export [dir]` writes the per-table file layout out of the pack store
+// named by SNAPSHOT_PACK, under dir (default: the current directory).
+static int export_snapshots(const char *root) {
     DBConfig config = {0};
-    AppContext app_ctx = {
-        .lock = PTHREAD_MUTEX_INITIALIZER,
-        .cond = PTHREAD_COND_INITIALIZER,
-        .stop = 0,
-        .current_branch = "unknown"
-    };
+    if (load_config(&config) != 0 || !config.snapshot_pack) {
+        fprintf(stderr, "SNAPSHOT_PACK is not set in .env\n");
+        free_config(&config);
+        return 1;
+    }
+    SnapshotStore store;
+    if (snapshot_store_open(&store, config.snapshot_pack, 1) != 0) {
+        free_config(&config);
+        return 1;
+    }
+    int files = snapshot_store_export(&store, root);
+    printf("Exported %d file(s) from %s to %s\n", files, config.snapshot_pack, root);
+    snapshot_store_close(&store);
+    free_config(&config);
+    return 0;
+}
+
+// `main backfill [dir] [target]` rebuilds tables/<t>/history.txt and
+// migrations from the schema files committed under dir (default: tables) in
+// the history of HEAD, using one thread per CPU. The files go where the
+// watcher of the single database, or of the named [target] section, writes
+// them. A pack store cannot be backfilled, so SNAPSHOT_PACK makes it refuse.
+static int backfill_history(const char *schema_dir, const char *target_name) {
+    DBConfig defaults = {0};
+    TargetConfig *targets = NULL;
+    int target_count = 0;
+    int rc = 1;
+    if (access(".env", F_OK) == 0 && load_config(&defaults) != 0) {
+        return 1;
+    }
+
+    const DBConfig *config = &defaults;
+    const char *root = NULL;
+    if (target_name) {
+        if (load_targets(&defaults, &targets, &target_count) != 0) {
+            goto done;
+        }
+        config = NULL;
+        for (int i = 0; i < target_count; i++) {
+            if (strcmp(targets[i].name, target_name) == 0) {
+                config = &targets[i].config;
+                root = config->output_root ? config->output_root : targets[i].name;
+            }
+        }
+        if (!config) {
+            fprintf(stderr, "No [%s] section in .env\n", target_name);
+            goto done;
+        }
+    }
+    if (config->snapshot_pack) {
+        fprintf(stderr, "SNAPSHOT_PACK is set, but backfill only writes the per-table file layout\n");
+        goto done;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    rc = git_backfill(schema_dir, root, cpus > 0 ? (int)cpus : 1) < 0 ? 1 : 0;
+
+done:
+    free_targets(targets, target_count);
+    free_config(&defaults);
+    return rc;
+}
+
+// `main diff <old.sql> <new.sql> [dir]` writes the migration between two
+// schema dumps under dir (default: migrations), using one thread per CPU.
+static int diff_dumps(const char *old_path, const char *new_path, const char *out_dir) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return dump_diff(old_path, new_path, out_dir, cpus > 0 ? (int)cpus : 1) < 0 ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "export") == 0) {
+        return export_snapshots(argc > 2 ? argv[2] : ".");
+    }
+    if (argc > 1 && strcmp(argv[1], "backfill") == 0) {
+        return backfill_history(argc > 2 ? argv[2] : "tables", argc > 3 ? argv[3] : NULL);
+    }
+    if (argc > 1 && strcmp(argv[1], "diff") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "usage: %s diff <old.sql> <new.sql> [dir]\n", argv[0]);
+            return 1;
+        }
+        return diff_dumps(argv[2], argv[3], argc > 4 ? argv[4] : "migrations");
+    }
+
+    DBConfig config = {0};
+    AppContext app_ctx;
     pthread_t git_thread;
     pthread_t mysql_thread;
     ServiceArgs service_args = {
@@ -37,46 +138,107 @@ int main() {
         .ctx = &app_ctx
     };
 
-    if (load_config(&config) != 0) {
+    // SIGINT and SIGTERM are handled by sigwait() below; block them before
+    // any thread starts so that every thread inherits the mask.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    if (app_context_init(&app_ctx) != 0) {
+        return 1;
+    }
+
+    if (load_config(&config) != 0 ||
+        load_targets(&config, &service_args.targets, &service_args.target_count) != 0) {
         printf("Failed to load config\n");
+        free_config(&config);
+        app_context_destroy(&app_ctx);
         return 1;
     }
     
-    printf("DB Host: %s\n", config.host);
-    printf("DB User: %s\n", config.user);
-    printf("DB Port: %d\n", config.port);
+    LoggerConfig log_config = {
+        .path = "logs/app.log",
+        .min_level = log_level_parse(config.log_level, LOG_LEVEL_INFO),
+        .max_bytes = config.log_max_bytes > 0 ? (size_t)config.log_max_bytes : LOG_DEFAULT_MAX_BYTES,
+        .max_files = config.log_max_files > 0 ? config.log_max_files : LOG_DEFAULT_MAX_FILES
+    };
+    logger_start(&log_config);
+
+    MetricsConfig metrics_config = {
+        .port = config.metrics_port,
+        .trace_path = config.trace_file,
+        .trace_max_bytes = config.trace_max_mb > 0 ? (size_t)config.trace_max_mb * 1024 * 1024 : 0
+    };
+    // Watching goes on without the endpoint if the port is taken.
+    metrics_start(&metrics_config);
+
+    if (service_args.target_count > 0) {
+        printf("Targets: %d\n", service_args.target_count);
+    } else {
+        printf("DB Host: %s\n", config.host);
+        printf("DB User: %s\n", config.user);
+        printf("DB Port: %d\n", config.port);
+    }
 
     if (pthread_create(&git_thread, NULL, git_thread_main, &service_args) != 0) {
         fprintf(stderr, "Failed to start git thread\n");
+        metrics_stop();
+        logger_stop();
+        free_targets(service_args.targets, service_args.target_count);
         free_config(&config);
+        app_context_destroy(&app_ctx);
         return 1;
     }
 
-    MYSQL *conn = connect_db(&config);
-    if (!conn) {
-        pthread_mutex_lock(&app_ctx.lock);
-        app_ctx.stop = 1;
-        pthread_cond_broadcast(&app_ctx.cond);
-        pthread_mutex_unlock(&app_ctx.lock);
-        pthread_cancel(git_thread);
+    // Targets on a server that is down are retried by the scheduler instead
+    // of keeping the others from starting.
+    MYSQL *conn = service_args.target_count > 0 ? NULL : connect_db(&config);
+    if (service_args.target_count == 0 && !conn) {
+        app_request_stop(&app_ctx);
         pthread_join(git_thread, NULL);
+        metrics_stop();
+        logger_stop();
+        free_targets(service_args.targets, service_args.target_count);
         free_config(&config);
+        app_context_destroy(&app_ctx);
         return 1;
     }
-    test_connection(conn);
-    close_connection(conn);
+    if (conn) {
+        test_connection(conn);
+        close_connection(conn);
+    }
 
     if (pthread_create(&mysql_thread, NULL, mysql_thread_main, &service_args) != 0) {
         fprintf(stderr, "Failed to start mysql thread\n");
-        pthread_cancel(git_thread);
+        app_request_stop(&app_ctx);
         pthread_join(git_thread, NULL);
+        metrics_stop();
+        logger_stop();
+        free_targets(service_args.targets, service_args.target_count);
         free_config(&config);
+        app_context_destroy(&app_ctx);
         return 1;
     }
 
+    int signo = 0;
+    sigwait(&stop_signals, &signo);
+    printf("Received signal %d, shutting down...\n", signo);
+    app_log(&app_ctx, "Received signal %d, shutting down", signo);
+    app_request_stop(&app_ctx);
+
     pthread_join(git_thread, NULL);
     pthread_join(mysql_thread, NULL);
 
+    LoggerStats log_stats;
+    logger_get_stats(&log_stats);
+    app_log(&app_ctx, "Logger: %lu written, %lu dropped, %lu rotations",
+            log_stats.written, log_stats.dropped, log_stats.rotations);
+    metrics_stop();
+    logger_stop();
+    free_targets(service_args.targets, service_args.target_count);
     free_config(&config);
+    app_context_destroy(&app_ctx);
     return 0;
 }
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "main_snapshot.h"
+#include "file_util.h"
+#include "str_buf.h"
+
+int main_snapshot_init(MainSnapshot *snapshot) {
+    snapshot->changed = 1;
+    snapshot->writes = 0;
+    return hash_map_init(&snapshot->blocks, 256);
+}
+
+int main_snapshot_has(MainSnapshot *snapshot, const char *table) {
+    return hash_map_get(&snapshot->blocks, table) != NULL;
+}
+
+int main_snapshot_set(MainSnapshot *snapshot, const char *branch, const char *table, const char *schema) {
+    StrBuf block = STR_BUF_INIT;
+    if (sb_appendf(&block, "-- branch: %s | table: %s\n%s;\n\n", branch, table, schema) != 0) {
+        sb_free(&block);
+        return -1;
+    }
+
+    char *current = hash_map_get(&snapshot->blocks, table);
+    if (current && strcmp(current, sb_str(&block)) == 0) {
+        sb_free(&block);
+        return 0;
+    }
+    char *rendered = sb_detach(&block);
+    if (!rendered || hash_map_put(&snapshot->blocks, table, rendered) != 0) {
+        free(rendered);
+        return -1;
+    }
+    free(current);
+    snapshot->changed = 1;
+    return 0;
+}
+
+typedef struct {
+    int (*keep)(const char *table, void *arg);
+    void *arg;
+    char **drop;
+    size_t count;
+} RetainState;
+
+static void collect_dropped(const char *key, void *value, void *arg) {
+    (void)value;
+    RetainState *state = arg;
+    if (!state->keep(key, state->arg)) {
+        state->drop[state->count++] = (char *)key;
+    }
+}
+
+void main_snapshot_retain(MainSnapshot *snapshot, int (*keep)(const char *table, void *arg), void *arg) {
+    if (snapshot->blocks.count == 0) {
+        return;
+    }
+    RetainState state = { keep, arg, calloc(snapshot->blocks.count, sizeof(char *)), 0 };
+    if (!state.drop) {
+        return;
+    }
+    hash_map_foreach(&snapshot->blocks, collect_dropped, &state);
+
+    // The keys belong to the map; copy them before removing entries.
+    for (size_t i = 0; i < state.count; i++) {
+        char *table = strdup(state.drop[i]);
+        state.drop[i] = table;
+    }
+    for (size_t i = 0; i < state.count; i++) {
+        if (state.drop[i]) {
+            free(hash_map_remove(&snapshot->blocks, state.drop[i]));
+            free(state.drop[i]);
+            snapshot->changed = 1;
+        }
+    }
+    free(state.drop);
+}
+
+typedef struct {
+    const char **tables;
+    size_t count;
+} TableList;
+
+static void collect_table(const char *key, void *value, void *arg) {
+    (void)value;
+    TableList *list = arg;
+    list->tables[list->count++] = key;
+}
+
+static int compare_tables(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+int main_snapshot_write(MainSnapshot *snapshot, const char *path, const char *header) {
+    if (!snapshot->changed && access(path, F_OK) == 0) {
+        return 0;
+    }
+
+    TableList list = { calloc(snapshot->blocks.count + 1, sizeof(char *)), 0 };
+    if (!list.tables) {
+        return -1;
+    }
+    hash_map_foreach(&snapshot->blocks, collect_table, &list);
+    qsort(list.tables, list.count, sizeof(char *), compare_tables);
+
+    StrBuf out = STR_BUF_INIT;
+    int rc = sb_append(&out, header);
+    for (size_t i = 0; i < list.count && rc == 0; i++) {
+        rc = sb_append(&out, hash_map_get(&snapshot->blocks, list.tables[i]));
+    }
+    free(list.tables);
+    if (rc == 0) {
+        rc = write_file_atomic(path, sb_str(&out), out.len, 1);
+    }
+    sb_free(&out);
+    if (rc != 0) {
+        return -1;
+    }
+    snapshot->changed = 0;
+    snapshot->writes++;
+    return 1;
+}
+
+void main_snapshot_free(MainSnapshot *snapshot) {
+    hash_map_free(&snapshot->blocks, free);
+}
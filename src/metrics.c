@@ -0,0 +1,442 @@
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include "metrics.h"
+#include "logger.h"
+#include "str_buf.h"
+
+#define METRIC_PREFIX "k_git_sql_"
+#define ACCEPT_POLL_MS 500
+#define REQUEST_MAX 1024
+#define TRACE_BUFFER_SIZE (16 * 1024)
+#define TRACE_EVENT_MAX 512
+#define TRACE_DEFAULT_MAX_BYTES (64UL * 1024 * 1024)
+
+// Upper bounds of the duration buckets, in microseconds.
+static const uint64_t g_bucket_us[] = {
+    1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 30000000
+};
+#define BUCKET_COUNT (sizeof(g_bucket_us) / sizeof(g_bucket_us[0]))
+
+static const char *g_phase_names[PHASE_COUNT] = {
+    "cycle", "enumerate", "fetch", "normalize", "diff", "write"
+};
+
+typedef struct {
+    const char *name;
+    const char *help;
+} CounterInfo;
+
+static const CounterInfo g_counter_info[COUNTER_COUNT] = {
+    { "passes_total", "Watch passes that ran." },
+    { "queries_total", "Queries sent to MySQL by the catalog and capture." },
+    { "tables_total", "Tables looked at by passes." },
+    { "changes_total", "Schema changes and branch deltas written." },
+    { "errors_total", "Failed passes and queries." },
+    { "bytes_written_total", "Bytes of schemas, migrations and history written." },
+    { "connects_total", "Connections opened." },
+    { "reconnects_total", "Connections opened again after one was lost." },
+    { "connect_failures_total", "Connection attempts that failed." }
+};
+
+typedef struct {
+    atomic_ulong buckets[BUCKET_COUNT];
+    atomic_ulong count;
+    atomic_ullong sum_us;
+} Histogram;
+
+static Histogram g_phases[PHASE_COUNT];
+static atomic_ulong g_counters[COUNTER_COUNT];
+static atomic_ulong g_git_changed_seq;
+static atomic_ullong g_git_changed_us;
+
+// Git sync state of one watched database. Slots are filled once, under
+// g_target_lock, and never reused; g_target_count publishes them.
+typedef struct {
+    char name[256];
+    atomic_ulong synced_seq;
+    atomic_ullong last_lag_us;
+} TargetSync;
+
+static TargetSync g_targets[METRICS_MAX_TARGETS];
+static atomic_int g_target_count;
+static pthread_mutex_t g_target_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Trace events of one thread, written to the file when the buffer fills,
+// when the thread exits and on metrics_stop().
+typedef struct TraceBuffer {
+    char data[TRACE_BUFFER_SIZE];
+    size_t len;
+    long tid;
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+// Set while the trace file is open and below its size cap.
+static atomic_int g_tracing;
+static pthread_mutex_t g_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *g_trace;
+static size_t g_trace_bytes;
+static size_t g_trace_max_bytes;
+static int g_trace_pid;
+static TraceBuffer *g_trace_buffers;
+static pthread_key_t g_trace_key;
+static pthread_once_t g_trace_once = PTHREAD_ONCE_INIT;
+
+static int g_listen_fd = -1;
+static pthread_t g_server_thread;
+static atomic_int g_serving;
+
+uint64_t metrics_now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+// Called with g_trace_lock held. Past the cap the events are dropped and
+// tracing stops for good, so a long run cannot fill the disk.
+static void flush_trace_locked(TraceBuffer *buffer) {
+    if (g_trace && buffer->len > 0) {
+        if (g_trace_bytes + buffer->len <= g_trace_max_bytes) {
+            fwrite(buffer->data, 1, buffer->len, g_trace);
+            g_trace_bytes += buffer->len;
+        } else if (atomic_exchange(&g_tracing, 0)) {
+            log_message(LOG_LEVEL_WARN, "Metrics: trace file reached %zu MB, tracing stopped",
+                        g_trace_max_bytes / (1024 * 1024));
+        }
+    }
+    buffer->len = 0;
+}
+
+static void release_trace_buffer(void *value) {
+    TraceBuffer *buffer = value;
+    pthread_mutex_lock(&g_trace_lock);
+    flush_trace_locked(buffer);
+    for (TraceBuffer **link = &g_trace_buffers; *link; link = &(*link)->next) {
+        if (*link == buffer) {
+            *link = buffer->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_trace_lock);
+    free(buffer);
+}
+
+static void create_trace_key(void) {
+    pthread_key_create(&g_trace_key, release_trace_buffer);
+}
+
+static TraceBuffer *trace_buffer(void) {
+    pthread_once(&g_trace_once, create_trace_key);
+    TraceBuffer *buffer = pthread_getspecific(g_trace_key);
+    if (!buffer) {
+        buffer = malloc(sizeof(TraceBuffer));
+        if (!buffer) {
+            return NULL;
+        }
+        buffer->len = 0;
+        buffer->tid = (long)syscall(SYS_gettid);
+        pthread_mutex_lock(&g_trace_lock);
+        buffer->next = g_trace_buffers;
+        g_trace_buffers = buffer;
+        pthread_mutex_unlock(&g_trace_lock);
+        pthread_setspecific(g_trace_key, buffer);
+    }
+    return buffer;
+}
+
+static void trace_event(MetricsPhase phase, uint64_t start_us, uint64_t duration_us, const char *target) {
+    if (!atomic_load_explicit(&g_tracing, memory_order_relaxed)) {
+        return;
+    }
+    TraceBuffer *buffer = trace_buffer();
+    if (!buffer) {
+        return;
+    }
+    // Every event starts with the separator; the file opens with a
+    // metadata event so the first one needs no special case.
+    char event[TRACE_EVENT_MAX];
+    int n = snprintf(event, sizeof(event), ",\n{\"name\":\"%s\",\"cat\":\"watch\",\"ph\":\"X\",\"ts\":%llu,"
+                     "\"dur\":%llu,\"pid\":%d,\"tid\":%ld,\"args\":{\"target\":\"%s\"}}",
+                     g_phase_names[phase], (unsigned long long)start_us, (unsigned long long)duration_us,
+                     g_trace_pid, buffer->tid, target && target[0] ? target : "default");
+    if (n < 0 || (size_t)n >= sizeof(event)) {
+        return;
+    }
+    if (buffer->len + (size_t)n > TRACE_BUFFER_SIZE) {
+        pthread_mutex_lock(&g_trace_lock);
+        flush_trace_locked(buffer);
+        pthread_mutex_unlock(&g_trace_lock);
+    }
+    memcpy(buffer->data + buffer->len, event, (size_t)n);
+    buffer->len += (size_t)n;
+}
+
+void metrics_observe(MetricsPhase phase, uint64_t start_us, const char *target) {
+    uint64_t end_us = metrics_now_us();
+    uint64_t duration_us = end_us > start_us ? end_us - start_us : 0;
+    Histogram *h = &g_phases[phase];
+    // Buckets are stored non-cumulative and summed when scraped.
+    size_t bucket = 0;
+    while (bucket < BUCKET_COUNT && duration_us > g_bucket_us[bucket]) {
+        bucket++;
+    }
+    if (bucket < BUCKET_COUNT) {
+        atomic_fetch_add(&h->buckets[bucket], 1);
+    }
+    atomic_fetch_add(&h->count, 1);
+    atomic_fetch_add(&h->sum_us, duration_us);
+    trace_event(phase, start_us, duration_us, target);
+}
+
+void metrics_add(MetricsCounter counter, unsigned long n) {
+    atomic_fetch_add(&g_counters[counter], n);
+}
+
+void metrics_phase_total(MetricsPhase phase, unsigned long *count, uint64_t *sum_us) {
+    *count = atomic_load(&g_phases[phase].count);
+    *sum_us = atomic_load(&g_phases[phase].sum_us);
+}
+
+void metrics_git_changed(unsigned long seq) {
+    // The time goes first, so a scrape never pairs a new seq with an old time.
+    atomic_store(&g_git_changed_us, metrics_now_us());
+    atomic_store(&g_git_changed_seq, seq);
+}
+
+int metrics_register_target(const char *name) {
+    const char *label = name && name[0] ? name : "default";
+    int id = -1;
+    pthread_mutex_lock(&g_target_lock);
+    int count = atomic_load(&g_target_count);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(g_targets[i].name, label) == 0) {
+            id = i;
+        }
+    }
+    if (id < 0 && count < METRICS_MAX_TARGETS) {
+        id = count;
+        snprintf(g_targets[id].name, sizeof(g_targets[id].name), "%s", label);
+        atomic_store(&g_targets[id].synced_seq, 0);
+        atomic_store(&g_targets[id].last_lag_us, 0);
+        atomic_store(&g_target_count, count + 1);
+    }
+    pthread_mutex_unlock(&g_target_lock);
+    return id;
+}
+
+void metrics_git_synced(int target, unsigned long seq) {
+    if (target < 0 || target >= atomic_load(&g_target_count)) {
+        return;
+    }
+    TargetSync *sync = &g_targets[target];
+    unsigned long synced = atomic_load(&sync->synced_seq);
+    while (seq > synced && !atomic_compare_exchange_weak(&sync->synced_seq, &synced, seq)) {
+    }
+    if (seq >= atomic_load(&g_git_changed_seq)) {
+        uint64_t now = metrics_now_us();
+        uint64_t changed = atomic_load(&g_git_changed_us);
+        atomic_store(&sync->last_lag_us, now > changed ? now - changed : 0);
+    }
+}
+
+static void render_metrics(StrBuf *out) {
+    sb_append(out, "# HELP " METRIC_PREFIX "phase_duration_seconds Time spent per watch-cycle phase.\n");
+    sb_append(out, "# TYPE " METRIC_PREFIX "phase_duration_seconds histogram\n");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        Histogram *h = &g_phases[p];
+        unsigned long cumulative = 0;
+        for (size_t b = 0; b < BUCKET_COUNT; b++) {
+            cumulative += atomic_load(&h->buckets[b]);
+            sb_appendf(out, METRIC_PREFIX "phase_duration_seconds_bucket{phase=\"%s\",le=\"%g\"} %lu\n",
+                       g_phase_names[p], (double)g_bucket_us[b] / 1e6, cumulative);
+        }
+        unsigned long count = atomic_load(&h->count);
+        sb_appendf(out, METRIC_PREFIX "phase_duration_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %lu\n",
+                   g_phase_names[p], count);
+        sb_appendf(out, METRIC_PREFIX "phase_duration_seconds_sum{phase=\"%s\"} %.6f\n",
+                   g_phase_names[p], (double)atomic_load(&h->sum_us) / 1e6);
+        sb_appendf(out, METRIC_PREFIX "phase_duration_seconds_count{phase=\"%s\"} %lu\n",
+                   g_phase_names[p], count);
+    }
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        sb_appendf(out, "# HELP " METRIC_PREFIX "%s %s\n", g_counter_info[c].name, g_counter_info[c].help);
+        sb_appendf(out, "# TYPE " METRIC_PREFIX "%s counter\n", g_counter_info[c].name);
+        sb_appendf(out, METRIC_PREFIX "%s %lu\n", g_counter_info[c].name, atomic_load(&g_counters[c]));
+    }
+
+    // Every target is behind on its own; max() over the series gives the
+    // lag of the whole process.
+    unsigned long changed = atomic_load(&g_git_changed_seq);
+    uint64_t now = metrics_now_us();
+    uint64_t since = atomic_load(&g_git_changed_us);
+    int targets = atomic_load(&g_target_count);
+    sb_append(out, "# HELP " METRIC_PREFIX "git_lag_seconds How long the last git change has waited for a "
+                   "full pass of the target; 0 once one ran.\n");
+    sb_append(out, "# TYPE " METRIC_PREFIX "git_lag_seconds gauge\n");
+    for (int i = 0; i < targets; i++) {
+        uint64_t behind_us = 0;
+        if (changed > atomic_load(&g_targets[i].synced_seq)) {
+            behind_us = now > since ? now - since : 0;
+        }
+        sb_appendf(out, METRIC_PREFIX "git_lag_seconds{target=\"%s\"} %.3f\n", g_targets[i].name,
+                   (double)behind_us / 1e6);
+    }
+    sb_append(out, "# HELP " METRIC_PREFIX "git_sync_seconds Time from the last synced git change to the end "
+                   "of the target's pass.\n");
+    sb_append(out, "# TYPE " METRIC_PREFIX "git_sync_seconds gauge\n");
+    for (int i = 0; i < targets; i++) {
+        sb_appendf(out, METRIC_PREFIX "git_sync_seconds{target=\"%s\"} %.3f\n", g_targets[i].name,
+                   (double)atomic_load(&g_targets[i].last_lag_us) / 1e6);
+    }
+    sb_append(out, "# HELP " METRIC_PREFIX "git_changes_total Branch switches and commits seen.\n");
+    sb_append(out, "# TYPE " METRIC_PREFIX "git_changes_total counter\n");
+    sb_appendf(out, METRIC_PREFIX "git_changes_total %lu\n", changed);
+}
+
+static void write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+static void serve_client(int fd) {
+    char request[REQUEST_MAX];
+    ssize_t n = read(fd, request, sizeof(request) - 1);
+    if (n <= 0) {
+        return;
+    }
+    request[n] = '\0';
+
+    StrBuf body;
+    StrBuf head;
+    sb_init(&body);
+    sb_init(&head);
+    if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0) {
+        render_metrics(&body);
+        sb_appendf(&head, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                   "Content-Length: %zu\r\nConnection: close\r\n\r\n", body.len);
+    } else {
+        sb_append(&body, "not found\n");
+        sb_appendf(&head, "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n"
+                   "Content-Length: %zu\r\nConnection: close\r\n\r\n", body.len);
+    }
+    write_all(fd, sb_str(&head), head.len);
+    write_all(fd, sb_str(&body), body.len);
+    sb_free(&head);
+    sb_free(&body);
+}
+
+// One request at a time is plenty for a scraper on the same host.
+static void *server_main(void *arg) {
+    (void)arg;
+    struct pollfd pfd = { .fd = g_listen_fd, .events = POLLIN };
+    while (atomic_load(&g_serving)) {
+        if (poll(&pfd, 1, ACCEPT_POLL_MS) <= 0) {
+            continue;
+        }
+        int client = accept(g_listen_fd, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        struct timeval timeout = { 2, 0 };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        serve_client(client);
+        close(client);
+    }
+    return NULL;
+}
+
+static int start_server(int port) {
+    g_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (g_listen_fd < 0) {
+        perror("metrics socket");
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(g_listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(g_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(g_listen_fd, 8) != 0) {
+        perror("metrics bind");
+        close(g_listen_fd);
+        g_listen_fd = -1;
+        return -1;
+    }
+    atomic_store(&g_serving, 1);
+    if (pthread_create(&g_server_thread, NULL, server_main, NULL) != 0) {
+        atomic_store(&g_serving, 0);
+        close(g_listen_fd);
+        g_listen_fd = -1;
+        return -1;
+    }
+    log_message(LOG_LEVEL_INFO, "Metrics: serving http://127.0.0.1:%d/metrics", port);
+    return 0;
+}
+
+int metrics_start(const MetricsConfig *config) {
+    int result = 0;
+    if (config->trace_path) {
+        pthread_mutex_lock(&g_trace_lock);
+        g_trace = fopen(config->trace_path, "w");
+        if (g_trace) {
+            // JSON array format; the closing bracket is written on stop, and
+            // the viewers also load a file cut short by a crash.
+            fprintf(g_trace, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"k_git_sql\"}}",
+                    (int)getpid());
+            g_trace_pid = (int)getpid();
+            g_trace_bytes = 0;
+            g_trace_max_bytes = config->trace_max_bytes > 0 ? config->trace_max_bytes : TRACE_DEFAULT_MAX_BYTES;
+            atomic_store(&g_tracing, 1);
+        } else {
+            perror("Failed to open trace file");
+            result = -1;
+        }
+        pthread_mutex_unlock(&g_trace_lock);
+    }
+    if (config->port > 0 && start_server(config->port) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+void metrics_stop(void) {
+    if (atomic_load(&g_serving)) {
+        atomic_store(&g_serving, 0);
+        pthread_join(g_server_thread, NULL);
+        close(g_listen_fd);
+        g_listen_fd = -1;
+    }
+    pthread_mutex_lock(&g_trace_lock);
+    if (g_trace) {
+        for (TraceBuffer *buffer = g_trace_buffers; buffer; buffer = buffer->next) {
+            flush_trace_locked(buffer);
+        }
+        atomic_store(&g_tracing, 0);
+        fputs("\n]\n", g_trace);
+        fclose(g_trace);
+        g_trace = NULL;
+    }
+    pthread_mutex_unlock(&g_trace_lock);
+}
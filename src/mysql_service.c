@@ -2,77 +2,133 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <limits.h>
 #include <mysql/mysql.h>
 #include <time.h>
-#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <pthread.h>
 #include "mysql_service.h"
+#include "schema_catalog.h"
+#include "db_connection.h"
+#include "schema_cache.h"
+#include "emitted_registry.h"
+#include "schema_diff.h"
+#include "str_buf.h"
+#include "worker_pool.h"
+#include "async_query.h"
+#include "binlog_watcher.h"
+#include "logger.h"
+#include "poll_scheduler.h"
+#include "main_snapshot.h"
+#include "snapshot_store.h"
+#include "schema_blob.h"
+#include "git_snapshot.h"
+#include "metrics.h"
+#include "file_util.h"
 
 #define MAX_LINE_LENGTH 1024
-#define MAX_QUERY_LENGTH 2048
 #define NAME_SIZE 256
-
-typedef struct EmittedChange {
-    char branch[NAME_SIZE];
-    char table[NAME_SIZE];
-    char *schema;
-    struct EmittedChange *next;
-} EmittedChange;
-
-static EmittedChange *g_emitted_changes = NULL;
-
-static int has_emitted_change(const char *branch, const char *table, const char *schema) {
-    EmittedChange *node = g_emitted_changes;
-    while (node) {
-        if (strcmp(node->branch, branch) == 0 &&
-            strcmp(node->table, table) == 0 &&
-            strcmp(node->schema, schema) == 0) {
-            return 1;
-        }
-        node = node->next;
-    }
-    return 0;
-}
-
-static void set_emitted_change(const char *branch, const char *table, const char *schema) {
-    EmittedChange *node = g_emitted_changes;
-    while (node) {
-        if (strcmp(node->branch, branch) == 0 &&
-            strcmp(node->table, table) == 0) {
-            free(node->schema);
-            node->schema = strdup(schema);
-            return;
-        }
-        node = node->next;
-    }
-
-    EmittedChange *new_node = malloc(sizeof(EmittedChange));
-    if (!new_node) {
-        return;
-    }
-    snprintf(new_node->branch, sizeof(new_node->branch), "%s", branch);
-    snprintf(new_node->table, sizeof(new_node->table), "%s", table);
-    new_node->schema = strdup(schema);
-    new_node->next = g_emitted_changes;
-    g_emitted_changes = new_node;
-}
-
-static void clear_emitted_change(const char *branch, const char *table) {
-    EmittedChange **cursor = &g_emitted_changes;
-    while (*cursor) {
-        EmittedChange *node = *cursor;
-        if (strcmp(node->branch, branch) == 0 &&
-            strcmp(node->table, table) == 0) {
-            *cursor = node->next;
-            free(node->schema);
-            free(node);
-            return;
-        }
-        cursor = &((*cursor)->next);
-    }
-}
+#define POLL_INTERVAL_MS 5000
+#define DEFAULT_WORKERS 4
+#define MAX_WORKERS 64
+#define BINLOG_POLL_MS 500
+#define POLL_CYCLE_MS 1000
+#define DISCOVER_MS 10000
+#define DEFAULT_POLL_HOT_MS 2000
+#define DEFAULT_POLL_COLD_MS 300000
+#define DEFAULT_POLL_BUDGET 100
+#define DEFAULT_CAPTURE_MEMORY_MB 256
+#define DEFAULT_CATALOG_PAGE_SIZE 1000
+// Floor for the per-table cost used to size capture windows, so a window of
+// small tables does not grow without bound.
+#define CAPTURE_MIN_TABLE_BYTES 4096
+
+typedef enum {
+    DELTA_NONE,
+    DELTA_EMIT,
+    DELTA_CLEAR
+} DeltaAction;
+
+// One table in a pass. The capture workers fill in everything after
+// needs_check; the watcher thread then writes the results in catalog order,
+// so the files on disk do not depend on which worker finished first.
+typedef struct {
+    CatalogTable *entry;
+    int needs_check;
+    SchemaBlob *blob;
+    const char *normalized;
+    int table_changed;
+    int had_snapshot;
+    StrBuf history_up;
+    StrBuf history_down;
+    DeltaAction delta;
+    uint64_t digest;
+    StrBuf delta_up;
+    StrBuf delta_down;
+} TableCapture;
+
+// A table picked for the pass, waiting for its capture window.
+typedef struct {
+    CatalogTable *entry;
+    int needs_check;
+} PendingTable;
+
+typedef struct {
+    WatchTarget *target;
+    TableCapture *jobs;
+    AppContext *ctx;
+    unsigned long generation;
+    const char *branch_key;
+    int is_main_branch;
+} CapturePass;
+
+// One watched database and everything kept about it between passes. A plain
+// .env watches a single unnamed target rooted at the working directory;
+// every [name] section of a multi-target .env is one more of these.
+struct WatchTarget {
+    char name[NAME_SIZE];
+    // "[name] " in front of log lines, empty for the single target.
+    char label[NAME_SIZE + 4];
+    DBConfig *config;
+    AppContext *ctx;
+    // Prefix of every output path, "" for the working directory.
+    char root[512];
+    char *emitted_state_path;
+    char *snapshot_pack;
+    EmittedRegistry emitted;
+    SchemaCatalog catalog;
+    MainSnapshot main_snapshot;
+    char last_branch_key[NAME_SIZE];
+    SchemaCache schema_cache;
+    int state_ready;
+    SnapshotStore store;
+    int store_open;
+    GitSnapshot git;
+    int git_open;
+    // Set by watch_target_set_source(); NULL reads MySQL on the connection
+    // each pass or worker was given.
+    SchemaSource *source;
+    WorkerPool pool;
+    AsyncQueryPool async;
+    int async_open;
+    TableCapture *jobs;
+    int jobs_capacity;
+    PendingTable *pending;
+    int pending_capacity;
+    // Poll state carried from one watch_target_poll() to the next.
+    PollScheduler scheduler;
+    unsigned long seen;
+    uint64_t listed_ms;
+    int full;
+    // Id of the target in the git lag gauges, -1 when not tracked.
+    int metrics_id;
+};
+
+static long g_peak_rss_kb = 0;
+static pthread_mutex_t g_peak_rss_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static int should_stop(AppContext *ctx) {
     int stop = 0;
@@ -85,91 +141,17 @@ static int should_stop(AppContext *ctx) {
     return stop;
 }
 
-// Helper functions (static to this file)
-static void create_directory(const char *path) {
-    struct stat st = {0};
-    if (stat(path, &st) == -1) {
-        mkdir(path, 0700);
-    }
-}
-
-static void trim_line(char *str) {
-    if (!str) return;
-    
-    // Trim leading whitespace
-    char *start = str;
-    while(isspace((unsigned char)*start)) start++;
-    if(start != str) {
-        memmove(str, start, strlen(start) + 1);
+// Formats a path under the output root of the target.
+static void target_path(const WatchTarget *t, char *out, size_t size, const char *fmt, ...) {
+    va_list args;
+    size_t used = 0;
+    if (t->root[0]) {
+        snprintf(out, size, "%s/", t->root);
+        used = strlen(out);
     }
-
-    // Trim trailing whitespace and commas
-    if (strlen(str) == 0) return;
-    char *end = str + strlen(str) - 1;
-    while(end >= str && (isspace((unsigned char)*end) || *end == ',')) end--;
-    *(end+1) = '\0';
-}
-
-static char* get_column_name(const char *line) {
-    const char *start = strchr(line, '`');
-    if (!start) return NULL;
-    start++; // skip first backtick
-    const char *end = strchr(start, '`');
-    if (!end) return NULL;
-    
-    int len = end - start;
-    char *name = malloc(len + 1);
-    strncpy(name, start, len);
-    name[len] = '\0';
-    return name;
-}
-
-static char** split_lines(const char *str, int *count) {
-    if (!str) { *count = 0; return NULL; }
-    
-    char *s = strdup(str);
-    int capacity = 10;
-    char **lines = malloc(capacity * sizeof(char*));
-    *count = 0;
-
-    char *token = strtok(s, "\n");
-    while (token) {
-        if (*count >= capacity) {
-            capacity *= 2;
-            lines = realloc(lines, capacity * sizeof(char*));
-        }
-        lines[(*count)++] = strdup(token);
-        token = strtok(NULL, "\n");
-    }
-    free(s);
-    return lines;
-}
-
-static void free_lines(char **lines, int count) {
-    for (int i = 0; i < count; i++) free(lines[i]);
-    free(lines);
-}
-
-static char* get_table_schema(MYSQL *conn, const char *table_name) {
-    char query[MAX_QUERY_LENGTH];
-    snprintf(query, sizeof(query), "SHOW CREATE TABLE %s", table_name);
-
-    if (mysql_query(conn, query)) {
-        fprintf(stderr, "Failed to get schema for table %s: %s\n", table_name, mysql_error(conn));
-        return NULL;
-    }
-
-    MYSQL_RES *result = mysql_store_result(conn);
-    if (!result) return NULL;
-
-    MYSQL_ROW row = mysql_fetch_row(result);
-    char *schema = NULL;
-    if (row && row[1]) {
-        schema = strdup(row[1]);
-    }
-
-    mysql_free_result(result);
-    return schema;
+    va_start(args, fmt);
+    vsnprintf(out + used, size - used, fmt, args);
+    va_end(args);
 }
 
 static void save_sql_file(const char *path, const char *content) {
@@ -177,12 +159,13 @@ static void save_sql_file(const char *path, const char *content) {
     if (fp) {
         fprintf(fp, "%s", content);
         fclose(fp);
+        metrics_add(COUNTER_BYTES_WRITTEN, strlen(content));
     } else {
         perror("Failed to write SQL file");
     }
 }
 
-static char *normalize_schema(const char *schema) {
+char *normalize_schema(const char *schema) {
     if (!schema) {
         return NULL;
     }
@@ -230,241 +213,319 @@ static void sanitize_name(const char *in, char *out, size_t out_size) {
     out[i] = '\0';
 }
 
-static void write_table_block(FILE *fp, const char *branch, const char *table_name, const char *schema) {
-    if (!fp) {
-        return;
-    }
-    fprintf(fp, "-- branch: %s | table: %s\n", branch, table_name);
-    fprintf(fp, "%s;\n\n", schema);
-}
-
-static char *read_file_content(const char *path) {
-    FILE *fp = fopen(path, "r");
-    if (!fp) {
-        return NULL;
-    }
-
-    if (fseek(fp, 0, SEEK_END) != 0) {
-        fclose(fp);
-        return NULL;
+// Snapshots are read and written through these two, so the per-table file
+// layout and the pack store (SNAPSHOT_PACK) are interchangeable. scope is
+// SNAPSHOT_SCOPE_LIVE for tables/<t>/schema.sql and the branch for
+// dbtables/<branch>/schemas/<t>.sql. Snapshots come back as interned blobs,
+// so an unchanged table is the same pointer as its freshly captured schema;
+// release the result with schema_blob_release().
+static SchemaBlob *load_snapshot(WatchTarget *t, const char *scope, const char *table, const char *path) {
+    if (!t->store_open) {
+        return schema_cache_get_blob(&t->schema_cache, path);
     }
-    long len = ftell(fp);
-    if (len < 0) {
-        fclose(fp);
+    // The pack store records the content hash, so a schema that is already
+    // held in memory is found by comparing bytes, without hashing them again.
+    uint64_t hash;
+    if (!snapshot_store_get_hash(&t->store, SNAPSHOT_SCHEMA, scope, table, &hash)) {
         return NULL;
     }
-    if (fseek(fp, 0, SEEK_SET) != 0) {
-        fclose(fp);
+    const char *data = snapshot_store_get(&t->store, SNAPSHOT_SCHEMA, scope, table);
+    if (!data) {
         return NULL;
     }
-
-    char *buf = malloc((size_t)len + 1);
-    if (!buf) {
-        fclose(fp);
-        return NULL;
+    size_t len = strlen(data);
+    SchemaBlob *blob = schema_blob_find(hash, data, len);
+    if (blob) {
+        return blob;
     }
+    return schema_blob_intern_len(data, len);
+}
 
-    size_t n = fread(buf, 1, (size_t)len, fp);
-    fclose(fp);
-    if (n != (size_t)len) {
-        free(buf);
-        return NULL;
+static void store_snapshot(WatchTarget *t, const char *scope, const char *table, const char *path, SchemaBlob *blob) {
+    if (t->store_open) {
+        snapshot_store_put(&t->store, SNAPSHOT_SCHEMA, scope, table, NULL, blob->data);
+    } else {
+        schema_cache_put_blob(&t->schema_cache, path, blob);
     }
-    buf[len] = '\0';
-    return buf;
 }
 
-static void generate_alter_statements(const char *table_name, const char *old_schema, const char *new_schema, char *up_sql, char *down_sql) {
-    int old_count = 0, new_count = 0;
-    char **old_lines = split_lines(old_schema, &old_count);
-    char **new_lines = split_lines(new_schema, &new_count);
-
-    up_sql[0] = '\0';
-    down_sql[0] = '\0';
-
-    // Find added lines (in new but not old) -> UP: ADD, DOWN: DROP
-    for (int i = 0; i < new_count; i++) {
-        char *n_line = strdup(new_lines[i]);
-        trim_line(n_line);
-        
-        // Skip table definition header/footer
-        if (strncmp(n_line, "CREATE TABLE", 12) == 0 || strncmp(n_line, ") ENGINE", 8) == 0 || strncmp(n_line, "PRIMARY KEY", 11) == 0 || strncmp(n_line, "KEY", 3) == 0 || strncmp(n_line, "CONSTRAINT", 10) == 0) {
-            free(n_line);
-            continue;
-        }
-
-        int found = 0;
-        for (int j = 0; j < old_count; j++) {
-            char *o_line = strdup(old_lines[j]);
-            trim_line(o_line);
-            if (strcmp(n_line, o_line) == 0) {
-                found = 1;
-            }
-            free(o_line);
-            if (found) break;
-        }
-
-        if (!found) {
-            char *col_name = get_column_name(n_line);
-            if (col_name) {
-                // Simple ADD logic
-                char stmt[MAX_LINE_LENGTH];
-                snprintf(stmt, sizeof(stmt), "ALTER TABLE `%s` ADD %s;\n", table_name, n_line);
-                strcat(up_sql, stmt);
-
-                snprintf(stmt, sizeof(stmt), "ALTER TABLE `%s` DROP COLUMN `%s`;\n", table_name, col_name);
-                strcat(down_sql, stmt);
-                free(col_name);
-            }
+static void write_migrations(WatchTarget *t, const char *start_path, const char *table_name, const TableCapture *job) {
+    const char *up = job->normalized;
+    const char *down = "-- Table did not exist previously\nDROP TABLE IF EXISTS table_name;\n";
+    if (job->had_snapshot) {
+        // Only save if meaningful changes detected (string is not empty)
+        if (job->history_up.len == 0 && job->history_down.len == 0) {
+            return;
         }
-        free(n_line);
+        up = sb_str(&job->history_up);
+        down = sb_str(&job->history_down);
     }
 
-    // Find removed lines (in old but not new) -> UP: DROP, DOWN: ADD
-    for (int i = 0; i < old_count; i++) {
-        char *o_line = strdup(old_lines[i]);
-        trim_line(o_line);
-
-        if (strncmp(o_line, "CREATE TABLE", 12) == 0 || strncmp(o_line, ") ENGINE", 8) == 0 || strncmp(o_line, "PRIMARY KEY", 11) == 0 || strncmp(o_line, "KEY", 3) == 0 || strncmp(o_line, "CONSTRAINT", 10) == 0) {
-            free(o_line);
-            continue;
-        }
-
-        int found = 0;
-        for (int j = 0; j < new_count; j++) {
-            char *n_line = strdup(new_lines[j]);
-            trim_line(n_line);
-            if (strcmp(o_line, n_line) == 0) {
-                found = 1;
-            }
-            free(n_line);
-            if (found) break;
-        }
-
-        if (!found) {
-            char *col_name = get_column_name(o_line);
-            if (col_name) {
-                char stmt[MAX_LINE_LENGTH];
-                snprintf(stmt, sizeof(stmt), "ALTER TABLE `%s` DROP COLUMN `%s`;\n", table_name, col_name);
-                strcat(up_sql, stmt);
+    time_t now = time(NULL);
+    struct tm tm_now;
+    char timestamp[64];
+    localtime_r(&now, &tm_now);
+    strftime(timestamp, sizeof(timestamp), "%Y%m%d%H%M%S", &tm_now);
 
-                snprintf(stmt, sizeof(stmt), "ALTER TABLE `%s` ADD %s;\n", table_name, o_line);
-                strcat(down_sql, stmt);
-                free(col_name);
-            }
-        }
-        free(o_line);
+    if (t->store_open) {
+        snapshot_store_put(&t->store, SNAPSHOT_MIGRATION_UP, SNAPSHOT_SCOPE_LIVE, table_name, timestamp, up);
+        snapshot_store_put(&t->store, SNAPSHOT_MIGRATION_DOWN, SNAPSHOT_SCOPE_LIVE, table_name, timestamp, down);
+        return;
     }
 
-    free_lines(old_lines, old_count);
-    free_lines(new_lines, new_count);
-}
-
-static void generate_migrations(const char *start_path, const char *table_name, const char *old_schema, const char *new_schema) {
     char migrations_dir[512];
     snprintf(migrations_dir, sizeof(migrations_dir), "%s/migrations", start_path);
-    create_directory(migrations_dir);
-
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    char timestamp[64];
-    strftime(timestamp, sizeof(timestamp), "%Y%m%d%H%M%S", t);
+    create_directories(migrations_dir);
 
     char up_path[512];
     char down_path[512];
     snprintf(up_path, sizeof(up_path), "%s/%s_%s_up.sql", migrations_dir, timestamp, table_name);
     snprintf(down_path, sizeof(down_path), "%s/%s_%s_down.sql", migrations_dir, timestamp, table_name);
+    save_sql_file(up_path, up);
+    save_sql_file(down_path, down);
+}
 
-    if (old_schema) {
-        // Generate ALTER statements
-        char up_sql[4096];
-        char down_sql[4096];
-        generate_alter_statements(table_name, old_schema, new_schema, up_sql, down_sql);
-        
-        // Only save if meaningful changes detected (string is not empty)
-        if (strlen(up_sql) > 0 || strlen(down_sql) > 0) {
-             save_sql_file(up_path, up_sql);
-             save_sql_file(down_path, down_sql);
-        } else {
-             // Fallback if we detected a change via strcmp but failed to parse diff (e.g. comment/format change only condition?)
-             // Or maybe we should just not save if empty.
-             // If we are here, save_schema_and_check_diff said strings were different.
-             // If up_sql is empty, maybe it was a trivial change we ignored (like ENGINE change line diff?).
-             // Let's safe-guard by generating full replacement if ALTER failed?
-             // Or just log it.
+// Loads the snapshot files and emitted-delta state of the previous run once,
+// so that the watch loop compares against memory instead of re-reading files
+// every pass.
+static void ensure_watch_state(WatchTarget *t) {
+    DBConfig *config = t->config;
+    char path[512];
+    if (t->state_ready) {
+        return;
+    }
+    t->catalog.page_size = config->catalog_page_size;
+    if (schema_cache_init(&t->schema_cache) != 0 ||
+        main_snapshot_init(&t->main_snapshot) != 0 ||
+        emitted_registry_init(&t->emitted, t->emitted_state_path) != 0) {
+        return;
+    }
+    if (t->snapshot_pack) {
+        target_path(t, path, sizeof(path), "dbtables");
+        create_directories(path);
+        t->store_open = snapshot_store_open(&t->store, t->snapshot_pack, 0) == 0;
+        if (!t->store_open) {
+            fprintf(stderr, "Falling back to per-table snapshot files\n");
         }
-    } else {
-        // Initial creation
-        save_sql_file(up_path, new_schema);
-        save_sql_file(down_path, "-- Table did not exist previously\nDROP TABLE IF EXISTS table_name;\n");
     }
+    if (config->git_snapshots) {
+        t->git_open = git_snapshot_open(&t->git) == 0;
+        if (!t->git_open) {
+            fprintf(stderr, "Schema commits under refs/schema/ are disabled\n");
+        }
+    }
+    if (!t->store_open) {
+        target_path(t, path, sizeof(path), "tables");
+        schema_cache_preload(&t->schema_cache, path, "schema.sql");
+        target_path(t, path, sizeof(path), "dbtables/main/schemas");
+        schema_cache_preload(&t->schema_cache, path, NULL);
+    }
+    t->state_ready = 1;
 }
 
-static void save_schema_and_check_diff(const char *table_dir, const char *table_name, const char *schema) {
+static void save_schema_and_log_history(WatchTarget *t, const char *table_dir, const char *table_name, const TableCapture *job) {
     char schema_path[512];
     char history_path[512];
     snprintf(schema_path, sizeof(schema_path), "%s/schema.sql", table_dir);
     snprintf(history_path, sizeof(history_path), "%s/history.txt", table_dir);
 
-    // Read existing schema
-    char *existing_schema = NULL;
-    FILE *fp = fopen(schema_path, "r");
+    printf("%sChange detected in table: %s\n", t->label, table_name);
+    if (!t->store_open) {
+        create_directories(table_dir);
+    }
+
+    // Generate migrations
+    write_migrations(t, table_dir, table_name, job);
+
+    // Save new schema
+    store_snapshot(t, SNAPSHOT_SCOPE_LIVE, table_name, schema_path, job->blob);
+
+    // Log to history
+    // Targets run on several threads, so not ctime() and its shared buffer.
+    time_t now = time(NULL);
+    struct tm tm_now;
+    char timestamp[64];
+    localtime_r(&now, &tm_now);
+    strftime(timestamp, sizeof(timestamp), "%a %b %e %H:%M:%S %Y", &tm_now);
+
+    StrBuf *note = sb_scratch(0);
+    sb_appendf(note, "[%s] Schema changed\n", timestamp);
+    if (job->had_snapshot) {
+        sb_append(note, "Previous schema was different. Generated ALTER statements.\n");
+    } else {
+        sb_append(note, "Initial schema saved.\n");
+    }
+    sb_append(note, "----------------------------------------\n");
+
+    if (t->store_open) {
+        snapshot_store_put(&t->store, SNAPSHOT_HISTORY, SNAPSHOT_SCOPE_LIVE, table_name, timestamp, sb_str(note));
+        return;
+    }
+    FILE *fp = fopen(history_path, "a");
     if (fp) {
-        fseek(fp, 0, SEEK_END);
-        long length = ftell(fp);
-        fseek(fp, 0, SEEK_SET);
-        if (length > 0) {
-            existing_schema = malloc(length + 1);
-            if (fread(existing_schema, 1, length, fp) == (size_t)length) {
-                existing_schema[length] = '\0';
-            } else {
-                free(existing_schema);
-                existing_schema = NULL;
-            }
-        }
+        fputs(sb_str(note), fp);
         fclose(fp);
+        metrics_add(COUNTER_BYTES_WRITTEN, note->len);
     }
+}
 
-    char *existing_normalized = normalize_schema(existing_schema);
-    char *schema_normalized = normalize_schema(schema);
+static void replace_string(char **field, const char *value) {
+    free(*field);
+    *field = strdup(value);
+}
 
-    // Compare and save if different
-    if (!existing_normalized || !schema_normalized ||
-        strcmp(existing_normalized, schema_normalized) != 0) {
-        printf("Change detected in table: %s\n", table_name);
+static void apply_config_key(DBConfig *config, const char *key, const char *value) {
+    if (strcmp(key, "DB_HOST") == 0) replace_string(&config->host, value);
+    else if (strcmp(key, "DB_USER") == 0) replace_string(&config->user, value);
+    else if (strcmp(key, "DB_PASS") == 0) replace_string(&config->pass, value);
+    else if (strcmp(key, "DB_NAME") == 0) replace_string(&config->name, value);
+    else if (strcmp(key, "DB_PORT") == 0) config->port = atoi(value);
+    else if (strcmp(key, "EMITTED_STATE_FILE") == 0) replace_string(&config->emitted_state_path, value);
+    else if (strcmp(key, "DB_WORKERS") == 0) config->workers = atoi(value);
+    else if (strcmp(key, "LOG_LEVEL") == 0) replace_string(&config->log_level, value);
+    else if (strcmp(key, "LOG_MAX_BYTES") == 0) config->log_max_bytes = atol(value);
+    else if (strcmp(key, "LOG_MAX_FILES") == 0) config->log_max_files = atoi(value);
+    else if (strcmp(key, "CAPTURE_ENGINE") == 0) config->capture_engine = strcmp(value, "async") == 0 ? CAPTURE_ENGINE_ASYNC : CAPTURE_ENGINE_THREADS;
+    else if (strcmp(key, "CAPTURE_MODE") == 0) config->capture_mode = strcmp(value, "binlog") == 0 ? CAPTURE_BINLOG : CAPTURE_POLL;
+    else if (strcmp(key, "BINLOG_INDEX") == 0 && value[0]) replace_string(&config->binlog_index, value);
+    else if (strcmp(key, "SNAPSHOT_PACK") == 0 && value[0]) replace_string(&config->snapshot_pack, value);
+    else if (strcmp(key, "GIT_SNAPSHOTS") == 0) config->git_snapshots = atoi(value);
+    else if (strcmp(key, "CAPTURE_MEMORY_MB") == 0) config->capture_memory_mb = atoi(value);
+    else if (strcmp(key, "CATALOG_PAGE_SIZE") == 0) config->catalog_page_size = atoi(value);
+    else if (strcmp(key, "POLL_HOT_MS") == 0) config->poll_hot_ms = (unsigned int)strtoul(value, NULL, 10);
+    else if (strcmp(key, "POLL_COLD_MS") == 0) config->poll_cold_ms = (unsigned int)strtoul(value, NULL, 10);
+    else if (strcmp(key, "POLL_BUDGET") == 0) config->poll_budget = atoi(value);
+    else if (strcmp(key, "OUTPUT_ROOT") == 0 && value[0]) replace_string(&config->output_root, value);
+    else if (strcmp(key, "WATCH_THREADS") == 0) config->watch_threads = atoi(value);
+    else if (strcmp(key, "SERVER_MAX_CONNECTIONS") == 0) config->server_connections = atoi(value);
+    else if (strcmp(key, "METRICS_PORT") == 0) config->metrics_port = atoi(value);
+    else if (strcmp(key, "TRACE_FILE") == 0 && value[0]) replace_string(&config->trace_file, value);
+    else if (strcmp(key, "TRACE_MAX_MB") == 0) config->trace_max_mb = atoi(value);
+    else if (strcmp(key, "BINLOG_SERVER_ID") == 0) config->binlog_server_id = (unsigned int)strtoul(value, NULL, 10);
+}
 
-        // Generate migrations
-        generate_migrations(table_dir, table_name, existing_normalized, schema_normalized);
+static void finish_config(DBConfig *config) {
+    if (config->workers <= 0) {
+        config->workers = DEFAULT_WORKERS;
+    } else if (config->workers > MAX_WORKERS) {
+        config->workers = MAX_WORKERS;
+    }
+    if (config->poll_hot_ms == 0) {
+        config->poll_hot_ms = DEFAULT_POLL_HOT_MS;
+    }
+    if (config->poll_cold_ms == 0) {
+        config->poll_cold_ms = DEFAULT_POLL_COLD_MS;
+    }
+    if (config->poll_cold_ms < config->poll_hot_ms) {
+        config->poll_cold_ms = config->poll_hot_ms;
+    }
+    if (config->poll_budget <= 0) {
+        config->poll_budget = DEFAULT_POLL_BUDGET;
+    }
+    if (config->capture_memory_mb <= 0) {
+        config->capture_memory_mb = DEFAULT_CAPTURE_MEMORY_MB;
+    }
+    // A negative page size turns paging off; 0 means the default.
+    if (config->catalog_page_size == 0) {
+        config->catalog_page_size = DEFAULT_CATALOG_PAGE_SIZE;
+    } else if (config->catalog_page_size < 0) {
+        config->catalog_page_size = 0;
+    }
+    if (config->binlog_server_id == 0) {
+        // Must differ from every replica of the server; derive one from the
+        // pid so two watchers on the same host do not kick each other off.
+        config->binlog_server_id = 0x4B470000u | ((unsigned int)getpid() & 0xFFFF);
+    }
+}
 
-        // Save new schema
-        if (schema_normalized) {
-            save_sql_file(schema_path, schema_normalized);
+// Splits a .env line into key and value, or into a section name when the
+// line is "[name]". Returns 1 for a key, 2 for a section and 0 otherwise.
+static int parse_config_line(char *line, char **key, char **value) {
+    line[strcspn(line, "\r\n")] = 0;
+    if (line[0] == '[') {
+        char *end = strchr(line, ']');
+        if (!end) {
+            return 0;
         }
+        *end = 0;
+        *key = line + 1;
+        return 2;
+    }
+    char *delimiter = strchr(line, '=');
+    if (!delimiter) {
+        return 0;
+    }
+    *delimiter = 0;
+    *key = line;
+    *value = delimiter + 1;
+    return 1;
+}
 
-        // Log to history
-        fp = fopen(history_path, "a");
-        if (fp) {
-            time_t now = time(NULL);
-            char *timestamp = ctime(&now);
-            timestamp[strcspn(timestamp, "\n")] = 0; // Remove newline
-            
-            fprintf(fp, "[%s] Schema changed\n", timestamp);
-            if (existing_normalized) {
-                fprintf(fp, "Previous schema was different. Generated ALTER statements.\n");
-            } else {
-                fprintf(fp, "Initial schema saved.\n");
-            }
-            fprintf(fp, "----------------------------------------\n");
-            fclose(fp);
+// Keys above the first [section] of .env; the sections are read by
+// load_targets().
+int load_config(DBConfig *config) {
+    FILE *file = fopen(".env", "r");
+    if (!file) {
+        perror("Failed to open .env file");
+        return -1;
+    }
+
+    char line[MAX_LINE_LENGTH];
+    char *key;
+    char *value;
+    int kind;
+    while (fgets(line, sizeof(line), file) && (kind = parse_config_line(line, &key, &value)) != 2) {
+        if (kind == 1) {
+            apply_config_key(config, key, value);
         }
     }
+    fclose(file);
+
+    finish_config(config);
+    return 0;
+}
 
-    if (existing_schema) free(existing_schema);
-    if (existing_normalized) free(existing_normalized);
-    if (schema_normalized) free(schema_normalized);
+static char *copy_string(const char *value) {
+    return value ? strdup(value) : NULL;
 }
 
-int load_config(DBConfig *config) {
+static void copy_config(DBConfig *dst, const DBConfig *src) {
+    *dst = *src;
+    dst->host = copy_string(src->host);
+    dst->user = copy_string(src->user);
+    dst->pass = copy_string(src->pass);
+    dst->name = copy_string(src->name);
+    dst->emitted_state_path = copy_string(src->emitted_state_path);
+    dst->log_level = copy_string(src->log_level);
+    dst->binlog_index = copy_string(src->binlog_index);
+    dst->snapshot_pack = copy_string(src->snapshot_pack);
+    dst->trace_file = copy_string(src->trace_file);
+    // Every target picks its own root.
+    dst->output_root = NULL;
+}
+
+static TargetConfig *add_target(TargetConfig **targets, int *count, const char *name, const DBConfig *defaults) {
+    TargetConfig *grown = realloc(*targets, (size_t)(*count + 1) * sizeof(TargetConfig));
+    if (!grown) {
+        return NULL;
+    }
+    *targets = grown;
+    TargetConfig *target = &grown[*count];
+    target->name = strdup(name);
+    copy_config(&target->config, defaults);
+    // Two binlog targets on one server need distinct replica ids.
+    target->config.binlog_server_id = 0;
+    // Paging that the defaults turned off stays off through finish_config().
+    if (defaults->catalog_page_size == 0) {
+        target->config.catalog_page_size = -1;
+    }
+    (*count)++;
+    return target;
+}
+
+int load_targets(const DBConfig *defaults, TargetConfig **targets, int *count) {
+    *targets = NULL;
+    *count = 0;
     FILE *file = fopen(".env", "r");
     if (!file) {
         perror("Failed to open .env file");
@@ -472,22 +533,57 @@ int load_config(DBConfig *config) {
     }
 
     char line[MAX_LINE_LENGTH];
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\n")] = 0;
-        char *delimiter = strchr(line, '=');
-        if (delimiter) {
-            *delimiter = 0;
-            char *key = line;
-            char *value = delimiter + 1;
-            if (strcmp(key, "DB_HOST") == 0) config->host = strdup(value);
-            else if (strcmp(key, "DB_USER") == 0) config->user = strdup(value);
-            else if (strcmp(key, "DB_PASS") == 0) config->pass = strdup(value);
-            else if (strcmp(key, "DB_NAME") == 0) config->name = strdup(value);
-            else if (strcmp(key, "DB_PORT") == 0) config->port = atoi(value);
+    char *key;
+    char *value;
+    TargetConfig *target = NULL;
+    int result = 0;
+    while (result == 0 && fgets(line, sizeof(line), file)) {
+        int kind = parse_config_line(line, &key, &value);
+        if (kind == 2) {
+            char safe_name[NAME_SIZE];
+            sanitize_name(key, safe_name, sizeof(safe_name));
+            if (key[0] == '\0' || strcmp(safe_name, key) != 0 || key[0] == '.') {
+                fprintf(stderr, "Invalid target name [%s]: use letters, digits, '_', '-' and '.'\n", key);
+                result = -1;
+                break;
+            }
+            for (int i = 0; i < *count; i++) {
+                if (strcmp((*targets)[i].name, key) == 0) {
+                    fprintf(stderr, "Target [%s] is listed twice\n", key);
+                    result = -1;
+                }
+            }
+            target = result == 0 ? add_target(targets, count, key, defaults) : NULL;
+            if (!target) {
+                result = -1;
+            }
+        } else if (kind == 1 && target) {
+            apply_config_key(&target->config, key, value);
         }
     }
     fclose(file);
-    return 0;
+
+    for (int i = 0; result == 0 && i < *count; i++) {
+        DBConfig *config = &(*targets)[i].config;
+        if (config->binlog_server_id == 0) {
+            config->binlog_server_id = defaults->binlog_server_id + (unsigned int)i + 1;
+        }
+        finish_config(config);
+    }
+    if (result != 0) {
+        free_targets(*targets, *count);
+        *targets = NULL;
+        *count = 0;
+    }
+    return result;
+}
+
+void free_targets(TargetConfig *targets, int count) {
+    for (int i = 0; i < count; i++) {
+        free(targets[i].name);
+        free_config(&targets[i].config);
+    }
+    free(targets);
 }
 
 void free_config(DBConfig *config) {
@@ -495,6 +591,12 @@ void free_config(DBConfig *config) {
     if (config->user) free(config->user);
     if (config->pass) free(config->pass);
     if (config->name) free(config->name);
+    if (config->emitted_state_path) free(config->emitted_state_path);
+    if (config->log_level) free(config->log_level);
+    if (config->binlog_index) free(config->binlog_index);
+    if (config->snapshot_pack) free(config->snapshot_pack);
+    if (config->output_root) free(config->output_root);
+    if (config->trace_file) free(config->trace_file);
 }
 
 MYSQL* connect_db(DBConfig *config) {
@@ -525,171 +627,876 @@ void close_connection(MYSQL *conn) {
     mysql_close(conn);
 }
 
-void track_changes(MYSQL *conn, DBConfig *config, AppContext *ctx) {
-    // Ensure 'tables' directory exists
-    create_directory("tables");
-    create_directory("dbtables");
+static SchemaSource *target_source(WatchTarget *t, MYSQL *conn, SchemaSource *mysql_source) {
+    if (t->source) {
+        return t->source;
+    }
+    if (!conn) {
+        return NULL;
+    }
+    schema_source_mysql(mysql_source, conn);
+    return mysql_source;
+}
+
+// Only the normalized, interned schema outlives the fetched DDL.
+static void set_entry_schema(CatalogTable *entry, const char *schema) {
+    char *normalized = normalize_schema(schema);
+    entry->blob = normalized ? schema_blob_intern(normalized) : NULL;
+    free(normalized);
+}
+
+// Compares the captured schema with the live and main snapshots and fills
+// in the history and branch-delta migrations of the job.
+static void diff_table(CapturePass *pass, TableCapture *job) {
+    WatchTarget *t = pass->target;
+    CatalogTable *entry = job->entry;
+    const char *table_name = entry->name;
+    char safe_table_name[NAME_SIZE];
+    sanitize_name(table_name, safe_table_name, sizeof(safe_table_name));
+
+    // Interned schemas are equal exactly when they are the same blob.
+    if (entry->dirty) {
+        char schema_path[512];
+        target_path(t, schema_path, sizeof(schema_path), "tables/%s/schema.sql", table_name);
+        SchemaBlob *existing = load_snapshot(t, SNAPSHOT_SCOPE_LIVE, table_name, schema_path);
+        if (existing != job->blob) {
+            job->table_changed = 1;
+            job->had_snapshot = existing != NULL;
+            if (existing) {
+                generate_alter_statements(table_name, existing->data, job->normalized,
+                                          &job->history_up, &job->history_down);
+            }
+        }
+        schema_blob_release(existing);
+    }
+
+    if (pass->is_main_branch || !job->needs_check) {
+        return;
+    }
+
+    char main_schema_path[512];
+    target_path(t, main_schema_path, sizeof(main_schema_path), "dbtables/main/schemas/%s.sql", safe_table_name);
+    SchemaBlob *main_blob = load_snapshot(t, "main", safe_table_name, main_schema_path);
+    if (main_blob == job->blob) {
+        job->delta = DELTA_CLEAR;
+        schema_blob_release(main_blob);
+        return;
+    }
+    job->digest = job->blob->hash;
+    if (emitted_registry_has(&t->emitted, pass->branch_key, safe_table_name, job->digest)) {
+        schema_blob_release(main_blob);
+        return;
+    }
+
+    job->delta = DELTA_EMIT;
+    StrBuf *up_sql = sb_scratch(0);
+    StrBuf *down_sql = sb_scratch(1);
+    const char *reason = "branch_delta";
+    if (!main_blob) {
+        sb_appendf(up_sql, "-- table: %s | reason: new_table\n%s;\n\n", table_name, job->normalized);
+        sb_appendf(down_sql, "-- table: %s | reason: rollback_new_table\nDROP TABLE IF EXISTS `%s`;\n\n", table_name, table_name);
+        reason = "new_table";
+    } else {
+        generate_alter_statements(table_name, main_blob->data, job->normalized, up_sql, down_sql);
+        reason = "schema_changed";
+    }
+    schema_blob_release(main_blob);
+    if (up_sql->len > 0 || down_sql->len > 0) {
+        sb_appendf(&job->delta_up, "-- table: %s | reason: %s | generation: %lu\n%s",
+                   table_name, reason, pass->generation, sb_str(up_sql));
+        sb_appendf(&job->delta_down, "-- table: %s | reason: %s | generation: %lu\n%s",
+                   table_name, reason, pass->generation, sb_str(down_sql));
+    }
+}
+
+// Runs on a capture worker: fetches the DDL if the catalog does not have it,
+// normalizes it and computes the history and branch-delta migrations. Only
+// the job and its own catalog entry are written here; the snapshot cache is
+// read for this table's paths and the emitted registry is only read.
+static void capture_table(MYSQL *conn, int index, void *arg) {
+    CapturePass *pass = arg;
+    WatchTarget *t = pass->target;
+    TableCapture *job = &pass->jobs[index];
+    CatalogTable *entry = job->entry;
+    SchemaSource mysql_source;
+    SchemaSource *source = target_source(t, conn, &mysql_source);
+
+    // Once the branch moves the rest of the pass is thrown away, so stop
+    // spending round trips on it.
+    if (app_branch_generation(pass->ctx) != pass->generation) {
+        return;
+    }
+    if (!entry->blob && source) {
+        uint64_t start = metrics_now_us();
+        char *schema = source->ops->show_create(source, t->config->name, entry->name);
+        metrics_observe(PHASE_FETCH, start, t->name);
+        start = metrics_now_us();
+        set_entry_schema(entry, schema);
+        metrics_observe(PHASE_NORMALIZE, start, t->name);
+        free(schema);
+    }
+    if (!entry->blob) {
+        return;
+    }
+    job->blob = schema_blob_retain(entry->blob);
+    job->normalized = job->blob->data;
 
+    uint64_t start = metrics_now_us();
+    diff_table(pass, job);
+    metrics_observe(PHASE_DIFF, start, t->name);
+}
+
+static int prefetch_query(int index, StrBuf *sql, void *arg) {
+    CapturePass *pass = arg;
+    CatalogTable *entry = pass->jobs[index].entry;
+    if (entry->blob || app_branch_generation(pass->ctx) != pass->generation) {
+        return 0;
+    }
+    schema_source_append_show_create(sql, pass->target->config->name, entry->name);
+    return 1;
+}
+
+static void prefetch_row(int index, MYSQL_ROW row, void *arg) {
+    CapturePass *pass = arg;
+    if (row && row[1]) {
+        uint64_t start = metrics_now_us();
+        set_entry_schema(pass->jobs[index].entry, row[1]);
+        metrics_observe(PHASE_NORMALIZE, start, pass->target->name);
+    }
+}
+
+// With CAPTURE_ENGINE=async the DDL of a window is fetched up front, every
+// connection of the async pool keeping one SHOW CREATE TABLE in flight, and
+// capture_table() then finds it in the catalog. Tables whose fetch failed,
+// or never ran for want of a connection, are fetched by capture_table() on
+// the pass's own connection.
+static void prefetch_schemas(WatchTarget *t, CapturePass *pass, int count) {
+    uint64_t start = metrics_now_us();
+    int failed = async_query_run(&t->async, count, prefetch_query, prefetch_row, pass);
+    metrics_observe(PHASE_FETCH, start, t->name);
+    if (failed > 0) {
+        log_message(LOG_LEVEL_WARN, "MySQL: %s%d async fetch(es) failed, retrying them serially",
+                    t->label, failed);
+    }
+}
+
+// Clears the first count jobs for the next window, growing the list when
+// needed. Job buffers keep their capacity so later windows reuse it, unless
+// together they grew past max_bytes; then they are released.
+static int prepare_jobs(WatchTarget *t, int count, size_t max_bytes) {
+    if (count > t->jobs_capacity) {
+        TableCapture *grown = realloc(t->jobs, (size_t)count * sizeof(TableCapture));
+        if (!grown) {
+            return -1;
+        }
+        memset(grown + t->jobs_capacity, 0, (size_t)(count - t->jobs_capacity) * sizeof(TableCapture));
+        t->jobs = grown;
+        t->jobs_capacity = count;
+    }
+    size_t retained = 0;
+    for (int i = 0; i < t->jobs_capacity; i++) {
+        TableCapture *job = &t->jobs[i];
+        retained += job->history_up.cap + job->history_down.cap + job->delta_up.cap + job->delta_down.cap;
+    }
+    int release = retained > max_bytes;
+    int clear = release ? t->jobs_capacity : count;
+    for (int i = 0; i < clear; i++) {
+        TableCapture *job = &t->jobs[i];
+        schema_blob_release(job->blob);
+        job->blob = NULL;
+        job->normalized = NULL;
+        job->entry = NULL;
+        job->needs_check = 0;
+        job->table_changed = 0;
+        job->had_snapshot = 0;
+        job->delta = DELTA_NONE;
+        job->digest = 0;
+        if (release) {
+            sb_free(&job->history_up);
+            sb_free(&job->history_down);
+            sb_free(&job->delta_up);
+            sb_free(&job->delta_down);
+        } else {
+            sb_reset(&job->history_up);
+            sb_reset(&job->history_down);
+            sb_reset(&job->delta_up);
+            sb_reset(&job->delta_down);
+        }
+    }
+    return 0;
+}
+
+// Bytes a window of jobs produced: migration and delta text plus schemas.
+static size_t job_bytes(WatchTarget *t, int count) {
+    size_t bytes = 0;
+    for (int i = 0; i < count; i++) {
+        TableCapture *job = &t->jobs[i];
+        bytes += job->history_up.len + job->history_down.len + job->delta_up.len + job->delta_down.len;
+        bytes += job->blob ? job->blob->len : 0;
+    }
+    return bytes;
+}
+
+// Sizes the next window from what the last one cost per table, so the
+// output held between capture and write stays near the ceiling however
+// large the tables' DDL is.
+static int next_window(size_t ceiling, size_t bytes, int count, int min_window) {
+    size_t per_table = count > 0 ? bytes / (size_t)count : 0;
+    if (per_table < CAPTURE_MIN_TABLE_BYTES) {
+        per_table = CAPTURE_MIN_TABLE_BYTES;
+    }
+    size_t window = ceiling / per_table;
+    if (window < (size_t)min_window) {
+        return min_window;
+    }
+    return window > INT_MAX ? INT_MAX : (int)window;
+}
+
+static int grow_pending(WatchTarget *t, int count) {
+    if (count <= t->pending_capacity) {
+        return 0;
+    }
+    PendingTable *grown = realloc(t->pending, (size_t)count * sizeof(PendingTable));
+    if (!grown) {
+        return -1;
+    }
+    t->pending = grown;
+    t->pending_capacity = count;
+    return 0;
+}
+
+// Largest resident set of the process so far, in KiB.
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss;
+}
+
+static void report_peak_rss(WatchTarget *t, int tables, int windows) {
+    DBConfig *config = t->config;
+    long peak = peak_rss_kb();
+    pthread_mutex_lock(&g_peak_rss_lock);
+    int grew = peak > g_peak_rss_kb;
+    if (grew) {
+        g_peak_rss_kb = peak;
+    }
+    pthread_mutex_unlock(&g_peak_rss_lock);
+    if (!grew) {
+        return;
+    }
+    app_log(t->ctx, "MySQL: %speak RSS %ld MB after capturing %d table(s) in %d window(s)",
+            t->label, peak / 1024, tables, windows);
+    if ((unsigned long)peak / 1024 > (unsigned long)config->capture_memory_mb) {
+        log_message(LOG_LEVEL_WARN, "MySQL: peak RSS %ld MB is above CAPTURE_MEMORY_MB=%d",
+                    peak / 1024, config->capture_memory_mb);
+    }
+}
+
+static int in_catalog(const char *table, void *arg) {
+    WatchTarget *t = arg;
+    return catalog_find(&t->catalog, table) != NULL;
+}
+
+// Schema commits name tables by their sanitized name.
+static int safe_name_in_catalog(const char *safe_name, void *arg) {
+    WatchTarget *t = arg;
+    if (catalog_find(&t->catalog, safe_name)) {
+        return 1;
+    }
+    char candidate[NAME_SIZE];
+    for (int i = 0; i < t->catalog.tables_count; i++) {
+        sanitize_name(t->catalog.tables[i].name, candidate, sizeof(candidate));
+        if (strcmp(candidate, safe_name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Commits the schemas of the branch to refs/schema/<branch>, or
+// refs/schema/<target>/<branch> for a named target. The tree was
+// started on top of the previous commit and the tables captured in the pass
+// were put as they were written; the first commit of a branch takes every
+// table of the catalog instead.
+static void commit_git_snapshot(WatchTarget *t, int fresh, unsigned long generation) {
+    AppContext *ctx = t->ctx;
+    if (fresh) {
+        char safe_table_name[NAME_SIZE];
+        for (int i = 0; i < t->catalog.tables_count; i++) {
+            CatalogTable *entry = &t->catalog.tables[i];
+            if (entry->blob) {
+                sanitize_name(entry->name, safe_table_name, sizeof(safe_table_name));
+                git_snapshot_put(&t->git, safe_table_name, entry->blob->data, entry->blob->len);
+            }
+        }
+    }
+
+    char head[GIT_OID_HEXSZ + 1];
+    app_get_head(ctx, head, sizeof(head));
+    if (git_snapshot_commit(&t->git, safe_name_in_catalog, t, head, generation) > 0) {
+        app_log(ctx, "MySQL: %scommitted schemas to %s (source %s)", t->label, t->git.ref_name, head[0] ? head : "unknown");
+    }
+}
+
+static int capture_pass(WatchTarget *t, MYSQL *conn, char **names, int count) {
+    DBConfig *config = t->config;
+    AppContext *ctx = t->ctx;
     char branch_name[NAME_SIZE];
     char branch_key[NAME_SIZE];
-    app_get_branch(ctx, branch_name, sizeof(branch_name));
+    unsigned long generation = app_get_branch(ctx, branch_name, sizeof(branch_name));
     sanitize_name(branch_name, branch_key, sizeof(branch_key));
     if (branch_key[0] == '\0') {
         snprintf(branch_key, sizeof(branch_key), "%s", "unknown");
     }
     int is_main_branch = strcmp(branch_key, "main") == 0;
+    ensure_watch_state(t);
+
+    // One fingerprint query tells which tables moved; their models come from
+    // a few set-based information_schema queries and SHOW CREATE TABLE only
+    // runs for tables whose model changed.
+    SchemaSource mysql_source;
+    SchemaSource *source = target_source(t, conn, &mysql_source);
+    if (!source) {
+        return -1;
+    }
+    uint64_t phase_start = metrics_now_us();
+    int moved = names ? catalog_refresh_tables(source, config->name, &t->catalog, names, count)
+                      : catalog_refresh(source, config->name, &t->catalog);
+    metrics_observe(PHASE_ENUMERATE, phase_start, t->name);
+    if (moved < 0) {
+        return -1;
+    }
+    int branch_switched = strcmp(t->last_branch_key, branch_key) != 0;
+    if (moved == 0 && !branch_switched) {
+        return 0;
+    }
 
+    char tables_dir[512];
+    char dbtables_dir[512];
     char branch_dir[512];
     char main_branch_dir[512];
     char main_schemas_dir[512];
     char main_tables_path[512];
     char branch_init_path[512];
-    snprintf(branch_dir, sizeof(branch_dir), "dbtables/%s", branch_key);
-    snprintf(main_branch_dir, sizeof(main_branch_dir), "dbtables/main");
+    target_path(t, tables_dir, sizeof(tables_dir), "tables");
+    target_path(t, dbtables_dir, sizeof(dbtables_dir), "dbtables");
+    snprintf(branch_dir, sizeof(branch_dir), "%s/%s", dbtables_dir, branch_key);
+    snprintf(main_branch_dir, sizeof(main_branch_dir), "%s/main", dbtables_dir);
     snprintf(main_schemas_dir, sizeof(main_schemas_dir), "%s/schemas", main_branch_dir);
-    snprintf(main_tables_path, sizeof(main_tables_path), "dbtables/main.sql");
+    snprintf(main_tables_path, sizeof(main_tables_path), "%s/main.sql", dbtables_dir);
+
+    // Ensure 'tables' directory exists
+    if (!t->store_open) {
+        create_directories(tables_dir);
+    }
+    create_directories(dbtables_dir);
     snprintf(branch_init_path, sizeof(branch_init_path), "%s/.initialized", branch_dir);
 
-    create_directory(branch_dir);
+    create_directories(branch_dir);
     if (is_main_branch) {
-        create_directory(main_branch_dir);
-        create_directory(main_schemas_dir);
+        create_directories(main_branch_dir);
+        if (!t->store_open) {
+            create_directories(main_schemas_dir);
+        }
     }
     int is_branch_bootstrap = is_main_branch && (access(branch_init_path, F_OK) != 0);
 
-    FILE *main_fp = NULL;
-    if (is_main_branch) {
-        main_fp = fopen(main_tables_path, "w");
-    }
-    if (main_fp) {
-        fprintf(main_fp, "-- all tables snapshot\n");
-        fprintf(main_fp, "-- branch: %s\n\n", branch_name);
+    // Unchanged tables only matter again once the branch they are compared
+    // against moves; on main, main.sql reuses their cached blocks.
+    if (grow_pending(t, t->catalog.tables_count) != 0) {
+        return -1;
     }
-
-    char query[MAX_QUERY_LENGTH];
-    snprintf(query, sizeof(query), "SELECT table_name FROM information_schema.tables WHERE table_schema = '%s'", config->name);
-
-    if (mysql_query(conn, query)) {
-        fprintf(stderr, "Failed to fetch tables: %s\n", mysql_error(conn));
-        if (main_fp) {
-            fclose(main_fp);
+    int pending_count = 0;
+    for (int i = 0; i < t->catalog.tables_count; i++) {
+        CatalogTable *entry = &t->catalog.tables[i];
+        int needs_check = entry->dirty || branch_switched || is_branch_bootstrap;
+        if (!needs_check && !(is_main_branch && !main_snapshot_has(&t->main_snapshot, entry->name))) {
+            continue;
         }
-        return;
+        t->pending[pending_count].entry = entry;
+        t->pending[pending_count].needs_check = needs_check;
+        pending_count++;
     }
+    metrics_add(COUNTER_TABLES, (unsigned long)pending_count);
 
-    MYSQL_RES *result = mysql_store_result(conn);
-    if (!result) {
-        if (main_fp) {
-            fclose(main_fp);
-        }
-        return;
+    int git_fresh = -1;
+    if (t->git_open) {
+        char git_branch[2 * NAME_SIZE];
+        snprintf(git_branch, sizeof(git_branch), "%s%s%s", t->name, t->name[0] ? "/" : "", branch_key);
+        git_fresh = git_snapshot_begin(&t->git, git_branch);
+    }
+    CapturePass pass = {
+        .target = t,
+        .jobs = t->jobs,
+        .ctx = ctx,
+        .generation = generation,
+        .branch_key = branch_key,
+        .is_main_branch = is_main_branch
+    };
+
+    // Tables are captured and written a window at a time, so what a pass
+    // holds in memory is bounded by CAPTURE_MEMORY_MB rather than by the
+    // size of the catalog.
+    size_t ceiling = (size_t)config->capture_memory_mb * 1024 * 1024;
+    int min_window = t->pool.size > 0 ? t->pool.size : 1;
+    if (t->async_open && t->async.size > min_window) {
+        min_window = t->async.size;
     }
+    int window = next_window(ceiling, 0, 0, min_window);
+    int windows = 0;
+    int start = 0;
+    while (start < pending_count) {
+        int batch = window < pending_count - start ? window : pending_count - start;
+        if (prepare_jobs(t, batch, ceiling) != 0) {
+            if (t->git_open) {
+                git_snapshot_abort(&t->git);
+            }
+            return -1;
+        }
+        for (int i = 0; i < batch; i++) {
+            t->jobs[i].entry = t->pending[start + i].entry;
+            t->jobs[i].needs_check = t->pending[start + i].needs_check;
+        }
+        pass.jobs = t->jobs;
+        if (t->async_open && !t->source) {
+            prefetch_schemas(t, &pass, batch);
+        }
+        worker_pool_run(&t->pool, conn, batch, capture_table, &pass);
+        windows++;
+
+        // A checkout during the capture means part of it may already reflect
+        // the new branch. Nothing more is written and the branch is not
+        // recorded as seen, so the next pass redoes the work under the new
+        // generation; windows already written were captured under the old
+        // one. Dropping the schema fetched for dirty tables keeps them dirty
+        // across catalog_refresh().
+        if (app_branch_generation(ctx) != generation) {
+            for (int i = 0; i < batch; i++) {
+                CatalogTable *entry = t->jobs[i].entry;
+                if (entry->dirty) {
+                    schema_blob_release(entry->blob);
+                    entry->blob = NULL;
+                }
+            }
+            if (t->git_open) {
+                git_snapshot_abort(&t->git);
+            }
+            app_log(ctx, "MySQL: %sbranch changed during capture (generation %lu), discarding pass for %s",
+                    t->label, generation, branch_name);
+            return 0;
+        }
 
-    MYSQL_ROW row;
-    while ((row = mysql_fetch_row(result))) {
-        char *table_name = row[0];
-        
-        char table_dir[512];
-        snprintf(table_dir, sizeof(table_dir), "tables/%s", table_name);
-        create_directory(table_dir);
-        
-        char safe_table_name[NAME_SIZE];
-        sanitize_name(table_name, safe_table_name, sizeof(safe_table_name));
+        phase_start = metrics_now_us();
+        for (int i = 0; i < batch; i++) {
+            TableCapture *job = &t->jobs[i];
+            CatalogTable *entry = job->entry;
+            const char *table_name = entry->name;
+            if (!job->normalized) {
+                continue;
+            }
 
-        char *schema = get_table_schema(conn, table_name);
-        if (schema) {
-            char *schema_normalized = normalize_schema(schema);
+            char safe_table_name[NAME_SIZE];
+            sanitize_name(table_name, safe_table_name, sizeof(safe_table_name));
 
-            save_schema_and_check_diff(table_dir, table_name, schema);
+            if (entry->dirty) {
+                if (job->table_changed) {
+                    metrics_add(COUNTER_CHANGES, 1);
+                    char table_dir[512];
+                    snprintf(table_dir, sizeof(table_dir), "%s/%s", tables_dir, table_name);
+                    save_schema_and_log_history(t, table_dir, table_name, job);
+                }
+                entry->dirty = 0;
+            }
 
-            if (schema_normalized) {
-                if (is_main_branch) {
+            if (is_main_branch) {
+                if (job->needs_check) {
                     char main_schema_path[512];
                     snprintf(main_schema_path, sizeof(main_schema_path), "%s/%s.sql", main_schemas_dir, safe_table_name);
-                    save_sql_file(main_schema_path, schema_normalized);
-                    write_table_block(main_fp, branch_name, table_name, schema_normalized);
-                } else {
-                    char main_schema_path[512];
-                    snprintf(main_schema_path, sizeof(main_schema_path), "%s/%s.sql", main_schemas_dir, safe_table_name);
-                    char *main_schema = read_file_content(main_schema_path);
-                    char *main_schema_norm = normalize_schema(main_schema);
-                    int differs_from_main = (!main_schema_norm) || (strcmp(main_schema_norm, schema_normalized) != 0);
-
-                    if (differs_from_main && !has_emitted_change(branch_key, safe_table_name, schema_normalized)) {
-                        char up_sql[8192];
-                        char down_sql[1024];
-                        const char *reason = "branch_delta";
-                        if (!main_schema_norm) {
-                            snprintf(up_sql, sizeof(up_sql), "-- table: %s | reason: new_table\n%s;\n\n", table_name, schema_normalized);
-                            snprintf(down_sql, sizeof(down_sql), "-- table: %s | reason: rollback_new_table\nDROP TABLE IF EXISTS `%s`;\n\n", table_name, table_name);
-                            reason = "new_table";
-                        } else {
-                            up_sql[0] = '\0';
-                            down_sql[0] = '\0';
-                            generate_alter_statements(table_name, main_schema_norm, schema_normalized, up_sql, down_sql);
-                            reason = "schema_changed";
-                        }
-                        if (strlen(up_sql) > 0 || strlen(down_sql) > 0) {
-                            time_t now = time(NULL);
-                            struct tm tm_now;
-                            char ts[32];
-                            localtime_r(&now, &tm_now);
-                            strftime(ts, sizeof(ts), "%Y%m%d%H%M%S", &tm_now);
-
-                            char up_event_path[512];
-                            char down_event_path[512];
-                            snprintf(up_event_path, sizeof(up_event_path), "%s/%s_%s_up.sql", branch_dir, ts, safe_table_name);
-                            snprintf(down_event_path, sizeof(down_event_path), "%s/%s_%s_down.sql", branch_dir, ts, safe_table_name);
-
-                            char up_file_content[8448];
-                            char down_file_content[8448];
-                            snprintf(up_file_content, sizeof(up_file_content), "-- table: %s | reason: %s\n%s", table_name, reason, up_sql);
-                            snprintf(down_file_content, sizeof(down_file_content), "-- table: %s | reason: %s\n%s", table_name, reason, down_sql);
-
-                            save_sql_file(up_event_path, up_file_content);
-                            save_sql_file(down_event_path, down_file_content);
-                        }
-                        set_emitted_change(branch_key, safe_table_name, schema_normalized);
-                        app_log(ctx, "MySQL: branch delta for %s -> %s", branch_name, table_name);
-                    } else if (!differs_from_main) {
-                        clear_emitted_change(branch_key, safe_table_name);
-                    }
-
-                    if (main_schema_norm) {
-                        free(main_schema_norm);
-                    }
-                    if (main_schema) {
-                        free(main_schema);
-                    }
+                    store_snapshot(t, "main", safe_table_name, main_schema_path, job->blob);
                 }
-
-                free(schema_normalized);
+                main_snapshot_set(&t->main_snapshot, branch_name, table_name, job->normalized);
+            } else if (job->delta == DELTA_EMIT) {
+                metrics_add(COUNTER_CHANGES, 1);
+                if (job->delta_up.len > 0) {
+                    time_t now = time(NULL);
+                    struct tm tm_now;
+                    char ts[32];
+                    localtime_r(&now, &tm_now);
+                    strftime(ts, sizeof(ts), "%Y%m%d%H%M%S", &tm_now);
+
+                    char up_event_path[512];
+                    char down_event_path[512];
+                    snprintf(up_event_path, sizeof(up_event_path), "%s/%s_%s_up.sql", branch_dir, ts, safe_table_name);
+                    snprintf(down_event_path, sizeof(down_event_path), "%s/%s_%s_down.sql", branch_dir, ts, safe_table_name);
+                    save_sql_file(up_event_path, sb_str(&job->delta_up));
+                    save_sql_file(down_event_path, sb_str(&job->delta_down));
+                }
+                emitted_registry_set(&t->emitted, branch_key, safe_table_name, job->digest);
+                app_log(ctx, "MySQL: %sbranch delta for %s -> %s (generation %lu)",
+                        t->label, branch_name, table_name, generation);
+            } else if (job->delta == DELTA_CLEAR) {
+                emitted_registry_clear(&t->emitted, branch_key, safe_table_name);
+            }
+            if (git_fresh == 0) {
+                git_snapshot_put(&t->git, safe_table_name, job->blob->data, job->blob->len);
             }
-            free(schema);
         }
+        metrics_observe(PHASE_WRITE, phase_start, t->name);
+
+        start += batch;
+        window = next_window(ceiling, job_bytes(t, batch), batch, min_window);
     }
 
-    mysql_free_result(result);
-    if (main_fp) {
-        fclose(main_fp);
+    phase_start = metrics_now_us();
+    if (is_main_branch) {
+        char header[NAME_SIZE + 96];
+        snprintf(header, sizeof(header), "-- all tables snapshot\n-- branch: %s | generation: %lu\n\n",
+                 branch_name, generation);
+        main_snapshot_retain(&t->main_snapshot, in_catalog, t);
+        if (main_snapshot_write(&t->main_snapshot, main_tables_path, header) > 0) {
+            app_log(ctx, "MySQL: %srewrote %s (generation %lu)", t->label, main_tables_path, generation);
+        }
     }
     if (is_main_branch && is_branch_bootstrap) {
         save_sql_file(branch_init_path, "initialized\n");
-        app_log(ctx, "MySQL: initialized branch baseline for %s", branch_name);
+        app_log(ctx, "MySQL: %sinitialized branch baseline for %s", t->label, branch_name);
+    }
+    if (git_fresh >= 0) {
+        commit_git_snapshot(t, git_fresh, generation);
     }
+    metrics_observe(PHASE_WRITE, phase_start, t->name);
+    report_peak_rss(t, pending_count, windows);
+    snprintf(t->last_branch_key, sizeof(t->last_branch_key), "%s", branch_key);
+    return 0;
 }
 
-void watch_database(DBConfig *config, AppContext *ctx) {
-    printf("Starting database watcher for %s...\n", config->name);
-    app_log(ctx, "MySQL: watcher started for database %s", config->name);
+// names == NULL rescans every table of the database; otherwise only the
+// listed ones are looked at. Returns -1 when the catalog could not be read.
+static int run_pass(WatchTarget *t, MYSQL *conn, char **names, int count) {
+    // A full pass that started after a git change has caught up with it.
+    unsigned long seq = app_change_seq(t->ctx);
+    uint64_t start = metrics_now_us();
+    int rc = capture_pass(t, conn, names, count);
+    // Deltas emitted or cleared by the pass, even one cut short, are saved
+    // with one rewrite of the state file.
+    if (t->state_ready) {
+        emitted_registry_flush(&t->emitted);
+    }
+    metrics_observe(PHASE_CYCLE, start, t->name);
+    metrics_add(COUNTER_PASSES, 1);
+    if (rc < 0) {
+        metrics_add(COUNTER_ERRORS, 1);
+    } else if (!names) {
+        metrics_git_synced(t->metrics_id, seq);
+    }
+    return rc;
+}
+
+int track_changes(WatchTarget *target, MYSQL *conn) {
+    return run_pass(target, conn, NULL, 0);
+}
+
+int track_table_changes(WatchTarget *target, MYSQL *conn, char **names, int count) {
+    return run_pass(target, conn, names, count);
+}
+
+// Feeds the outcome of a pass back into the scheduler. A table the current
+// feature branch has a delta for stays hot: it is the one being worked on.
+static void schedule_probed(WatchTarget *t, char **names, int count) {
+    char branch_name[NAME_SIZE];
+    char branch_key[NAME_SIZE];
+    app_get_branch(t->ctx, branch_name, sizeof(branch_name));
+    sanitize_name(branch_name, branch_key, sizeof(branch_key));
+    int is_main_branch = strcmp(branch_key, "main") == 0;
+    uint64_t now = poll_scheduler_now_ms();
+
+    int total = names ? count : t->catalog.tables_count;
+    for (int i = 0; i < total; i++) {
+        const char *name = names ? names[i] : t->catalog.tables[i].name;
+        CatalogTable *entry = catalog_find(&t->catalog, name);
+        int hot = 0;
+        if (entry && !is_main_branch) {
+            char safe_table_name[NAME_SIZE];
+            sanitize_name(name, safe_table_name, sizeof(safe_table_name));
+            hot = emitted_registry_contains(&t->emitted, branch_key, safe_table_name);
+        }
+        poll_scheduler_report(&t->scheduler, name, entry ? entry->fingerprint : NULL, hot, now);
+    }
+}
+
+// Lists the tables every DISCOVER_MS so created and dropped ones are probed
+// at once instead of waiting for a full pass.
+static void discover_tables(WatchTarget *t, MYSQL *conn) {
+    char **names = NULL;
+    int count = 0;
+    SchemaSource mysql_source;
+    SchemaSource *source = target_source(t, conn, &mysql_source);
+    if (!source || catalog_list_tables(source, t->config->name, t->config->catalog_page_size, &names, &count) != 0) {
+        return;
+    }
+    poll_scheduler_sync(&t->scheduler, names, count, poll_scheduler_now_ms());
+    poll_scheduler_free_names(names, count);
+}
+
+// Runs a full pass, then fingerprints only the tables the scheduler says are
+// due, at most poll_budget of them per cycle and at most one cycle per
+// POLL_CYCLE_MS. A git change since the last cycle makes it a full pass.
+unsigned int watch_target_poll(WatchTarget *t, MYSQL *conn) {
+    unsigned int wait_ms = POLL_CYCLE_MS;
+    if (app_change_seq(t->ctx) != t->seen) {
+        t->seen = app_change_seq(t->ctx);
+        t->full = 1;
+    }
+    if (!conn) {
+        t->full = 1;
+    } else if (t->full) {
+        if (track_changes(t, conn) == 0) {
+            schedule_probed(t, NULL, 0);
+            t->listed_ms = poll_scheduler_now_ms();
+            t->full = 0;
+        }
+    } else {
+        if (poll_scheduler_now_ms() - t->listed_ms >= DISCOVER_MS) {
+            discover_tables(t, conn);
+            t->listed_ms = poll_scheduler_now_ms();
+        }
+
+        int count = 0;
+        char **names = poll_scheduler_due(&t->scheduler, poll_scheduler_now_ms(), &count);
+        if (count > 0) {
+            if (track_table_changes(t, conn, names, count) == 0) {
+                schedule_probed(t, names, count);
+            } else {
+                t->full = 1;
+            }
+        }
+        poll_scheduler_free_names(names, count);
+
+        unsigned int next_ms = poll_scheduler_next_wait(&t->scheduler, poll_scheduler_now_ms(), DISCOVER_MS);
+        if (next_ms > wait_ms) {
+            wait_ms = next_ms;
+        }
+    }
+    return wait_ms;
+}
+
+static void watch_by_polling(WatchTarget *t, DbConnection *dc) {
+    while (!should_stop(t->ctx)) {
+        MYSQL *conn = db_connection_acquire(dc, t->ctx);
+        unsigned int wait_ms = watch_target_poll(t, conn);
+        if (!conn) {
+            wait_ms = db_connection_retry_delay_ms(dc);
+        }
+
+        unsigned long seen = t->seen;
+        if (app_wait_for_change(t->ctx, &seen, wait_ms) > 0) {
+            app_log(t->ctx, "MySQL: %swoken by a git change, rescanning", t->label);
+        }
+    }
+}
+
+// Runs a full pass, then only re-reads the tables DDL in the binlog names.
+// A git change still triggers a full pass, since a branch switch rewrites
+// every delta. Whenever the binlog cannot be read the watcher does a full
+// pass (DDL may have been missed meanwhile) and reconnects.
+static void watch_by_binlog(WatchTarget *t, DbConnection *dc) {
+    DBConfig *config = t->config;
+    AppContext *ctx = t->ctx;
+    BinlogWatcher bw;
+    int open = 0;
+    int full = 1;
+    unsigned long seen = app_change_seq(ctx);
+
     while (!should_stop(ctx)) {
-        MYSQL *conn = connect_db(config);
+        if (!open) {
+            if (binlog_watcher_open(&bw, config, ctx) == 0) {
+                open = 1;
+                full = 1;
+            } else {
+                log_message(LOG_LEVEL_WARN, "MySQL: %scannot tail the binlog, polling until it can be reopened",
+                            t->label);
+                full = 1;
+            }
+        }
+
+        char **names = NULL;
+        int count = 0;
+        if (open && !full) {
+            int rc = binlog_watcher_poll(&bw, BINLOG_POLL_MS);
+            if (rc < 0) {
+                log_message(LOG_LEVEL_WARN, "MySQL: %slost the binlog stream at %s:%llu, reconnecting",
+                            t->label, bw.file_name, (unsigned long long)bw.position);
+                binlog_watcher_close(&bw);
+                open = 0;
+                full = 1;
+            } else if (rc > 0) {
+                names = binlog_watcher_take(&bw, &count, &full);
+            }
+        }
+        if (app_change_seq(ctx) != seen) {
+            seen = app_change_seq(ctx);
+            full = 1;
+        }
+        if (!full && !names) {
+            continue;
+        }
+
+        MYSQL *conn = db_connection_acquire(dc, ctx);
+        int failed = 0;
         if (conn) {
-            track_changes(conn, config, ctx);
-            close_connection(conn);
+            if (full) {
+                failed = track_changes(t, conn) != 0;
+            } else {
+                app_log(ctx, "MySQL: %sbinlog DDL touched %d table(s)", t->label, count);
+                failed = track_table_changes(t, conn, names, count) != 0;
+            }
+            full = failed;
         } else {
-            fprintf(stderr, "Retrying connection in 5 seconds...\n");
+            full = 1;
         }
-        sleep(5);
+        binlog_watcher_free_names(names, count);
+
+        // Without a stream, without a server or after a failed pass, fall
+        // back to the poll interval so the retry does not turn into a busy
+        // loop.
+        if (!open || !conn || failed) {
+            unsigned int wait_ms = conn ? POLL_INTERVAL_MS : db_connection_retry_delay_ms(dc);
+            app_wait_for_change(ctx, &seen, wait_ms);
+        }
+    }
+    if (open) {
+        binlog_watcher_close(&bw);
+    }
+}
+
+// Relative state files of a named target live under its output root, so
+// targets that inherit the same EMITTED_STATE_FILE or SNAPSHOT_PACK from
+// the defaults do not share them.
+static char *resolve_path(const WatchTarget *t, const char *path) {
+    if (!path) {
+        return NULL;
+    }
+    if (path[0] == '/' || !t->root[0]) {
+        return strdup(path);
+    }
+    char resolved[512];
+    target_path(t, resolved, sizeof(resolved), "%s", path);
+    return strdup(resolved);
+}
+
+WatchTarget *watch_target_create(const char *name, DBConfig *config, AppContext *ctx, int workers) {
+    WatchTarget *t = calloc(1, sizeof(WatchTarget));
+    if (!t) {
+        return NULL;
+    }
+    t->config = config;
+    t->ctx = ctx;
+    if (name) {
+        snprintf(t->name, sizeof(t->name), "%s", name);
+        snprintf(t->label, sizeof(t->label), "[%s] ", name);
+        snprintf(t->root, sizeof(t->root), "%s", config->output_root ? config->output_root : name);
+        create_directories(t->root);
     }
+    ScheduleConfig schedule = { config->poll_hot_ms, config->poll_cold_ms, config->poll_budget };
+    if (poll_scheduler_init(&t->scheduler, &schedule) != 0) {
+        fprintf(stderr, "Failed to set up the poll scheduler\n");
+        free(t);
+        return NULL;
+    }
+    t->emitted_state_path = resolve_path(t, config->emitted_state_path);
+    t->snapshot_pack = resolve_path(t, config->snapshot_pack);
+    t->seen = app_change_seq(ctx);
+    t->full = 1;
+    t->metrics_id = metrics_register_target(t->name);
+
+    ensure_watch_state(t);
+    // The async engine replaces the capture threads; the rest of a pass runs
+    // on the watcher's thread once the DDL is in.
+    if (config->capture_engine == CAPTURE_ENGINE_ASYNC && workers >= 2) {
+        t->async_open = async_query_start(&t->async, config, ctx, workers) == 0;
+    }
+    worker_pool_start(&t->pool, config, ctx, t->async_open ? 0 : workers);
+    app_log(ctx, "MySQL: %swatcher started for database %s (%s capture)", t->label, config->name,
+            config->capture_mode == CAPTURE_BINLOG ? "binlog" : "poll");
+    return t;
+}
+
+void watch_target_set_source(WatchTarget *t, SchemaSource *source) {
+    t->source = source;
+}
+
+void watch_target_run(WatchTarget *t) {
+    DbConnection dc;
+    db_connection_init(&dc, t->config);
+    printf("%sStarting database watcher for %s...\n", t->label, t->config->name);
+    if (t->config->capture_mode == CAPTURE_BINLOG) {
+        watch_by_binlog(t, &dc);
+    } else {
+        watch_by_polling(t, &dc);
+    }
+    db_connection_close(&dc);
+}
+
+void watch_target_destroy(WatchTarget *t) {
+    AppContext *ctx = t->ctx;
+    worker_pool_stop(&t->pool);
+    if (t->async_open) {
+        app_log(ctx, "MySQL: %sasync engine ran %lu queries, %lu failed, at most %d in flight",
+                t->label, t->async.queries, t->async.failures, t->async.max_in_flight);
+        async_query_stop(&t->async);
+    }
+    if (t->config->capture_mode != CAPTURE_BINLOG) {
+        app_log(ctx, "MySQL: %sscheduler probed %lu table(s), %lu changed, %lu deferred by the budget",
+                t->label, t->scheduler.probes, t->scheduler.changes, t->scheduler.deferred);
+    }
+    poll_scheduler_free(&t->scheduler);
+    if (t->store_open) {
+        app_log(ctx, "MySQL: %ssnapshot store %s appended %lu record(s)", t->label, t->snapshot_pack,
+                t->store.appends);
+        snapshot_store_close(&t->store);
+    }
+    if (t->git_open) {
+        app_log(ctx, "MySQL: %swrote %lu schema commit(s) under refs/schema/", t->label, t->git.commits);
+        git_snapshot_close(&t->git);
+    }
+    if (t->state_ready) {
+        emitted_registry_flush(&t->emitted);
+        emitted_registry_free(&t->emitted);
+        main_snapshot_free(&t->main_snapshot);
+        schema_cache_free(&t->schema_cache);
+    }
+    catalog_free(&t->catalog);
+    for (int i = 0; i < t->jobs_capacity; i++) {
+        TableCapture *job = &t->jobs[i];
+        schema_blob_release(job->blob);
+        sb_free(&job->history_up);
+        sb_free(&job->history_down);
+        sb_free(&job->delta_up);
+        sb_free(&job->delta_down);
+    }
+    free(t->jobs);
+    free(t->pending);
+    free(t->emitted_state_path);
+    free(t->snapshot_pack);
+    free(t);
+}
+
+void watch_database(DBConfig *config, AppContext *ctx) {
+    WatchTarget *t = watch_target_create(NULL, config, ctx, config->workers);
+    if (!t) {
+        return;
+    }
+    watch_target_run(t);
+    watch_target_destroy(t);
+    report_blob_usage(ctx);
+}
+
+void report_blob_usage(AppContext *ctx) {
+    SchemaBlobStats blob_stats;
+    schema_blob_get_stats(&blob_stats);
+    app_log(ctx, "MySQL: %lu distinct schema(s) in %zu bytes, %lu lookup(s) shared an existing copy",
+            blob_stats.blobs, blob_stats.bytes, blob_stats.shared);
+    app_log(ctx, "MySQL: peak RSS %ld MB", peak_rss_kb() / 1024);
 }
@@ -0,0 +1,65 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "parallel.h"
+
+typedef struct {
+    const ParallelJob *job;
+    pthread_mutex_t lock;
+    int chunk;
+    int next;
+    int end;
+} ParallelRun;
+
+static int take_chunk(ParallelRun *run, int *end) {
+    int start = -1;
+    pthread_mutex_lock(&run->lock);
+    if (run->next < run->end) {
+        start = run->next;
+        run->next = run->end - run->next > run->chunk ? run->next + run->chunk : run->end;
+        *end = run->next;
+    }
+    pthread_mutex_unlock(&run->lock);
+    return start;
+}
+
+static void *parallel_worker(void *arg) {
+    ParallelRun *run = arg;
+    const ParallelJob *job = run->job;
+    void *local = NULL;
+    if (job->open && job->open(&local, job->arg) != 0) {
+        return NULL;
+    }
+
+    int start;
+    int end = 0;
+    while ((start = take_chunk(run, &end)) >= 0) {
+        for (int i = start; i < end; i++) {
+            job->fn(local, i, job->arg);
+        }
+    }
+    if (job->close) {
+        job->close(local, job->arg);
+    }
+    return NULL;
+}
+
+int parallel_run(const ParallelJob *job, int threads, int start, int end) {
+    ParallelRun run = { job, PTHREAD_MUTEX_INITIALIZER, job->chunk > 0 ? job->chunk : 1, start, end };
+    pthread_t *ids = threads > 1 ? calloc((size_t)threads, sizeof(pthread_t)) : NULL;
+    int started = 0;
+    for (int i = 0; ids && i < threads; i++) {
+        if (pthread_create(&ids[started], NULL, parallel_worker, &run) != 0) {
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        parallel_worker(&run);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(ids[i], NULL);
+    }
+    free(ids);
+    pthread_mutex_destroy(&run.lock);
+    return run.next < end ? -1 : 0;
+}
@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "poll_scheduler.h"
+
+// Every interval is stretched or shrunk by up to this share, so tables that
+// changed together do not keep coming due in the same cycle.
+#define JITTER_PERCENT 10
+
+uint64_t poll_scheduler_now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static uint32_t next_random(PollScheduler *s) {
+    // xorshift32; only used to spread probes, not for anything secret.
+    uint32_t x = s->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s->rng = x;
+    return x;
+}
+
+static uint64_t jittered(PollScheduler *s, unsigned int interval_ms) {
+    uint32_t spread = interval_ms / 100 * JITTER_PERCENT;
+    if (spread == 0) {
+        return interval_ms;
+    }
+    return (uint64_t)interval_ms - spread + next_random(s) % (2 * spread + 1);
+}
+
+static void free_schedule(void *value) {
+    TableSchedule *table = value;
+    free(table->fingerprint);
+    free(table);
+}
+
+int poll_scheduler_init(PollScheduler *s, const ScheduleConfig *config) {
+    memset(s, 0, sizeof(*s));
+    s->config = *config;
+    if (s->config.hot_ms == 0) {
+        s->config.hot_ms = 1;
+    }
+    if (s->config.cold_ms < s->config.hot_ms) {
+        s->config.cold_ms = s->config.hot_ms;
+    }
+    if (s->config.budget <= 0) {
+        s->config.budget = 1;
+    }
+    s->rng = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16) ^ 0x9E3779B9u;
+    if (s->rng == 0) {
+        s->rng = 1;
+    }
+    return hash_map_init(&s->tables, 256);
+}
+
+static TableSchedule *add_table(PollScheduler *s, const char *name) {
+    TableSchedule *table = calloc(1, sizeof(TableSchedule));
+    if (!table) {
+        return NULL;
+    }
+    if (hash_map_put(&s->tables, name, table) != 0) {
+        free(table);
+        return NULL;
+    }
+    return table;
+}
+
+typedef struct {
+    PollScheduler *s;
+    HashMap listed;
+    uint64_t now_ms;
+} SyncState;
+
+static void mark_gone(const char *key, void *value, void *arg) {
+    SyncState *state = arg;
+    TableSchedule *table = value;
+    if (!table->gone && !hash_map_get(&state->listed, key)) {
+        table->gone = 1;
+        table->due_ms = state->now_ms;
+    }
+}
+
+void poll_scheduler_sync(PollScheduler *s, char **names, int count, uint64_t now_ms) {
+    SyncState state = { s, { 0 }, now_ms };
+    if (hash_map_init(&state.listed, (size_t)count * 2 + 16) != 0) {
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        hash_map_put(&state.listed, names[i], s);
+        TableSchedule *table = hash_map_get(&s->tables, names[i]);
+        if (!table) {
+            // Created since the last sync: probe it right away and keep it
+            // hot, new tables tend to be altered again soon.
+            table = add_table(s, names[i]);
+            if (table) {
+                table->interval_ms = s->config.hot_ms;
+                table->due_ms = now_ms;
+            }
+        } else if (table->gone) {
+            table->gone = 0;
+        }
+    }
+    hash_map_foreach(&s->tables, mark_gone, &state);
+    hash_map_free(&state.listed, NULL);
+}
+
+typedef struct {
+    const char *name;
+    uint64_t due_ms;
+} DueTable;
+
+typedef struct {
+    DueTable *items;
+    size_t count;
+    uint64_t now_ms;
+} DueList;
+
+static void collect_due(const char *key, void *value, void *arg) {
+    DueList *list = arg;
+    TableSchedule *table = value;
+    if (table->due_ms <= list->now_ms) {
+        list->items[list->count].name = key;
+        list->items[list->count].due_ms = table->due_ms;
+        list->count++;
+    }
+}
+
+static int compare_due(const void *a, const void *b) {
+    const DueTable *left = a;
+    const DueTable *right = b;
+    if (left->due_ms != right->due_ms) {
+        return left->due_ms < right->due_ms ? -1 : 1;
+    }
+    return strcmp(left->name, right->name);
+}
+
+char **poll_scheduler_due(PollScheduler *s, uint64_t now_ms, int *count) {
+    *count = 0;
+    if (s->tables.count == 0) {
+        return NULL;
+    }
+    DueList list = { calloc(s->tables.count, sizeof(DueTable)), 0, now_ms };
+    if (!list.items) {
+        return NULL;
+    }
+    hash_map_foreach(&s->tables, collect_due, &list);
+    if (list.count == 0) {
+        free(list.items);
+        return NULL;
+    }
+
+    qsort(list.items, list.count, sizeof(DueTable), compare_due);
+    size_t take = list.count;
+    if (take > (size_t)s->config.budget) {
+        s->deferred += take - (size_t)s->config.budget;
+        take = (size_t)s->config.budget;
+    }
+
+    char **names = calloc(take, sizeof(char *));
+    int n = 0;
+    if (names) {
+        for (size_t i = 0; i < take; i++) {
+            names[n] = strdup(list.items[i].name);
+            if (names[n]) {
+                n++;
+            }
+        }
+    }
+    free(list.items);
+    *count = n;
+    return names;
+}
+
+void poll_scheduler_free_names(char **names, int count) {
+    for (int i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+void poll_scheduler_report(PollScheduler *s, const char *name, const char *fingerprint, int hot, uint64_t now_ms) {
+    TableSchedule *table = hash_map_get(&s->tables, name);
+    if (!fingerprint) {
+        if (table) {
+            free_schedule(hash_map_remove(&s->tables, name));
+        }
+        return;
+    }
+
+    s->probes++;
+    if (!table) {
+        // First sighting, typically the pass at startup: assume the table is
+        // cold and spread the first probes over the whole cold interval.
+        table = add_table(s, name);
+        if (!table) {
+            return;
+        }
+        table->fingerprint = strdup(fingerprint);
+        table->interval_ms = hot ? s->config.hot_ms : s->config.cold_ms;
+        table->due_ms = now_ms + s->config.hot_ms + next_random(s) % (table->interval_ms - s->config.hot_ms + 1);
+        return;
+    }
+
+    table->gone = 0;
+    int changed = !table->fingerprint || strcmp(table->fingerprint, fingerprint) != 0;
+    if (changed) {
+        char *copy = strdup(fingerprint);
+        if (copy) {
+            free(table->fingerprint);
+            table->fingerprint = copy;
+        }
+        s->changes++;
+    }
+
+    if (changed || hot) {
+        table->interval_ms = s->config.hot_ms;
+    } else if (table->interval_ms < s->config.cold_ms / 2) {
+        table->interval_ms *= 2;
+    } else {
+        table->interval_ms = s->config.cold_ms;
+    }
+    table->due_ms = now_ms + jittered(s, table->interval_ms);
+}
+
+typedef struct {
+    uint64_t earliest;
+} NextDue;
+
+static void find_earliest(const char *key, void *value, void *arg) {
+    (void)key;
+    NextDue *next = arg;
+    TableSchedule *table = value;
+    if (table->due_ms < next->earliest) {
+        next->earliest = table->due_ms;
+    }
+}
+
+unsigned int poll_scheduler_next_wait(PollScheduler *s, uint64_t now_ms, unsigned int max_ms) {
+    NextDue next = { now_ms + max_ms };
+    hash_map_foreach(&s->tables, find_earliest, &next);
+    return next.earliest <= now_ms ? 0 : (unsigned int)(next.earliest - now_ms);
+}
+
+void poll_scheduler_free(PollScheduler *s) {
+    hash_map_free(&s->tables, free_schedule);
+}
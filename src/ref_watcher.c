@@ -0,0 +1,240 @@
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include "ref_watcher.h"
+
+// A ref update usually touches several watched files (the ref, logs/HEAD,
+// sometimes packed-refs); events arriving this close together are folded
+// into one wake-up.
+#define SETTLE_MS 5
+
+#define WATCH_GIT_DIR 0x1
+#define WATCH_COMMON_DIR 0x2
+#define WATCH_LOGS 0x4
+#define WATCH_REFS 0x8
+
+#define DIR_EVENTS (IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM)
+
+static int add_watch(RefWatcher *watcher, const char *path, uint32_t mask, int kind) {
+    int wd = inotify_add_watch(watcher->fd, path, mask | IN_MASK_ADD);
+    if (wd < 0) {
+        return -1;
+    }
+
+    // The git dir and the common dir are the same directory outside linked
+    // worktrees; inotify hands back the same descriptor for both.
+    for (int i = 0; i < watcher->watch_count; i++) {
+        if (watcher->watches[i].wd == wd) {
+            watcher->watches[i].kinds |= kind;
+            return 0;
+        }
+    }
+
+    if (watcher->watch_count >= watcher->watch_capacity) {
+        int capacity = watcher->watch_capacity ? watcher->watch_capacity * 2 : 16;
+        RefWatch *grown = realloc(watcher->watches, (size_t)capacity * sizeof(RefWatch));
+        if (!grown) {
+            inotify_rm_watch(watcher->fd, wd);
+            return -1;
+        }
+        watcher->watches = grown;
+        watcher->watch_capacity = capacity;
+    }
+    RefWatch *watch = &watcher->watches[watcher->watch_count++];
+    watch->wd = wd;
+    watch->kinds = kind;
+    snprintf(watch->path, sizeof(watch->path), "%s", path);
+    return 0;
+}
+
+// Watches dir and every directory below it, so branches named like
+// feature/x are covered.
+static void add_ref_tree(RefWatcher *watcher, const char *dir) {
+    if (add_watch(watcher, dir, DIR_EVENTS | IN_ONLYDIR, WATCH_REFS) != 0) {
+        return;
+    }
+
+    DIR *d = opendir(dir);
+    if (!d) {
+        return;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(d))) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        char path[REF_WATCHER_PATH_SIZE];
+        struct stat st;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            add_ref_tree(watcher, path);
+        }
+    }
+    closedir(d);
+}
+
+static RefWatch *find_watch(RefWatcher *watcher, int wd) {
+    for (int i = 0; i < watcher->watch_count; i++) {
+        if (watcher->watches[i].wd == wd) {
+            return &watcher->watches[i];
+        }
+    }
+    return NULL;
+}
+
+static void drop_watch(RefWatcher *watcher, int wd) {
+    for (int i = 0; i < watcher->watch_count; i++) {
+        if (watcher->watches[i].wd == wd) {
+            watcher->watches[i] = watcher->watches[--watcher->watch_count];
+            return;
+        }
+    }
+}
+
+static int ends_with(const char *name, const char *suffix) {
+    size_t len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(name + len - suffix_len, suffix) == 0;
+}
+
+// Tells whether one event can move HEAD or a branch. The git dir also sees
+// index, ORIG_HEAD, FETCH_HEAD and lock file traffic, which is ignored.
+static int is_ref_event(RefWatcher *watcher, const struct inotify_event *event) {
+    if (event->mask & IN_Q_OVERFLOW) {
+        return 1;
+    }
+    if (event->mask & IN_IGNORED) {
+        drop_watch(watcher, event->wd);
+        return 0;
+    }
+
+    RefWatch *watch = find_watch(watcher, event->wd);
+    if (!watch || event->len == 0) {
+        return 0;
+    }
+    const char *name = event->name;
+
+    if (watch->kinds & WATCH_REFS) {
+        if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+            char path[REF_WATCHER_PATH_SIZE];
+            if (snprintf(path, sizeof(path), "%s/%s", watch->path, name) < (int)sizeof(path)) {
+                add_ref_tree(watcher, path);
+            }
+            return 0;
+        }
+        return !ends_with(name, ".lock");
+    }
+    if ((watch->kinds & (WATCH_GIT_DIR | WATCH_LOGS)) && strcmp(name, "HEAD") == 0) {
+        return 1;
+    }
+    if ((watch->kinds & WATCH_COMMON_DIR) && strcmp(name, "packed-refs") == 0) {
+        return 1;
+    }
+    return 0;
+}
+
+// Reads every queued event. Returns 1 when at least one of them is ref
+// related, 0 when none is and -1 on a read error.
+static int read_events(RefWatcher *watcher) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+
+    for (;;) {
+        ssize_t n = read(watcher->fd, buffer, sizeof(buffer));
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return changed;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            return changed;
+        }
+
+        for (char *p = buffer; p < buffer + n;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            watcher->events++;
+            if (is_ref_event(watcher, event)) {
+                changed = 1;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+int ref_watcher_open(RefWatcher *watcher, const char *git_dir, const char *common_dir) {
+    memset(watcher, 0, sizeof(*watcher));
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->fd < 0) {
+        perror("inotify_init1");
+        return -1;
+    }
+    if (!common_dir) {
+        common_dir = git_dir;
+    }
+
+    char path[REF_WATCHER_PATH_SIZE];
+    if (add_watch(watcher, git_dir, DIR_EVENTS | IN_ONLYDIR, WATCH_GIT_DIR) != 0 ||
+        add_watch(watcher, common_dir, DIR_EVENTS | IN_ONLYDIR, WATCH_COMMON_DIR) != 0) {
+        perror("inotify_add_watch");
+        ref_watcher_close(watcher);
+        return -1;
+    }
+
+    // logs/HEAD is appended to in place, so it also needs IN_MODIFY. It may
+    // not exist when core.logAllRefUpdates is off.
+    snprintf(path, sizeof(path), "%s/logs", git_dir);
+    add_watch(watcher, path, DIR_EVENTS | IN_MODIFY | IN_ONLYDIR, WATCH_LOGS);
+
+    snprintf(path, sizeof(path), "%s/refs/heads", common_dir);
+    add_ref_tree(watcher, path);
+    return 0;
+}
+
+int ref_watcher_wait(RefWatcher *watcher, int wake_fd, int timeout_ms) {
+    struct pollfd pfds[2] = {
+        { .fd = watcher->fd, .events = POLLIN },
+        { .fd = wake_fd, .events = POLLIN }
+    };
+
+    int rc = poll(pfds, wake_fd >= 0 ? 2 : 1, timeout_ms);
+    if (rc < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (rc == 0 || !(pfds[0].revents & POLLIN)) {
+        return 0;
+    }
+
+    int changed = read_events(watcher);
+    if (changed <= 0) {
+        return changed;
+    }
+    while (poll(pfds, 1, SETTLE_MS) > 0) {
+        if (read_events(watcher) < 0) {
+            break;
+        }
+    }
+    return 1;
+}
+
+void ref_watcher_close(RefWatcher *watcher) {
+    if (watcher->fd >= 0) {
+        close(watcher->fd);
+    }
+    watcher->fd = -1;
+    free(watcher->watches);
+    watcher->watches = NULL;
+    watcher->watch_count = 0;
+    watcher->watch_capacity = 0;
+}
@@ -0,0 +1,143 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "schema_blob.h"
+#include "hash_map.h"
+
+#define INITIAL_BUCKETS 1024
+
+// Process-wide intern table. Chained on SchemaBlob.next so the text is not
+// copied again as a key.
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static SchemaBlob **g_buckets = NULL;
+static size_t g_bucket_count = 0;
+static unsigned long g_blobs = 0;
+static unsigned long g_refs = 0;
+static unsigned long g_shared = 0;
+static size_t g_bytes = 0;
+
+static int grow_locked(void) {
+    size_t bucket_count = g_bucket_count ? g_bucket_count * 2 : INITIAL_BUCKETS;
+    SchemaBlob **buckets = calloc(bucket_count, sizeof(SchemaBlob *));
+    if (!buckets) {
+        return -1;
+    }
+    for (size_t i = 0; i < g_bucket_count; i++) {
+        SchemaBlob *blob = g_buckets[i];
+        while (blob) {
+            SchemaBlob *next = blob->next;
+            size_t slot = blob->hash & (bucket_count - 1);
+            blob->next = buckets[slot];
+            buckets[slot] = blob;
+            blob = next;
+        }
+    }
+    free(g_buckets);
+    g_buckets = buckets;
+    g_bucket_count = bucket_count;
+    return 0;
+}
+
+SchemaBlob *schema_blob_intern_len(const char *text, size_t len) {
+    uint64_t hash = hash_bytes(text, len);
+
+    pthread_mutex_lock(&g_lock);
+    if (!g_buckets && grow_locked() != 0) {
+        pthread_mutex_unlock(&g_lock);
+        return NULL;
+    }
+    for (SchemaBlob *blob = g_buckets[hash & (g_bucket_count - 1)]; blob; blob = blob->next) {
+        if (blob->hash == hash && blob->len == len && memcmp(blob->data, text, len) == 0) {
+            blob->refs++;
+            g_refs++;
+            g_shared++;
+            pthread_mutex_unlock(&g_lock);
+            return blob;
+        }
+    }
+
+    if (g_blobs >= g_bucket_count) {
+        grow_locked();
+    }
+    SchemaBlob *blob = malloc(sizeof(SchemaBlob) + len + 1);
+    if (!blob) {
+        pthread_mutex_unlock(&g_lock);
+        return NULL;
+    }
+    blob->hash = hash;
+    blob->len = len;
+    blob->refs = 1;
+    memcpy(blob->data, text, len);
+    blob->data[len] = '\0';
+    size_t slot = hash & (g_bucket_count - 1);
+    blob->next = g_buckets[slot];
+    g_buckets[slot] = blob;
+    g_blobs++;
+    g_refs++;
+    g_bytes += len + 1;
+    pthread_mutex_unlock(&g_lock);
+    return blob;
+}
+
+SchemaBlob *schema_blob_intern(const char *text) {
+    return text ? schema_blob_intern_len(text, strlen(text)) : NULL;
+}
+
+SchemaBlob *schema_blob_find(uint64_t hash, const char *text, size_t len) {
+    SchemaBlob *found = NULL;
+    pthread_mutex_lock(&g_lock);
+    if (g_buckets) {
+        for (SchemaBlob *blob = g_buckets[hash & (g_bucket_count - 1)]; blob; blob = blob->next) {
+            if (blob->hash == hash && blob->len == len && memcmp(blob->data, text, len) == 0) {
+                blob->refs++;
+                g_refs++;
+                found = blob;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    return found;
+}
+
+SchemaBlob *schema_blob_retain(SchemaBlob *blob) {
+    if (blob) {
+        pthread_mutex_lock(&g_lock);
+        blob->refs++;
+        g_refs++;
+        pthread_mutex_unlock(&g_lock);
+    }
+    return blob;
+}
+
+void schema_blob_release(SchemaBlob *blob) {
+    if (!blob) {
+        return;
+    }
+    pthread_mutex_lock(&g_lock);
+    g_refs--;
+    if (--blob->refs > 0) {
+        pthread_mutex_unlock(&g_lock);
+        return;
+    }
+    SchemaBlob **slot = &g_buckets[blob->hash & (g_bucket_count - 1)];
+    while (*slot && *slot != blob) {
+        slot = &(*slot)->next;
+    }
+    if (*slot) {
+        *slot = blob->next;
+    }
+    g_blobs--;
+    g_bytes -= blob->len + 1;
+    pthread_mutex_unlock(&g_lock);
+    free(blob);
+}
+
+void schema_blob_get_stats(SchemaBlobStats *stats) {
+    pthread_mutex_lock(&g_lock);
+    stats->blobs = g_blobs;
+    stats->refs = g_refs;
+    stats->bytes = g_bytes;
+    stats->shared = g_shared;
+    pthread_mutex_unlock(&g_lock);
+}
@@ -0,0 +1,196 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "schema_cache.h"
+#include "mysql_service.h"
+#include "file_util.h"
+
+static void free_entry(void *value) {
+    SchemaCacheEntry *entry = value;
+    if (entry) {
+        schema_blob_release(entry->blob);
+        free(entry);
+    }
+}
+
+static int same_file(const SchemaCacheEntry *entry, const struct stat *st) {
+    return entry->present &&
+           entry->ino == st->st_ino &&
+           entry->size == st->st_size &&
+           entry->mtime.tv_sec == st->st_mtim.tv_sec &&
+           entry->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void remember_stat(SchemaCacheEntry *entry, const struct stat *st) {
+    entry->present = 1;
+    entry->ino = st->st_ino;
+    entry->size = st->st_size;
+    entry->mtime = st->st_mtim;
+}
+
+static char *read_all(const char *path, off_t size) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return NULL;
+    }
+
+    char *buf = malloc((size_t)size + 1);
+    if (!buf) {
+        fclose(fp);
+        return NULL;
+    }
+    size_t n = fread(buf, 1, (size_t)size, fp);
+    fclose(fp);
+    buf[n] = '\0';
+    return buf;
+}
+
+// (Re)reads path into entry. A missing or empty file is cached as absent.
+static void load_entry(SchemaCache *cache, SchemaCacheEntry *entry, const char *path) {
+    struct stat st;
+    schema_blob_release(entry->blob);
+    entry->blob = NULL;
+    entry->present = 0;
+
+    if (stat(path, &st) != 0 || st.st_size == 0) {
+        return;
+    }
+
+    char *raw = read_all(path, st.st_size);
+    if (!raw) {
+        return;
+    }
+    char *normalized = normalize_schema(raw);
+    free(raw);
+    entry->blob = schema_blob_intern(normalized);
+    free(normalized);
+    if (entry->blob) {
+        remember_stat(entry, &st);
+    }
+    cache->loads++;
+}
+
+static SchemaCacheEntry *lookup(SchemaCache *cache, const char *path) {
+    SchemaCacheEntry *entry = hash_map_get(&cache->entries, path);
+    if (entry) {
+        return entry;
+    }
+
+    entry = calloc(1, sizeof(SchemaCacheEntry));
+    if (!entry) {
+        return NULL;
+    }
+    if (hash_map_put(&cache->entries, path, entry) != 0) {
+        free(entry);
+        return NULL;
+    }
+    load_entry(cache, entry, path);
+    return entry;
+}
+
+int schema_cache_init(SchemaCache *cache) {
+    cache->hits = 0;
+    cache->loads = 0;
+    pthread_mutex_init(&cache->lock, NULL);
+    return hash_map_init(&cache->entries, 1024);
+}
+
+void schema_cache_preload(SchemaCache *cache, const char *dir, const char *leaf) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(d))) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+
+        char path[512];
+        if (leaf) {
+            snprintf(path, sizeof(path), "%s/%s/%s", dir, ent->d_name, leaf);
+        } else {
+            size_t len = strlen(ent->d_name);
+            if (len < 4 || strcmp(ent->d_name + len - 4, ".sql") != 0) {
+                continue;
+            }
+            snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        }
+        pthread_mutex_lock(&cache->lock);
+        lookup(cache, path);
+        pthread_mutex_unlock(&cache->lock);
+    }
+    closedir(d);
+}
+
+static SchemaBlob *get_locked(SchemaCache *cache, const char *path) {
+    SchemaCacheEntry *entry = hash_map_get(&cache->entries, path);
+    if (!entry) {
+        entry = lookup(cache, path);
+        return entry ? entry->blob : NULL;
+    }
+
+    // Revalidate against the file so external edits are picked up.
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        if (entry->present) {
+            schema_blob_release(entry->blob);
+            entry->blob = NULL;
+            entry->present = 0;
+        }
+        return NULL;
+    }
+    if (!same_file(entry, &st)) {
+        load_entry(cache, entry, path);
+    } else {
+        cache->hits++;
+    }
+    return entry->blob;
+}
+
+SchemaBlob *schema_cache_get_blob(SchemaCache *cache, const char *path) {
+    pthread_mutex_lock(&cache->lock);
+    SchemaBlob *blob = schema_blob_retain(get_locked(cache, path));
+    pthread_mutex_unlock(&cache->lock);
+    return blob;
+}
+
+static int put_locked(SchemaCache *cache, const char *path, SchemaBlob *blob) {
+    SchemaCacheEntry *entry = lookup(cache, path);
+    SchemaBlob *current = entry ? get_locked(cache, path) : NULL;
+    if (current == blob) {
+        return 0;
+    }
+
+    if (write_file_atomic(path, blob->data, blob->len, 0) != 0) {
+        return -1;
+    }
+
+    if (!entry) {
+        return 1;
+    }
+
+    struct stat st;
+    schema_blob_release(entry->blob);
+    entry->blob = schema_blob_retain(blob);
+    entry->present = 0;
+    if (stat(path, &st) == 0) {
+        remember_stat(entry, &st);
+    }
+    return 1;
+}
+
+int schema_cache_put_blob(SchemaCache *cache, const char *path, SchemaBlob *blob) {
+    pthread_mutex_lock(&cache->lock);
+    int rc = put_locked(cache, path, blob);
+    pthread_mutex_unlock(&cache->lock);
+    return rc;
+}
+
+void schema_cache_free(SchemaCache *cache) {
+    hash_map_free(&cache->entries, free_entry);
+    pthread_mutex_destroy(&cache->lock);
+}
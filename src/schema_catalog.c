@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "schema_catalog.h"
+
+static int compare_tables(const void *a, const void *b) {
+    const CatalogTable *ta = a;
+    const CatalogTable *tb = b;
+    return strcmp(ta->name, tb->name);
+}
+
+static void free_table(CatalogTable *table) {
+    free(table->name);
+    free(table->fingerprint);
+    sb_free(&table->signature);
+    schema_blob_release(table->blob);
+}
+
+// Appends one result row as a tagged line: "<tag>|field|field|...\n".
+// The first column is the table name and is not part of the model.
+static int append_row(CatalogTable *table, const char *tag, char **row, unsigned int fields) {
+    if (sb_append(&table->signature, tag) != 0) {
+        return -1;
+    }
+    for (unsigned int i = 1; i < fields; i++) {
+        const char *value = row[i] ? row[i] : "\\N";
+        if (sb_append_len(&table->signature, "|", 1) != 0 ||
+            sb_append(&table->signature, value) != 0) {
+            return -1;
+        }
+    }
+    return sb_append_len(&table->signature, "\n", 1);
+}
+
+static CatalogTable *find_in(CatalogTable *tables, int count, const char *table_name) {
+    if (!tables || count == 0) {
+        return NULL;
+    }
+    CatalogTable key = { .name = (char *)table_name };
+    return bsearch(&key, tables, (size_t)count, sizeof(CatalogTable), compare_tables);
+}
+
+static int add_table(SchemaCatalog *out, const char *name, const char *fingerprint) {
+    if (out->tables_count >= out->capacity) {
+        int capacity = out->capacity ? out->capacity * 2 : 64;
+        CatalogTable *grown = realloc(out->tables, (size_t)capacity * sizeof(CatalogTable));
+        if (!grown) {
+            return -1;
+        }
+        out->tables = grown;
+        out->capacity = capacity;
+    }
+
+    CatalogTable *table = &out->tables[out->tables_count];
+    memset(table, 0, sizeof(*table));
+    table->name = strdup(name);
+    table->fingerprint = strdup(fingerprint ? fingerprint : "");
+    out->tables_count++;
+    return table->name && table->fingerprint ? 0 : -1;
+}
+
+static int add_fingerprint_row(char **row, unsigned int fields, void *arg) {
+    (void)fields;
+    if (!row[0]) {
+        return 0;
+    }
+    return add_table(arg, row[0], row[1]);
+}
+
+static int load_fingerprints(SchemaSource *source, const char *db_name, char **names, int count,
+                             SchemaCatalog *out) {
+    char *last = NULL;
+    for (;;) {
+        int rows = source->ops->fingerprints(source, db_name, names, count, last, out->page_size,
+                                             add_fingerprint_row, out);
+        if (rows < 0) {
+            free(last);
+            return -1;
+        }
+        if (out->page_size <= 0 || rows < out->page_size || out->tables_count == 0) {
+            break;
+        }
+        free(last);
+        last = strdup(out->tables[out->tables_count - 1].name);
+        if (!last) {
+            return -1;
+        }
+    }
+    free(last);
+
+    if (out->tables_count > 1) {
+        qsort(out->tables, (size_t)out->tables_count, sizeof(CatalogTable), compare_tables);
+    }
+    return 0;
+}
+
+typedef struct {
+    SchemaCatalog *catalog;
+    const char *tag;
+} ModelRows;
+
+// Appends a model row to the signature of its table. Rows for tables that
+// are not dirty, or that appeared after the fingerprints were read, are
+// ignored.
+static int add_model_row(char **row, unsigned int fields, void *arg) {
+    ModelRows *rows = arg;
+    if (!row[0]) {
+        return 0;
+    }
+    CatalogTable *table = find_in(rows->catalog->tables, rows->catalog->tables_count, row[0]);
+    if (table && table->dirty) {
+        return append_row(table, rows->tag, row, fields);
+    }
+    return 0;
+}
+
+static int load_models(SchemaSource *source, const char *db_name, SchemaCatalog *out, int dirty_count) {
+    static const char *tags[SOURCE_MODEL_COUNT] = { "T", "C", "I", "K" };
+
+    // The reads are limited to the dirty tables, unless every table is dirty
+    // and the filter would only cost parse time.
+    char **names = NULL;
+    if (dirty_count < out->tables_count) {
+        names = malloc((size_t)dirty_count * sizeof(char *));
+        if (!names) {
+            return -1;
+        }
+        int n = 0;
+        for (int i = 0; i < out->tables_count && n < dirty_count; i++) {
+            if (out->tables[i].dirty) {
+                names[n++] = out->tables[i].name;
+            }
+        }
+    }
+
+    int rc = 0;
+    for (int model = 0; model < SOURCE_MODEL_COUNT && rc == 0; model++) {
+        ModelRows rows = { out, tags[model] };
+        if (source->ops->model(source, db_name, (SourceModel)model, names, dirty_count, add_model_row, &rows) < 0) {
+            rc = -1;
+        }
+    }
+    free(names);
+    return rc;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Moves the tables that were not part of a targeted refresh from the old
+// catalog into the new one unchanged. Names are copied rather than moved so
+// the old catalog stays searchable.
+static int carry_untargeted(SchemaCatalog *catalog, SchemaCatalog *fresh, char **names, int count) {
+    for (int i = 0; i < catalog->tables_count; i++) {
+        CatalogTable *previous = &catalog->tables[i];
+        if (bsearch(&previous->name, names, (size_t)count, sizeof(char *), compare_names)) {
+            continue;
+        }
+        if (fresh->tables_count >= fresh->capacity) {
+            int capacity = fresh->capacity ? fresh->capacity * 2 : 64;
+            CatalogTable *grown = realloc(fresh->tables, (size_t)capacity * sizeof(CatalogTable));
+            if (!grown) {
+                return -1;
+            }
+            fresh->tables = grown;
+            fresh->capacity = capacity;
+        }
+        CatalogTable *table = &fresh->tables[fresh->tables_count++];
+        memset(table, 0, sizeof(*table));
+        table->name = strdup(previous->name);
+        if (!table->name) {
+            return -1;
+        }
+        table->fingerprint = previous->fingerprint;
+        table->signature = previous->signature;
+        table->blob = previous->blob;
+        previous->fingerprint = NULL;
+        sb_init(&previous->signature);
+        previous->blob = NULL;
+    }
+    if (fresh->tables_count > 1) {
+        qsort(fresh->tables, (size_t)fresh->tables_count, sizeof(CatalogTable), compare_tables);
+    }
+    return 0;
+}
+
+int catalog_refresh(SchemaSource *source, const char *db_name, SchemaCatalog *catalog) {
+    return catalog_refresh_tables(source, db_name, catalog, NULL, 0);
+}
+
+int catalog_refresh_tables(SchemaSource *source, const char *db_name, SchemaCatalog *catalog, char **names, int count) {
+    SchemaCatalog fresh = {0};
+    fresh.page_size = catalog->page_size;
+
+    if (names && count > 1) {
+        qsort(names, (size_t)count, sizeof(char *), compare_names);
+    }
+    if (load_fingerprints(source, db_name, names, count, &fresh) != 0) {
+        catalog_free(&fresh);
+        return -1;
+    }
+
+    // Tables with an unchanged fingerprint keep their model and schema as is.
+    int moved = 0;
+    int kept = 0;
+    for (int i = 0; i < fresh.tables_count; i++) {
+        CatalogTable *table = &fresh.tables[i];
+        CatalogTable *previous = find_in(catalog->tables, catalog->tables_count, table->name);
+        if (previous) {
+            kept++;
+        }
+        if (previous && previous->fingerprint &&
+            strcmp(previous->fingerprint, table->fingerprint) == 0) {
+            table->signature = previous->signature;
+            table->blob = previous->blob;
+            sb_init(&previous->signature);
+            previous->blob = NULL;
+        } else {
+            table->dirty = 1;
+            moved++;
+        }
+    }
+    int dropped = catalog->tables_count - kept;
+
+    if (names) {
+        int before = fresh.tables_count;
+        if (carry_untargeted(catalog, &fresh, names, count) != 0) {
+            catalog_free(&fresh);
+            return -1;
+        }
+        dropped -= fresh.tables_count - before;
+    }
+
+    if (moved > 0) {
+        if (load_models(source, db_name, &fresh, moved) != 0) {
+            catalog_free(&fresh);
+            return -1;
+        }
+
+        // A moved fingerprint does not always mean a new model (OPTIMIZE TABLE
+        // bumps CREATE_TIME, for example); keep the captured DDL when it does not.
+        for (int i = 0; i < fresh.tables_count; i++) {
+            CatalogTable *table = &fresh.tables[i];
+            if (!table->dirty) {
+                continue;
+            }
+            CatalogTable *previous = find_in(catalog->tables, catalog->tables_count, table->name);
+            if (previous && previous->blob &&
+                strcmp(sb_str(&previous->signature), sb_str(&table->signature)) == 0) {
+                table->blob = previous->blob;
+                previous->blob = NULL;
+            }
+        }
+    }
+
+    int dirty = 0;
+    for (int i = 0; i < fresh.tables_count; i++) {
+        fresh.tables[i].dirty = fresh.tables[i].blob == NULL;
+        dirty += fresh.tables[i].dirty;
+    }
+
+    catalog_free(catalog);
+    *catalog = fresh;
+    return dirty + dropped;
+}
+
+typedef struct {
+    char **list;
+    int capacity;
+    int count;
+} NameList;
+
+static int add_name_row(char **row, unsigned int fields, void *arg) {
+    NameList *names = arg;
+    (void)fields;
+    if (!row[0]) {
+        return 0;
+    }
+    if (names->count == names->capacity) {
+        int capacity = names->capacity ? names->capacity * 2 : 256;
+        char **grown = realloc(names->list, (size_t)capacity * sizeof(char *));
+        if (!grown) {
+            return -1;
+        }
+        names->list = grown;
+        names->capacity = capacity;
+    }
+    names->list[names->count] = strdup(row[0]);
+    if (!names->list[names->count]) {
+        return -1;
+    }
+    names->count++;
+    return 0;
+}
+
+int catalog_list_tables(SchemaSource *source, const char *db_name, int page_size, char ***names, int *count) {
+    NameList found = { NULL, 0, 0 };
+    *names = NULL;
+    *count = 0;
+
+    for (;;) {
+        const char *last = found.count > 0 ? found.list[found.count - 1] : NULL;
+        int rows = source->ops->table_names(source, db_name, last, page_size, add_name_row, &found);
+        if (rows < 0) {
+            break;
+        }
+        if (page_size <= 0 || rows < page_size || found.count == 0) {
+            *names = found.list ? found.list : calloc(1, sizeof(char *));
+            *count = found.count;
+            return *names ? 0 : -1;
+        }
+    }
+
+    for (int i = 0; i < found.count; i++) {
+        free(found.list[i]);
+    }
+    free(found.list);
+    return -1;
+}
+
+CatalogTable *catalog_find(SchemaCatalog *catalog, const char *table_name) {
+    if (!catalog || !table_name) {
+        return NULL;
+    }
+    return find_in(catalog->tables, catalog->tables_count, table_name);
+}
+
+void catalog_free(SchemaCatalog *catalog) {
+    if (!catalog) {
+        return;
+    }
+    for (int i = 0; i < catalog->tables_count; i++) {
+        free_table(&catalog->tables[i]);
+    }
+    free(catalog->tables);
+    catalog->tables = NULL;
+    catalog->tables_count = 0;
+    catalog->capacity = 0;
+}
@@ -0,0 +1,202 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "schema_diff.h"
+#include "hash_map.h"
+#include "schema_model.h"
+
+// Open-addressing set of the distinct lines of one side. Slots hold -1 when
+// empty; duplicate lines keep their first occurrence.
+typedef struct {
+    int *slots;
+    size_t mask;
+} LineIndex;
+
+static int index_build(LineIndex *index, const SchemaLines *lines) {
+    size_t size = 16;
+    while (size < (size_t)lines->count * 2) {
+        size *= 2;
+    }
+    index->slots = malloc(size * sizeof(int));
+    if (!index->slots) {
+        return -1;
+    }
+    memset(index->slots, 0xff, size * sizeof(int));
+    index->mask = size - 1;
+
+    for (int i = 0; i < lines->count; i++) {
+        const SchemaLine *line = &lines->lines[i];
+        size_t slot = line->hash & index->mask;
+        while (index->slots[slot] >= 0) {
+            const SchemaLine *other = &lines->lines[index->slots[slot]];
+            if (other->len == line->len && memcmp(other->text, line->text, line->len) == 0) {
+                break;
+            }
+            slot = (slot + 1) & index->mask;
+        }
+        if (index->slots[slot] < 0) {
+            index->slots[slot] = i;
+        }
+    }
+    return 0;
+}
+
+static int index_contains(const LineIndex *index, const SchemaLines *lines, const SchemaLine *line) {
+    size_t slot = line->hash & index->mask;
+    while (index->slots[slot] >= 0) {
+        const SchemaLine *other = &lines->lines[index->slots[slot]];
+        if (other->hash == line->hash && other->len == line->len && memcmp(other->text, line->text, line->len) == 0) {
+            return 1;
+        }
+        slot = (slot + 1) & index->mask;
+    }
+    return 0;
+}
+
+int schema_lines_parse(const char *schema, SchemaLines *out) {
+    memset(out, 0, sizeof(*out));
+    if (!schema) {
+        return 0;
+    }
+
+    out->buffer = strdup(schema);
+    if (!out->buffer) {
+        return -1;
+    }
+
+    int capacity = 16;
+    out->lines = malloc((size_t)capacity * sizeof(SchemaLine));
+    if (!out->lines) {
+        schema_lines_free(out);
+        return -1;
+    }
+
+    char *cursor = out->buffer;
+    while (*cursor) {
+        char *end = strchr(cursor, '\n');
+        char *next = end ? end + 1 : cursor + strlen(cursor);
+        if (end) {
+            *end = '\0';
+        } else {
+            end = next;
+        }
+
+        // Empty segments between consecutive newlines are not lines.
+        if (end != cursor) {
+            while (isspace((unsigned char)*cursor)) cursor++;
+            char *last = end - 1;
+            while (last >= cursor && (isspace((unsigned char)*last) || *last == ',')) last--;
+            last[1] = '\0';
+
+            if (out->count >= capacity) {
+                capacity *= 2;
+                SchemaLine *grown = realloc(out->lines, (size_t)capacity * sizeof(SchemaLine));
+                if (!grown) {
+                    schema_lines_free(out);
+                    return -1;
+                }
+                out->lines = grown;
+            }
+            SchemaLine *line = &out->lines[out->count++];
+            line->text = cursor;
+            line->len = (size_t)(last + 1 - cursor);
+            line->hash = hash_bytes(line->text, line->len);
+        }
+        cursor = next;
+    }
+    return 0;
+}
+
+void schema_lines_free(SchemaLines *lines) {
+    free(lines->buffer);
+    free(lines->lines);
+    memset(lines, 0, sizeof(*lines));
+}
+
+size_t schema_line_column(const SchemaLine *line, const char **name) {
+    const char *start = memchr(line->text, '`', line->len);
+    if (!start) {
+        return 0;
+    }
+    start++;
+    const char *end = memchr(start, '`', line->len - (size_t)(start - line->text));
+    if (!end) {
+        return 0;
+    }
+    *name = start;
+    return (size_t)(end - start);
+}
+
+int schema_diff_lines(const SchemaLines *old_lines, const SchemaLines *new_lines, SchemaLineDiff *diff) {
+    memset(diff, 0, sizeof(*diff));
+    LineIndex old_index;
+    LineIndex new_index;
+    if (index_build(&old_index, old_lines) != 0) {
+        return -1;
+    }
+    if (index_build(&new_index, new_lines) != 0) {
+        free(old_index.slots);
+        return -1;
+    }
+
+    for (int i = 0; i < new_lines->count; i++) {
+        diff->added_count += !index_contains(&old_index, old_lines, &new_lines->lines[i]);
+    }
+    for (int i = 0; i < old_lines->count; i++) {
+        diff->removed_count += !index_contains(&new_index, new_lines, &old_lines->lines[i]);
+    }
+    free(old_index.slots);
+    free(new_index.slots);
+    return 0;
+}
+
+// Same lines in the same order; the common case of an untouched schema
+// costs one pass over the precomputed hashes and no allocation.
+static int same_lines(const SchemaLines *a, const SchemaLines *b) {
+    if (a->count != b->count) {
+        return 0;
+    }
+    for (int i = 0; i < a->count; i++) {
+        const SchemaLine *x = &a->lines[i];
+        const SchemaLine *y = &b->lines[i];
+        if (x->hash != y->hash || x->len != y->len || memcmp(x->text, y->text, x->len) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void generate_alter_statements(const char *table_name, const char *old_schema, const char *new_schema, StrBuf *up_sql, StrBuf *down_sql) {
+    SchemaLines old_lines;
+    SchemaLines new_lines;
+    SchemaLineDiff diff;
+
+    if (schema_lines_parse(old_schema, &old_lines) != 0) {
+        return;
+    }
+    if (schema_lines_parse(new_schema, &new_lines) != 0) {
+        schema_lines_free(&old_lines);
+        return;
+    }
+
+    // The line diff only decides whether the models are worth building;
+    // the models then work out what each added and removed line means.
+    if (!same_lines(&old_lines, &new_lines) && schema_diff_lines(&old_lines, &new_lines, &diff) == 0) {
+        int changed = diff.added_count + diff.removed_count;
+
+        TableModel old_model;
+        TableModel new_model;
+        if (changed > 0 && table_model_parse(&old_lines, &old_model) == 0) {
+            if (table_model_parse(&new_lines, &new_model) == 0) {
+                table_model_alter(table_name, &old_model, &new_model, up_sql);
+                table_model_alter(table_name, &new_model, &old_model, down_sql);
+                table_model_free(&new_model);
+            }
+            table_model_free(&old_model);
+        }
+    }
+
+    schema_lines_free(&old_lines);
+    schema_lines_free(&new_lines);
+}
@@ -0,0 +1,606 @@
+#include <ctype.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "schema_model.h"
+#include "hash_map.h"
+
+static const char *HINT_ONLINE = ", ALGORITHM=INPLACE, LOCK=NONE";
+static const char *HINT_SHARED = ", ALGORITHM=INPLACE, LOCK=SHARED";
+static const char *HINT_NONE = "";
+
+// Words that end the data type of a column definition in SHOW CREATE TABLE
+// output; character set and collation stay part of the type.
+static const char *COLUMN_STOP_WORDS[] = {
+    "NOT", "NULL", "DEFAULT", "AUTO_INCREMENT", "COMMENT", "ON", "GENERATED", "AS",
+    "VIRTUAL", "STORED", "INVISIBLE", "VISIBLE", "SRID", "COLUMN_FORMAT", "STORAGE",
+    "PRIMARY", "UNIQUE", "KEY", "CHECK", "REFERENCES", NULL
+};
+
+static const struct {
+    const char *prefix;
+    IndexKind kind;
+} INDEX_PREFIXES[] = {
+    { "UNIQUE KEY ", INDEX_UNIQUE },
+    { "UNIQUE INDEX ", INDEX_UNIQUE },
+    { "FULLTEXT KEY ", INDEX_FULLTEXT },
+    { "FULLTEXT INDEX ", INDEX_FULLTEXT },
+    { "SPATIAL KEY ", INDEX_SPATIAL },
+    { "SPATIAL INDEX ", INDEX_SPATIAL },
+    { "KEY ", INDEX_PLAIN },
+    { "INDEX ", INDEX_PLAIN },
+};
+
+// Returns the next whitespace separated token of a definition. Quoted strings
+// and parenthesized groups are kept whole, so "enum('a b','c')" and
+// "DEFAULT _utf8mb4'x y'" split the way MySQL would read them.
+static size_t next_token(const char **cursor, const char **start) {
+    const char *p = *cursor;
+    while (isspace((unsigned char)*p)) p++;
+    *start = p;
+
+    int depth = 0;
+    char quote = 0;
+    while (*p) {
+        if (quote) {
+            if (*p == '\\' && quote != '`' && p[1]) {
+                p++;
+            } else if (*p == quote) {
+                quote = 0;
+            }
+        } else if (*p == '\'' || *p == '"' || *p == '`') {
+            quote = *p;
+        } else if (*p == '(') {
+            depth++;
+        } else if (*p == ')') {
+            depth--;
+        } else if (isspace((unsigned char)*p) && depth <= 0) {
+            break;
+        }
+        p++;
+    }
+
+    *cursor = p;
+    return (size_t)(p - *start);
+}
+
+static int token_is(const char *token, size_t len, const char *word) {
+    return strlen(word) == len && strncasecmp(token, word, len) == 0;
+}
+
+static int is_stop_word(const char *token, size_t len) {
+    for (int i = 0; COLUMN_STOP_WORDS[i]; i++) {
+        if (token_is(token, len, COLUMN_STOP_WORDS[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static char *copy_span(const char *text, size_t len) {
+    char *copy = malloc(len + 1);
+    if (copy) {
+        memcpy(copy, text, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+// Appends a token to a space separated, heap allocated list.
+static int join_token(char **dst, const char *token, size_t len) {
+    size_t old_len = *dst ? strlen(*dst) : 0;
+    char *grown = realloc(*dst, old_len + len + 2);
+    if (!grown) {
+        return -1;
+    }
+    if (old_len > 0) {
+        grown[old_len++] = ' ';
+    }
+    memcpy(grown + old_len, token, len);
+    grown[old_len + len] = '\0';
+    *dst = grown;
+    return 0;
+}
+
+// Splits "<name> <rest>" where name is the first backtick-quoted identifier.
+static const char *split_name(const SchemaLine *line, char **name) {
+    const char *start;
+    size_t len = schema_line_column(line, &start);
+    if (len == 0) {
+        return NULL;
+    }
+    *name = copy_span(start, len);
+    const char *rest = start + len + 1;
+    while (isspace((unsigned char)*rest)) rest++;
+    return rest;
+}
+
+static int parse_column(const SchemaLine *line, int position, ColumnDef *column) {
+    memset(column, 0, sizeof(*column));
+    const char *rest = split_name(line, &column->name);
+    if (!rest || !column->name) {
+        return -1;
+    }
+    column->definition = strdup(rest);
+    column->nullable = 1;
+    column->position = position;
+    column->line = line;
+
+    const char *cursor = rest;
+    const char *token;
+    size_t len;
+    int in_type = 1;
+    while ((len = next_token(&cursor, &token)) > 0) {
+        if (in_type && !is_stop_word(token, len)) {
+            if (join_token(&column->type, token, len) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        in_type = 0;
+
+        if (token_is(token, len, "NOT")) {
+            const char *peek = cursor;
+            const char *next;
+            size_t next_len = next_token(&peek, &next);
+            if (token_is(next, next_len, "NULL")) {
+                column->nullable = 0;
+                cursor = peek;
+                continue;
+            }
+        } else if (token_is(token, len, "NULL")) {
+            column->nullable = 1;
+            continue;
+        } else if (token_is(token, len, "DEFAULT")) {
+            const char *value;
+            size_t value_len = next_token(&cursor, &value);
+            free(column->default_value);
+            column->default_value = copy_span(value, value_len);
+            continue;
+        }
+        if (join_token(&column->attributes, token, len) != 0) {
+            return -1;
+        }
+    }
+
+    if (!column->definition) {
+        return -1;
+    }
+    if (!column->type) {
+        column->type = strdup("");
+    }
+    if (!column->attributes) {
+        column->attributes = strdup("");
+    }
+    return (column->type && column->attributes) ? 0 : -1;
+}
+
+static int parse_index(const SchemaLine *line, IndexDef *index) {
+    memset(index, 0, sizeof(*index));
+    index->line = line;
+
+    if (strncmp(line->text, "PRIMARY KEY", 11) == 0) {
+        const char *rest = line->text + 11;
+        while (isspace((unsigned char)*rest)) rest++;
+        index->kind = INDEX_PRIMARY;
+        index->name = strdup("PRIMARY");
+        index->definition = strdup(rest);
+        return (index->name && index->definition) ? 1 : -1;
+    }
+
+    for (size_t i = 0; i < sizeof(INDEX_PREFIXES) / sizeof(INDEX_PREFIXES[0]); i++) {
+        if (strncmp(line->text, INDEX_PREFIXES[i].prefix, strlen(INDEX_PREFIXES[i].prefix)) == 0) {
+            const char *rest = split_name(line, &index->name);
+            if (!rest || !index->name) {
+                free(index->name);
+                return -1;
+            }
+            index->kind = INDEX_PREFIXES[i].kind;
+            index->definition = strdup(rest);
+            return index->definition ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+static int parse_constraint(const SchemaLine *line, ConstraintDef *constraint) {
+    memset(constraint, 0, sizeof(*constraint));
+    if (strncmp(line->text, "CONSTRAINT ", 11) != 0) {
+        return 0;
+    }
+
+    const char *rest = split_name(line, &constraint->name);
+    if (!rest || !constraint->name) {
+        free(constraint->name);
+        return -1;
+    }
+    constraint->kind = strncmp(rest, "FOREIGN KEY", 11) == 0 ? CONSTRAINT_FOREIGN_KEY : CONSTRAINT_CHECK;
+    constraint->definition = strdup(rest);
+    constraint->line = line;
+    return constraint->definition ? 1 : -1;
+}
+
+int table_model_parse(const SchemaLines *lines, TableModel *model) {
+    memset(model, 0, sizeof(*model));
+    if (lines->count == 0 || strncmp(lines->lines[0].text, "CREATE TABLE", 12) != 0) {
+        return -1;
+    }
+
+    // Every definition lives on its own line, so the line count bounds all
+    // three arrays.
+    size_t n = (size_t)lines->count;
+    model->columns = calloc(n, sizeof(ColumnDef));
+    model->indexes = calloc(n, sizeof(IndexDef));
+    model->constraints = calloc(n, sizeof(ConstraintDef));
+    if (!model->columns || !model->indexes || !model->constraints) {
+        table_model_free(model);
+        return -1;
+    }
+
+    for (int i = 1; i < lines->count; i++) {
+        const SchemaLine *line = &lines->lines[i];
+        if (line->text[0] == '`') {
+            ColumnDef *column = &model->columns[model->column_count];
+            model->column_count++;
+            if (parse_column(line, model->column_count - 1, column) != 0) {
+                table_model_free(model);
+                return -1;
+            }
+            continue;
+        }
+
+        int rc = parse_index(line, &model->indexes[model->index_count]);
+        if (rc > 0) {
+            model->index_count++;
+            continue;
+        }
+        if (rc == 0) {
+            rc = parse_constraint(line, &model->constraints[model->constraint_count]);
+            if (rc > 0) {
+                model->constraint_count++;
+                continue;
+            }
+        }
+        if (rc < 0) {
+            table_model_free(model);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void table_model_free(TableModel *model) {
+    for (int i = 0; model->columns && i < model->column_count; i++) {
+        ColumnDef *column = &model->columns[i];
+        free(column->name);
+        free(column->definition);
+        free(column->type);
+        free(column->default_value);
+        free(column->attributes);
+    }
+    for (int i = 0; model->indexes && i < model->index_count; i++) {
+        free(model->indexes[i].name);
+        free(model->indexes[i].definition);
+    }
+    for (int i = 0; model->constraints && i < model->constraint_count; i++) {
+        free(model->constraints[i].name);
+        free(model->constraints[i].definition);
+    }
+    free(model->columns);
+    free(model->indexes);
+    free(model->constraints);
+    memset(model, 0, sizeof(*model));
+}
+
+__attribute__((format(printf, 4, 5)))
+static void emit(StrBuf *out_sql, const char *table_name, const char *hint, const char *fmt, ...) {
+    va_list args;
+    sb_appendf(out_sql, "ALTER TABLE `%s` ", table_name);
+    va_start(args, fmt);
+    sb_vappendf(out_sql, fmt, args);
+    va_end(args);
+    sb_appendf(out_sql, "%s;\n", hint);
+}
+
+// Name -> index + 1 lookups over one side of the comparison.
+static int index_names(HashMap *map, const void *items, size_t item_size, size_t name_offset, int count) {
+    if (hash_map_init(map, (size_t)count * 2) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        const char *item = (const char *)items + (size_t)i * item_size;
+        const char *name = *(char *const *)(item + name_offset);
+        if (hash_map_put(map, name, (void *)(intptr_t)(i + 1)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int lookup_name(const HashMap *map, const char *name) {
+    return (int)(intptr_t)hash_map_get(map, name) - 1;
+}
+
+static int parse_varchar(const char *type, long *length, const char **suffix) {
+    if (strncasecmp(type, "varchar(", 8) != 0) {
+        return 0;
+    }
+    char *end;
+    *length = strtol(type + 8, &end, 10);
+    if (*end != ')') {
+        return 0;
+    }
+    *suffix = end + 1;
+    return 1;
+}
+
+// VARCHAR can grow in place as long as its length prefix stays one byte
+// (at most 255 bytes, i.e. 63 characters in utf8mb4) or was already two.
+static int varchar_widens_in_place(const char *from_type, const char *to_type) {
+    long from_len;
+    long to_len;
+    const char *from_suffix;
+    const char *to_suffix;
+    if (!parse_varchar(from_type, &from_len, &from_suffix) ||
+        !parse_varchar(to_type, &to_len, &to_suffix) ||
+        strcmp(from_suffix, to_suffix) != 0 || to_len < from_len) {
+        return 0;
+    }
+    return (to_len <= 63) || (from_len > 255);
+}
+
+// Appending members to the end of an ENUM or SET is a metadata change as
+// long as the storage size does not grow; stay well below that boundary.
+static int enum_appends_in_place(const char *from_type, const char *to_type) {
+    int is_enum = strncasecmp(from_type, "enum(", 5) == 0 && strncasecmp(to_type, "enum(", 5) == 0;
+    int is_set = strncasecmp(from_type, "set(", 4) == 0 && strncasecmp(to_type, "set(", 4) == 0;
+    size_t from_len = strlen(from_type);
+    if ((!is_enum && !is_set) || from_len < 2 || from_type[from_len - 1] != ')') {
+        return 0;
+    }
+    if (strncmp(from_type, to_type, from_len - 1) != 0 || to_type[from_len - 1] != ',') {
+        return 0;
+    }
+
+    int members = 1;
+    for (const char *p = to_type; *p; p++) {
+        members += *p == ',';
+    }
+    return is_enum ? members <= 255 : members <= 8;
+}
+
+static int has_word(const char *text, const char *word) {
+    const char *cursor = text;
+    const char *token;
+    size_t len;
+    while ((len = next_token(&cursor, &token)) > 0) {
+        if (token_is(token, len, word)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void emit_column_change(StrBuf *out_sql, const char *table_name, const ColumnDef *from, const ColumnDef *to) {
+    int same_type = strcmp(from->type, to->type) == 0;
+    int same_attributes = strcmp(from->attributes, to->attributes) == 0;
+
+    // A default-only change is a metadata update.
+    if (same_type && same_attributes && from->nullable == to->nullable) {
+        if (to->default_value) {
+            emit(out_sql, table_name, HINT_ONLINE, "ALTER COLUMN `%s` SET DEFAULT %s", to->name, to->default_value);
+        } else {
+            emit(out_sql, table_name, HINT_ONLINE, "ALTER COLUMN `%s` DROP DEFAULT", to->name);
+        }
+        return;
+    }
+
+    int online = (same_type || varchar_widens_in_place(from->type, to->type) ||
+                  enum_appends_in_place(from->type, to->type)) &&
+                 has_word(from->attributes, "AUTO_INCREMENT") == has_word(to->attributes, "AUTO_INCREMENT") &&
+                 !has_word(to->attributes, "STORED");
+    emit(out_sql, table_name, online ? HINT_ONLINE : HINT_NONE, "MODIFY COLUMN %s", to->line->text);
+}
+
+static void emit_column_add(StrBuf *out_sql, const char *table_name, const TableModel *to, int index) {
+    const ColumnDef *column = &to->columns[index];
+    char position[300] = "";
+    if (index == 0) {
+        snprintf(position, sizeof(position), " FIRST");
+    } else if (index < to->column_count - 1) {
+        snprintf(position, sizeof(position), " AFTER `%s`", to->columns[index - 1].name);
+    }
+
+    int online = !has_word(column->attributes, "AUTO_INCREMENT") && !has_word(column->attributes, "STORED");
+    emit(out_sql, table_name, online ? HINT_ONLINE : HINT_NONE, "ADD COLUMN %s%s", column->line->text, position);
+}
+
+// A renamed column would keep its place: either its position or the column
+// right before it is the same on both sides.
+static int same_anchor(const TableModel *from, int f, const TableModel *to, int t) {
+    if (from->columns[f].position == to->columns[t].position) {
+        return 1;
+    }
+    if (f == 0 || t == 0) {
+        return 0;
+    }
+    return strcmp(from->columns[f - 1].name, to->columns[t - 1].name) == 0;
+}
+
+// Pairs a column that only exists in from with one that only exists in to
+// when both have the same definition and the same anchor. Such a pair looks
+// like a rename but is just as likely a dropped column and an unrelated new
+// one of the same type, so it is only pointed out, never applied.
+static void match_renames(const TableModel *from, const TableModel *to,
+                          const HashMap *from_names, const HashMap *to_names,
+                          int *from_rename, int *to_rename) {
+    for (int t = 0; t < to->column_count; t++) {
+        if (lookup_name(from_names, to->columns[t].name) >= 0) {
+            continue;
+        }
+        for (int f = 0; f < from->column_count; f++) {
+            if (from_rename[f] < 0 && lookup_name(to_names, from->columns[f].name) < 0 &&
+                strcmp(from->columns[f].definition, to->columns[t].definition) == 0 &&
+                same_anchor(from, f, to, t)) {
+                from_rename[f] = t;
+                to_rename[t] = f;
+                break;
+            }
+        }
+    }
+}
+
+void table_model_alter(const char *table_name, const TableModel *from, const TableModel *to, StrBuf *out_sql) {
+    HashMap from_columns = {0};
+    HashMap to_columns = {0};
+    HashMap from_indexes = {0};
+    HashMap to_indexes = {0};
+    HashMap from_constraints = {0};
+    HashMap to_constraints = {0};
+    int *from_rename = malloc(((size_t)from->column_count + 1) * sizeof(int));
+    int *to_rename = malloc(((size_t)to->column_count + 1) * sizeof(int));
+    int *index_renamed = calloc((size_t)from->index_count + 1, sizeof(int));
+    int *index_rename_target = calloc((size_t)to->index_count + 1, sizeof(int));
+
+    if (!from_rename || !to_rename || !index_renamed || !index_rename_target ||
+        index_names(&from_columns, from->columns, sizeof(ColumnDef), offsetof(ColumnDef, name), from->column_count) != 0 ||
+        index_names(&to_columns, to->columns, sizeof(ColumnDef), offsetof(ColumnDef, name), to->column_count) != 0 ||
+        index_names(&from_indexes, from->indexes, sizeof(IndexDef), offsetof(IndexDef, name), from->index_count) != 0 ||
+        index_names(&to_indexes, to->indexes, sizeof(IndexDef), offsetof(IndexDef, name), to->index_count) != 0 ||
+        index_names(&from_constraints, from->constraints, sizeof(ConstraintDef), offsetof(ConstraintDef, name), from->constraint_count) != 0 ||
+        index_names(&to_constraints, to->constraints, sizeof(ConstraintDef), offsetof(ConstraintDef, name), to->constraint_count) != 0) {
+        goto cleanup;
+    }
+    memset(from_rename, 0xff, ((size_t)from->column_count + 1) * sizeof(int));
+    memset(to_rename, 0xff, ((size_t)to->column_count + 1) * sizeof(int));
+    match_renames(from, to, &from_columns, &to_columns, from_rename, to_rename);
+
+    // Indexes that only changed name become RENAME INDEX.
+    for (int t = 0; t < to->index_count; t++) {
+        const IndexDef *index = &to->indexes[t];
+        if (lookup_name(&from_indexes, index->name) >= 0 || index->kind == INDEX_PRIMARY) {
+            continue;
+        }
+        for (int f = 0; f < from->index_count; f++) {
+            const IndexDef *old = &from->indexes[f];
+            if (!index_renamed[f] && old->kind == index->kind &&
+                lookup_name(&to_indexes, old->name) < 0 &&
+                strcmp(old->definition, index->definition) == 0) {
+                index_renamed[f] = 1;
+                index_rename_target[t] = f + 1;
+                break;
+            }
+        }
+    }
+
+    // 1. Drop foreign keys and checks that go away or change; they can pin
+    //    the columns and indexes touched below.
+    for (int f = 0; f < from->constraint_count; f++) {
+        const ConstraintDef *constraint = &from->constraints[f];
+        int t = lookup_name(&to_constraints, constraint->name);
+        if (t >= 0 && strcmp(to->constraints[t].definition, constraint->definition) == 0) {
+            continue;
+        }
+        if (constraint->kind == CONSTRAINT_FOREIGN_KEY) {
+            emit(out_sql, table_name, HINT_ONLINE, "DROP FOREIGN KEY `%s`", constraint->name);
+        } else {
+            emit(out_sql, table_name, HINT_NONE, "DROP CHECK `%s`", constraint->name);
+        }
+    }
+
+    // 2. Drop secondary indexes that go away or change.
+    for (int f = 0; f < from->index_count; f++) {
+        const IndexDef *index = &from->indexes[f];
+        int t = lookup_name(&to_indexes, index->name);
+        if (index_renamed[f] || index->kind == INDEX_PRIMARY ||
+            (t >= 0 && to->indexes[t].kind == index->kind &&
+             strcmp(to->indexes[t].definition, index->definition) == 0)) {
+            continue;
+        }
+        emit(out_sql, table_name, HINT_ONLINE, "DROP INDEX `%s`", index->name);
+    }
+
+    // 3. Drop the columns that are gone. A drop that looks like a rename
+    //    gets a comment with the statement that would keep the data.
+    for (int f = 0; f < from->column_count; f++) {
+        if (lookup_name(&to_columns, from->columns[f].name) >= 0) {
+            continue;
+        }
+        if (from_rename[f] >= 0) {
+            sb_appendf(out_sql, "-- possible rename: ALTER TABLE `%s` RENAME COLUMN `%s` TO `%s`%s;\n", table_name,
+                       from->columns[f].name, to->columns[from_rename[f]].name, HINT_ONLINE);
+        }
+        emit(out_sql, table_name, HINT_ONLINE, "DROP COLUMN `%s`", from->columns[f].name);
+    }
+
+    // 4. Added and modified columns in their final order. Reordering of
+    //    columns that exist on both sides is not expressed.
+    for (int t = 0; t < to->column_count; t++) {
+        const ColumnDef *column = &to->columns[t];
+        int f = lookup_name(&from_columns, column->name);
+        if (f >= 0) {
+            if (strcmp(from->columns[f].definition, column->definition) != 0) {
+                emit_column_change(out_sql, table_name, &from->columns[f], column);
+            }
+        } else {
+            emit_column_add(out_sql, table_name, to, t);
+        }
+    }
+
+    // 5. Primary key, new and changed indexes, renamed indexes.
+    int from_pk = lookup_name(&from_indexes, "PRIMARY");
+    int to_pk = lookup_name(&to_indexes, "PRIMARY");
+    if (from_pk >= 0 && to_pk < 0) {
+        // Dropping the primary key without a replacement requires a copy.
+        emit(out_sql, table_name, HINT_NONE, "DROP PRIMARY KEY");
+    } else if (to_pk >= 0 && from_pk < 0) {
+        emit(out_sql, table_name, HINT_ONLINE, "ADD %s", to->indexes[to_pk].line->text);
+    } else if (to_pk >= 0 && strcmp(from->indexes[from_pk].definition, to->indexes[to_pk].definition) != 0) {
+        emit(out_sql, table_name, HINT_ONLINE, "DROP PRIMARY KEY, ADD %s", to->indexes[to_pk].line->text);
+    }
+    for (int t = 0; t < to->index_count; t++) {
+        const IndexDef *index = &to->indexes[t];
+        if (index->kind == INDEX_PRIMARY) {
+            continue;
+        }
+        if (index_rename_target[t]) {
+            emit(out_sql, table_name, HINT_ONLINE, "RENAME INDEX `%s` TO `%s`",
+                 from->indexes[index_rename_target[t] - 1].name, index->name);
+            continue;
+        }
+        int f = lookup_name(&from_indexes, index->name);
+        if (f >= 0 && from->indexes[f].kind == index->kind &&
+            strcmp(from->indexes[f].definition, index->definition) == 0) {
+            continue;
+        }
+        int shared = index->kind == INDEX_FULLTEXT || index->kind == INDEX_SPATIAL;
+        emit(out_sql, table_name, shared ? HINT_SHARED : HINT_ONLINE, "ADD %s", index->line->text);
+    }
+
+    // 6. New and changed constraints. Adding a foreign key with
+    //    foreign_key_checks enabled is a table copy, so no hint.
+    for (int t = 0; t < to->constraint_count; t++) {
+        const ConstraintDef *constraint = &to->constraints[t];
+        int f = lookup_name(&from_constraints, constraint->name);
+        if (f >= 0 && strcmp(from->constraints[f].definition, constraint->definition) == 0) {
+            continue;
+        }
+        emit(out_sql, table_name, HINT_NONE, "ADD %s", constraint->line->text);
+    }
+
+cleanup:
+    hash_map_free(&from_columns, NULL);
+    hash_map_free(&to_columns, NULL);
+    hash_map_free(&from_indexes, NULL);
+    hash_map_free(&to_indexes, NULL);
+    hash_map_free(&from_constraints, NULL);
+    hash_map_free(&to_constraints, NULL);
+    free(from_rename);
+    free(to_rename);
+    free(index_renamed);
+    free(index_rename_target);
+}
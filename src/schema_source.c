@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "schema_source.h"
+#include "metrics.h"
+
+// Each subquery folds one information_schema view into "<rows>:<crc sum>" so
+// that any change to a column, index or constraint moves the fingerprint.
+// Covered: table options and comment; column name, position, type,
+// nullability, default, extra, collation, comment and generated expression;
+// index columns or expressions, order, uniqueness, prefix, type, visibility
+// and comment; key and foreign key columns and rules; CHECK constraint
+// names, clauses and enforcement. CHECK constraints and index visibility
+// need MySQL 8.0.16.
+// UPDATE_TIME is left out on purpose: it moves on every DML write.
+static const char *FINGERPRINT_QUERY =
+    "SELECT t.table_name, CONCAT_WS('/', t.table_type, t.engine, t.create_time, "
+    "t.table_collation, t.create_options, CRC32(t.table_comment), "
+    "(SELECT CONCAT(COUNT(*), ':', IFNULL(SUM(CRC32(CONCAT_WS('|', c.ordinal_position, "
+    "c.column_name, c.column_type, c.is_nullable, IFNULL(c.column_default, '~'), c.extra, "
+    "IFNULL(c.collation_name, '~'), c.column_comment, IFNULL(c.generation_expression, '~')))), 0)) "
+    "FROM information_schema.columns c "
+    "WHERE c.table_schema = t.table_schema AND c.table_name = t.table_name), "
+    "(SELECT CONCAT(COUNT(*), ':', IFNULL(SUM(CRC32(CONCAT_WS('|', s.index_name, "
+    "s.seq_in_index, IFNULL(s.column_name, '~'), s.non_unique, IFNULL(s.sub_part, '~'), "
+    "IFNULL(s.collation, '~'), s.index_type, s.is_visible, s.index_comment, "
+    "IFNULL(s.expression, '~')))), 0)) "
+    "FROM information_schema.statistics s "
+    "WHERE s.table_schema = t.table_schema AND s.table_name = t.table_name), "
+    "(SELECT CONCAT(COUNT(*), ':', IFNULL(SUM(CRC32(CONCAT_WS('|', k.constraint_name, "
+    "k.column_name, IFNULL(k.referenced_table_name, '~'), "
+    "IFNULL(k.referenced_column_name, '~')))), 0)) "
+    "FROM information_schema.key_column_usage k "
+    "WHERE k.table_schema = t.table_schema AND k.table_name = t.table_name), "
+    "(SELECT CONCAT(COUNT(*), ':', IFNULL(SUM(CRC32(CONCAT_WS('|', r.constraint_name, "
+    "r.update_rule, r.delete_rule))), 0)) "
+    "FROM information_schema.referential_constraints r "
+    "WHERE r.constraint_schema = t.table_schema AND r.table_name = t.table_name), "
+    "(SELECT CONCAT(COUNT(*), ':', IFNULL(SUM(CRC32(CONCAT_WS('|', cc.constraint_name, "
+    "cc.check_clause, tc.enforced))), 0)) "
+    "FROM information_schema.table_constraints tc "
+    "JOIN information_schema.check_constraints cc "
+    "ON cc.constraint_schema = tc.constraint_schema AND cc.constraint_name = tc.constraint_name "
+    "WHERE tc.table_schema = t.table_schema AND tc.table_name = t.table_name "
+    "AND tc.constraint_type = 'CHECK')) "
+    "FROM information_schema.tables t WHERE t.table_schema = '%s'%s";
+
+static const char *TABLES_QUERY =
+    "SELECT table_name, table_type, engine, table_collation, create_options, table_comment "
+    "FROM information_schema.tables WHERE table_schema = '%s'%s";
+
+static const char *TABLE_NAMES_QUERY =
+    "SELECT table_name FROM information_schema.tables WHERE table_schema = '%s'%s";
+
+static const char *COLUMNS_QUERY =
+    "SELECT table_name, ordinal_position, column_name, column_type, is_nullable, "
+    "column_default, extra, character_set_name, collation_name, column_comment, generation_expression "
+    "FROM information_schema.columns WHERE table_schema = '%s'%s "
+    "ORDER BY table_name, ordinal_position";
+
+static const char *STATISTICS_QUERY =
+    "SELECT table_name, index_name, seq_in_index, column_name, non_unique, "
+    "sub_part, collation, index_type, index_comment, is_visible, expression "
+    "FROM information_schema.statistics WHERE table_schema = '%s'%s "
+    "ORDER BY table_name, index_name, seq_in_index";
+
+static const char *CONSTRAINTS_QUERY =
+    "SELECT tc.table_name, tc.constraint_name, tc.constraint_type, k.ordinal_position, "
+    "k.column_name, k.referenced_table_name, k.referenced_column_name, "
+    "r.update_rule, r.delete_rule, cc.check_clause, tc.enforced "
+    "FROM information_schema.table_constraints tc "
+    "LEFT JOIN information_schema.key_column_usage k "
+    "ON k.constraint_schema = tc.constraint_schema AND k.table_name = tc.table_name "
+    "AND k.constraint_name = tc.constraint_name "
+    "LEFT JOIN information_schema.referential_constraints r "
+    "ON r.constraint_schema = tc.constraint_schema AND r.table_name = tc.table_name "
+    "AND r.constraint_name = tc.constraint_name "
+    "LEFT JOIN information_schema.check_constraints cc "
+    "ON cc.constraint_schema = tc.constraint_schema AND cc.constraint_name = tc.constraint_name "
+    "WHERE tc.table_schema = '%s'%s "
+    "ORDER BY tc.table_name, tc.constraint_name, k.ordinal_position";
+
+typedef struct {
+    const char **fmt;
+    const char *column;
+} ModelQuery;
+
+static const ModelQuery MODEL_QUERIES[SOURCE_MODEL_COUNT] = {
+    { &TABLES_QUERY, "table_name" },
+    { &COLUMNS_QUERY, "table_name" },
+    { &STATISTICS_QUERY, "table_name" },
+    { &CONSTRAINTS_QUERY, "tc.table_name" },
+};
+
+// Formats into a heap buffer sized for the arguments; used for queries that
+// carry a table-name filter of arbitrary length.
+static char *format_query(const char *fmt, const char *db_name, const char *filter) {
+    StrBuf query = STR_BUF_INIT;
+    if (sb_appendf(&query, fmt, db_name, filter) != 0) {
+        sb_free(&query);
+        return NULL;
+    }
+    return sb_detach(&query);
+}
+
+static int append_quoted(MYSQL *conn, StrBuf *filter, const char *name, int first) {
+    size_t name_len = strlen(name);
+    if (sb_reserve(filter, name_len * 2 + 3) != 0) {
+        return -1;
+    }
+    if (!first) {
+        filter->data[filter->len++] = ',';
+    }
+    filter->data[filter->len++] = '\'';
+    filter->len += mysql_real_escape_string(conn, filter->data + filter->len, name, name_len);
+    filter->data[filter->len++] = '\'';
+    return 0;
+}
+
+// Appends " AND <column> IN ('a','b',...)", or nothing when names is NULL.
+static int append_name_filter(MYSQL *conn, StrBuf *filter, const char *column, char **names, int count) {
+    if (!names) {
+        return 0;
+    }
+    if (sb_appendf(filter, " AND %s IN (", column) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (append_quoted(conn, filter, names[i], i == 0) != 0) {
+            return -1;
+        }
+    }
+    return sb_append(filter, count > 0 ? ")" : "NULL)");
+}
+
+// Appends the keyset clause for the page after last (NULL for the first
+// page). Names compare as bytes so the order does not depend on the
+// collation of information_schema.
+static int append_page_filter(MYSQL *conn, StrBuf *filter, const char *column, const char *last, int page_size) {
+    if (page_size <= 0) {
+        return 0;
+    }
+    if (last && (sb_appendf(filter, " AND CAST(%s AS BINARY) > ", column) != 0 ||
+                 append_quoted(conn, filter, last, 1) != 0)) {
+        return -1;
+    }
+    return sb_appendf(filter, " ORDER BY CAST(%s AS BINARY) LIMIT %d", column, page_size);
+}
+
+// A streamed result ends early, with NULL from mysql_fetch_row(), when the
+// connection drops mid-read; only the error code tells it from the end.
+static int finish_stream(MYSQL *conn, MYSQL_RES *result, const char *what) {
+    int failed = mysql_errno(conn) != 0;
+    if (failed) {
+        fprintf(stderr, "Failed to %s: %s\n", what, mysql_error(conn));
+        metrics_add(COUNTER_ERRORS, 1);
+    }
+    mysql_free_result(result);
+    return failed ? -1 : 0;
+}
+
+// Runs fmt with filter and hands the rows to row one at a time. The rows are
+// streamed rather than buffered client side, so neither side holds the
+// whole result.
+static int stream_rows(MYSQL *conn, const char *fmt, const char *db_name, const char *filter, const char *what,
+                       SourceRowFn row, void *arg) {
+    char *query = format_query(fmt, db_name, filter);
+    if (!query) {
+        return -1;
+    }
+    metrics_add(COUNTER_QUERIES, 1);
+    if (mysql_query(conn, query)) {
+        fprintf(stderr, "Failed to %s: %s\n", what, mysql_error(conn));
+        metrics_add(COUNTER_ERRORS, 1);
+        free(query);
+        return -1;
+    }
+    free(query);
+    MYSQL_RES *result = mysql_use_result(conn);
+    if (!result) {
+        return -1;
+    }
+
+    unsigned int fields = mysql_num_fields(result);
+    int rows = 0;
+    MYSQL_ROW values;
+    while ((values = mysql_fetch_row(result))) {
+        rows++;
+        if (row(values, fields, arg) != 0) {
+            mysql_free_result(result);
+            return -1;
+        }
+    }
+    return finish_stream(conn, result, what) == 0 ? rows : -1;
+}
+
+static int mysql_fingerprints(SchemaSource *source, const char *db_name, char **names, int count,
+                              const char *after, int limit, SourceRowFn row, void *arg) {
+    MYSQL *conn = source->impl;
+    StrBuf filter = STR_BUF_INIT;
+    if (append_name_filter(conn, &filter, "t.table_name", names, count) != 0 ||
+        append_page_filter(conn, &filter, "t.table_name", after, limit) != 0) {
+        sb_free(&filter);
+        return -1;
+    }
+    int rows = stream_rows(conn, FINGERPRINT_QUERY, db_name, sb_str(&filter), "fetch tables", row, arg);
+    sb_free(&filter);
+    return rows;
+}
+
+static int mysql_table_names(SchemaSource *source, const char *db_name, const char *after, int limit,
+                             SourceRowFn row, void *arg) {
+    MYSQL *conn = source->impl;
+    StrBuf filter = STR_BUF_INIT;
+    if (append_page_filter(conn, &filter, "table_name", after, limit) != 0) {
+        sb_free(&filter);
+        return -1;
+    }
+    int rows = stream_rows(conn, TABLE_NAMES_QUERY, db_name, sb_str(&filter), "list tables", row, arg);
+    sb_free(&filter);
+    return rows;
+}
+
+static int mysql_model(SchemaSource *source, const char *db_name, SourceModel model, char **names, int count,
+                       SourceRowFn row, void *arg) {
+    MYSQL *conn = source->impl;
+    const ModelQuery *query = &MODEL_QUERIES[model];
+    StrBuf filter = STR_BUF_INIT;
+    if (append_name_filter(conn, &filter, query->column, names, count) != 0) {
+        sb_free(&filter);
+        return -1;
+    }
+    int rows = stream_rows(conn, *query->fmt, db_name, sb_str(&filter), "capture table metadata", row, arg);
+    sb_free(&filter);
+    return rows;
+}
+
+// Appends name as a quoted identifier.
+static void append_identifier(StrBuf *sb, const char *name) {
+    sb_append(sb, "`");
+    for (const char *p = name; *p; p++) {
+        if (*p == '`') {
+            sb_append(sb, "`");
+        }
+        sb_appendf(sb, "%c", *p);
+    }
+    sb_append(sb, "`");
+}
+
+// The table is qualified with its database, so the same connection serves
+// every database on the server whatever it was opened on.
+void schema_source_append_show_create(StrBuf *query, const char *db_name, const char *table_name) {
+    sb_append(query, "SHOW CREATE TABLE ");
+    append_identifier(query, db_name);
+    sb_append(query, ".");
+    append_identifier(query, table_name);
+}
+
+static char *mysql_show_create(SchemaSource *source, const char *db_name, const char *table_name) {
+    MYSQL *conn = source->impl;
+    StrBuf *query = sb_scratch(0);
+    schema_source_append_show_create(query, db_name, table_name);
+
+    metrics_add(COUNTER_QUERIES, 1);
+    if (mysql_query(conn, sb_str(query))) {
+        fprintf(stderr, "Failed to get schema for table %s: %s\n", table_name, mysql_error(conn));
+        metrics_add(COUNTER_ERRORS, 1);
+        return NULL;
+    }
+
+    // Streamed rather than buffered, so the DDL (hundreds of KB for some
+    // partitioned tables) is only held by the row and the copy made below.
+    MYSQL_RES *result = mysql_use_result(conn);
+    if (!result) return NULL;
+
+    MYSQL_ROW row = mysql_fetch_row(result);
+    char *schema = NULL;
+    if (row && row[1]) {
+        schema = strdup(row[1]);
+    }
+
+    mysql_free_result(result);
+    return schema;
+}
+
+static const SchemaSourceOps MYSQL_SOURCE_OPS = {
+    mysql_fingerprints,
+    mysql_table_names,
+    mysql_model,
+    mysql_show_create
+};
+
+void schema_source_mysql(SchemaSource *source, MYSQL *conn) {
+    source->ops = &MYSQL_SOURCE_OPS;
+    source->impl = conn;
+}
@@ -0,0 +1,664 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot_store.h"
+#include "file_util.h"
+#include "str_buf.h"
+#include "metrics.h"
+
+#define STORE_MAGIC "KGSNAP01"
+#define STORE_VERSION 1
+#define RECORD_MAGIC 0x4B475352u
+// The mapping is sized in steps well past the end of the file so appends
+// only rarely need a new mapping; pages past the end are never touched.
+#define MAP_STEP (64UL * 1024 * 1024)
+#define KEY_SIZE 1024
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t toc_offset;
+    uint64_t reserved2;
+} StoreHeader;
+
+// Followed by scope, table, label and data, each NUL terminated, padded to
+// a multiple of 8 bytes. Fields are in host byte order.
+typedef struct {
+    uint32_t magic;
+    uint32_t kind;
+    uint64_t prev;
+    int64_t timestamp;
+    uint32_t scope_len;
+    uint32_t table_len;
+    uint32_t label_len;
+    uint32_t data_len;
+    uint32_t checksum;
+    uint32_t flags;
+} RecordHeader;
+
+// The data of a SNAPSHOT_SCHEMA record names a SNAPSHOT_BLOB record holding
+// the text, so a schema shared by many tables and branches is on disk once.
+// The name is "<hex hash>-<hex length>", with "-<n>" appended for content
+// that collides with a blob already stored; stores written before the
+// length was added use the bare hash.
+#define RECORD_BLOB_REF 0x1
+
+typedef struct {
+    uint64_t latest;
+    uint64_t versions;
+} TocEntry;
+
+static size_t padded(size_t len) {
+    return (len + 7) & ~(size_t)7;
+}
+
+static void make_key(char *key, SnapshotKind kind, const char *scope, const char *table) {
+    snprintf(key, KEY_SIZE, "%d\x1f%s\x1f%s", (int)kind, scope, table);
+}
+
+static int map_file(SnapshotStore *store) {
+    size_t size = (size_t)((store->file_size / MAP_STEP + 1) * MAP_STEP);
+    if (store->map && size <= store->map_size) {
+        return 0;
+    }
+    if (store->map) {
+        munmap(store->map, store->map_size);
+        store->map = NULL;
+    }
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, store->fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    store->map = map;
+    store->map_size = size;
+    return 0;
+}
+
+// Validates the record at offset and fills out. Returns the offset of the
+// next record, or 0 when the record is truncated or corrupt.
+static uint64_t read_record(SnapshotStore *store, uint64_t offset, SnapshotRecord *out, uint64_t *prev) {
+    if (offset < sizeof(StoreHeader) || offset % 8 != 0 ||
+        offset + sizeof(RecordHeader) > store->file_size) {
+        return 0;
+    }
+    RecordHeader header;
+    memcpy(&header, store->map + offset, sizeof(header));
+    if (header.magic != RECORD_MAGIC || header.scope_len == 0 || header.table_len == 0 ||
+        header.label_len == 0 || header.data_len == 0) {
+        return 0;
+    }
+    uint64_t payload = (uint64_t)header.scope_len + header.table_len + header.label_len + header.data_len;
+    uint64_t next = offset + sizeof(RecordHeader) + padded((size_t)payload);
+    if (next > store->file_size) {
+        return 0;
+    }
+
+    const char *p = (const char *)store->map + offset + sizeof(RecordHeader);
+    if ((uint32_t)hash_bytes(p, (size_t)payload) != header.checksum) {
+        return 0;
+    }
+    const char *table = p + header.scope_len;
+    const char *label = table + header.table_len;
+    const char *data = label + header.label_len;
+    if (table[-1] != '\0' || label[-1] != '\0' || data[-1] != '\0' || data[header.data_len - 1] != '\0') {
+        return 0;
+    }
+
+    out->offset = offset;
+    out->kind = (SnapshotKind)header.kind;
+    out->timestamp = (time_t)header.timestamp;
+    out->scope = p;
+    out->table = table;
+    out->label = label;
+    out->data = data;
+    out->data_len = header.data_len - 1;
+    out->blob_ref = (header.flags & RECORD_BLOB_REF) != 0;
+    if (prev) {
+        *prev = header.prev;
+    }
+    return next;
+}
+
+static TocEntry *toc_entry(SnapshotStore *store, const char *key) {
+    TocEntry *entry = hash_map_get(&store->toc, key);
+    if (entry) {
+        return entry;
+    }
+    entry = calloc(1, sizeof(TocEntry));
+    if (!entry) {
+        return NULL;
+    }
+    if (hash_map_put(&store->toc, key, entry) != 0) {
+        free(entry);
+        return NULL;
+    }
+    return entry;
+}
+
+static void index_record(SnapshotStore *store, const SnapshotRecord *record) {
+    char key[KEY_SIZE];
+    make_key(key, record->kind, record->scope, record->table);
+    TocEntry *entry = toc_entry(store, key);
+    if (entry) {
+        entry->latest = record->offset;
+        entry->versions++;
+    }
+}
+
+// Loads the table of contents written at offset by the last clean close.
+// Returns the offset right after it, or 0 when it is not usable.
+static uint64_t load_toc(SnapshotStore *store, uint64_t offset) {
+    SnapshotRecord toc;
+    uint64_t next = read_record(store, offset, &toc, NULL);
+    if (!next || toc.kind != SNAPSHOT_TOC) {
+        return 0;
+    }
+    size_t count = toc.data_len / (2 * sizeof(uint64_t));
+    const unsigned char *p = (const unsigned char *)toc.data;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t pair[2];
+        memcpy(pair, p + i * sizeof(pair), sizeof(pair));
+        SnapshotRecord record;
+        if (!read_record(store, pair[0], &record, NULL)) {
+            return 0;
+        }
+        char key[KEY_SIZE];
+        make_key(key, record.kind, record.scope, record.table);
+        TocEntry *entry = toc_entry(store, key);
+        if (!entry) {
+            return 0;
+        }
+        entry->latest = pair[0];
+        entry->versions = pair[1];
+    }
+    return next;
+}
+
+// Indexes every record from offset on. A torn append at the end of the file
+// is cut off so new records follow the last complete one.
+static void scan_tail(SnapshotStore *store, uint64_t offset) {
+    while (offset < store->file_size) {
+        SnapshotRecord record;
+        uint64_t next = read_record(store, offset, &record, NULL);
+        if (!next) {
+            // A reader may just be looking at an append in progress.
+            if (store->read_only) {
+                store->file_size = offset;
+                return;
+            }
+            fprintf(stderr, "Snapshot store %s: dropping %llu damaged bytes at offset %llu\n", store->path,
+                    (unsigned long long)(store->file_size - offset), (unsigned long long)offset);
+            if (ftruncate(store->fd, (off_t)offset) == 0) {
+                store->file_size = offset;
+            }
+            return;
+        }
+        if (record.kind != SNAPSHOT_TOC) {
+            index_record(store, &record);
+        }
+        offset = next;
+    }
+}
+
+static void free_toc(SnapshotStore *store) {
+    hash_map_free(&store->toc, free);
+    hash_map_init(&store->toc, 1024);
+}
+
+int snapshot_store_open(SnapshotStore *store, const char *path, int read_only) {
+    memset(store, 0, sizeof(*store));
+    store->read_only = read_only;
+    store->fd = read_only ? open(path, O_RDONLY | O_CLOEXEC) : open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (store->fd < 0) {
+        perror("Failed to open snapshot store");
+        return -1;
+    }
+    store->path = strdup(path);
+    pthread_mutex_init(&store->lock, NULL);
+    if (!store->path || hash_map_init(&store->toc, 1024) != 0) {
+        snapshot_store_close(store);
+        return -1;
+    }
+
+    struct stat st;
+    StoreHeader header;
+    if (fstat(store->fd, &st) != 0) {
+        snapshot_store_close(store);
+        return -1;
+    }
+    if (st.st_size == 0 && !read_only) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, STORE_MAGIC, sizeof(header.magic));
+        header.version = STORE_VERSION;
+        if (pwrite(store->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+            perror("Failed to initialize snapshot store");
+            snapshot_store_close(store);
+            return -1;
+        }
+        st.st_size = sizeof(header);
+    } else if (st.st_size < (off_t)sizeof(header) ||
+               pread(store->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+               memcmp(header.magic, STORE_MAGIC, sizeof(header.magic)) != 0 ||
+               header.version != STORE_VERSION) {
+        fprintf(stderr, "%s is not a snapshot store\n", path);
+        snapshot_store_close(store);
+        return -1;
+    }
+    store->file_size = (uint64_t)st.st_size;
+    if (map_file(store) != 0) {
+        snapshot_store_close(store);
+        return -1;
+    }
+
+    uint64_t start = header.toc_offset ? load_toc(store, header.toc_offset) : 0;
+    if (start) {
+        store->toc_offset = header.toc_offset;
+    } else {
+        free_toc(store);
+        start = sizeof(StoreHeader);
+    }
+    uint64_t loaded_size = store->file_size;
+    scan_tail(store, start);
+    if (start != loaded_size) {
+        // Records follow the table of contents; it no longer covers them.
+        store->toc_offset = 0;
+    }
+    return 0;
+}
+
+static void blob_key(char *key, const char *hex) {
+    make_key(key, SNAPSHOT_BLOB, "", hex);
+}
+
+// Points a blob reference at the text it names. Returns 0 when the blob is
+// missing.
+static int resolve_blob(SnapshotStore *store, SnapshotRecord *record) {
+    if (!record->blob_ref) {
+        return 1;
+    }
+    char key[KEY_SIZE];
+    SnapshotRecord blob;
+    blob_key(key, record->data);
+    TocEntry *entry = hash_map_get(&store->toc, key);
+    if (!entry || !read_record(store, entry->latest, &blob, NULL)) {
+        return 0;
+    }
+    record->data = blob.data;
+    record->data_len = blob.data_len;
+    record->blob_ref = 0;
+    return 1;
+}
+
+static const char *latest_locked(SnapshotStore *store, const char *key, SnapshotRecord *record) {
+    TocEntry *entry = hash_map_get(&store->toc, key);
+    if (!entry || !read_record(store, entry->latest, record, NULL)) {
+        return NULL;
+    }
+    return record->data;
+}
+
+const char *snapshot_store_get(SnapshotStore *store, SnapshotKind kind, const char *scope, const char *table) {
+    char key[KEY_SIZE];
+    SnapshotRecord record;
+    make_key(key, kind, scope, table);
+    pthread_mutex_lock(&store->lock);
+    const char *data = latest_locked(store, key, &record);
+    if (data && !resolve_blob(store, &record)) {
+        data = NULL;
+    } else if (data) {
+        data = record.data;
+    }
+    pthread_mutex_unlock(&store->lock);
+    return data;
+}
+
+int snapshot_store_get_hash(SnapshotStore *store, SnapshotKind kind, const char *scope, const char *table,
+                            uint64_t *hash) {
+    char key[KEY_SIZE];
+    SnapshotRecord record;
+    make_key(key, kind, scope, table);
+    pthread_mutex_lock(&store->lock);
+    const char *data = latest_locked(store, key, &record);
+    if (data && record.blob_ref) {
+        *hash = strtoull(data, NULL, 16);
+    } else if (data) {
+        *hash = hash_bytes(record.data, record.data_len);
+    }
+    pthread_mutex_unlock(&store->lock);
+    return data ? 1 : 0;
+}
+
+static int append_locked(SnapshotStore *store, SnapshotKind kind, const char *scope, const char *table,
+                         const char *label, const char *data, size_t data_len, uint32_t flags);
+
+// Finds the blob record holding data, or appends one, and writes its name
+// to ref. A blob is only shared after its bytes were compared, so two
+// schemas with the same hash never end up as one.
+static int blob_ref_locked(SnapshotStore *store, const char *data, size_t len, char *ref, size_t ref_size) {
+    unsigned long long hash = (unsigned long long)hash_bytes(data, len);
+    char key[KEY_SIZE];
+    for (int n = 0;; n++) {
+        if (n == 0) {
+            snprintf(ref, ref_size, "%016llx-%zx", hash, len);
+        } else {
+            snprintf(ref, ref_size, "%016llx-%zx-%d", hash, len, n);
+        }
+        blob_key(key, ref);
+        TocEntry *entry = hash_map_get(&store->toc, key);
+        if (!entry) {
+            return append_locked(store, SNAPSHOT_BLOB, "", ref, "", data, len, 0);
+        }
+        SnapshotRecord blob;
+        if (read_record(store, entry->latest, &blob, NULL) && blob.data_len == len &&
+            memcmp(blob.data, data, len) == 0) {
+            return 0;
+        }
+    }
+}
+
+static int append_locked(SnapshotStore *store, SnapshotKind kind, const char *scope, const char *table,
+                         const char *label, const char *data, size_t data_len, uint32_t flags) {
+    char key[KEY_SIZE];
+    make_key(key, kind, scope, table);
+    TocEntry *entry = hash_map_get(&store->toc, key);
+
+    RecordHeader header = {
+        .magic = RECORD_MAGIC,
+        .kind = (uint32_t)kind,
+        .prev = entry ? entry->latest : 0,
+        .timestamp = (int64_t)time(NULL),
+        .scope_len = (uint32_t)strlen(scope) + 1,
+        .table_len = (uint32_t)strlen(table) + 1,
+        .label_len = (uint32_t)strlen(label) + 1,
+        .data_len = (uint32_t)data_len + 1,
+        .flags = flags
+    };
+
+    StrBuf record = STR_BUF_INIT;
+    size_t payload = (size_t)header.scope_len + header.table_len + header.label_len + header.data_len;
+    int rc = sb_reserve(&record, sizeof(header) + padded(payload));
+    if (rc == 0) {
+        rc = sb_append_len(&record, (const char *)&header, sizeof(header));
+    }
+    if (rc == 0) {
+        rc = sb_append_len(&record, scope, header.scope_len);
+    }
+    if (rc == 0) {
+        rc = sb_append_len(&record, table, header.table_len);
+    }
+    if (rc == 0) {
+        rc = sb_append_len(&record, label, header.label_len);
+    }
+    if (rc == 0) {
+        rc = sb_append_len(&record, data, data_len);
+    }
+    if (rc == 0) {
+        // The data's own terminator and the padding.
+        static const char zeros[8] = {0};
+        rc = sb_append_len(&record, zeros, 1 + padded(payload) - payload);
+    }
+    if (rc != 0) {
+        sb_free(&record);
+        return -1;
+    }
+    RecordHeader *stored = (RecordHeader *)record.data;
+    stored->checksum = (uint32_t)hash_bytes(record.data + sizeof(header), payload);
+
+    uint64_t offset = store->file_size;
+    ssize_t written = pwrite(store->fd, record.data, record.len, (off_t)offset);
+    size_t len = record.len;
+    sb_free(&record);
+    if (written != (ssize_t)len) {
+        perror("Failed to append to snapshot store");
+        if (written > 0 && ftruncate(store->fd, (off_t)offset) != 0) {
+            perror("ftruncate");
+        }
+        return -1;
+    }
+    store->file_size += len;
+    metrics_add(COUNTER_BYTES_WRITTEN, len);
+    if (map_file(store) != 0) {
+        return -1;
+    }
+
+    if (kind != SNAPSHOT_TOC) {
+        if (!entry) {
+            entry = toc_entry(store, key);
+        }
+        if (entry) {
+            entry->latest = offset;
+            entry->versions++;
+        }
+    }
+    store->appends++;
+    return 0;
+}
+
+int snapshot_store_put(SnapshotStore *store, SnapshotKind kind, const char *scope, const char *table,
+                       const char *label, const char *data) {
+    char key[KEY_SIZE];
+    SnapshotRecord record;
+    if (!label) {
+        label = "";
+    }
+    make_key(key, kind, scope, table);
+
+    if (store->read_only) {
+        return -1;
+    }
+    pthread_mutex_lock(&store->lock);
+    const char *current = latest_locked(store, key, &record);
+    if (kind != SNAPSHOT_SCHEMA) {
+        int rc = 0;
+        if (!current || strcmp(current, data) != 0 || strcmp(record.label, label) != 0) {
+            rc = append_locked(store, kind, scope, table, label, data, strlen(data), 0) == 0 ? 1 : -1;
+        }
+        pthread_mutex_unlock(&store->lock);
+        return rc;
+    }
+
+    // Schemas are stored once by content; the record for this table only
+    // names the blob. Adding the blob can move the mapping, so what the
+    // newest record says is copied out of it first.
+    char current_ref[64] = "";
+    if (current && record.blob_ref && strcmp(record.label, label) == 0) {
+        snprintf(current_ref, sizeof(current_ref), "%s", current);
+    }
+    char ref[64];
+    int rc = blob_ref_locked(store, data, strlen(data), ref, sizeof(ref));
+    if (rc == 0 && strcmp(current_ref, ref) == 0) {
+        pthread_mutex_unlock(&store->lock);
+        return 0;
+    }
+    if (rc == 0) {
+        rc = append_locked(store, kind, scope, table, label, ref, strlen(ref), RECORD_BLOB_REF);
+    }
+    pthread_mutex_unlock(&store->lock);
+    return rc == 0 ? 1 : -1;
+}
+
+int snapshot_store_history(SnapshotStore *store, SnapshotKind kind, const char *scope, const char *table,
+                           SnapshotRecordFn fn, void *arg) {
+    char key[KEY_SIZE];
+    make_key(key, kind, scope, table);
+
+    pthread_mutex_lock(&store->lock);
+    TocEntry *entry = hash_map_get(&store->toc, key);
+    if (!entry) {
+        pthread_mutex_unlock(&store->lock);
+        return 0;
+    }
+    uint64_t *chain = calloc((size_t)entry->versions, sizeof(uint64_t));
+    if (!chain) {
+        pthread_mutex_unlock(&store->lock);
+        return -1;
+    }
+
+    // Versions link backwards; collect them, then replay oldest first.
+    size_t count = 0;
+    uint64_t offset = entry->latest;
+    SnapshotRecord record;
+    while (offset && count < entry->versions) {
+        uint64_t prev = 0;
+        if (!read_record(store, offset, &record, &prev)) {
+            break;
+        }
+        chain[count++] = offset;
+        offset = prev;
+    }
+    pthread_mutex_unlock(&store->lock);
+
+    for (size_t i = count; i > 0; i--) {
+        if (read_record(store, chain[i - 1], &record, NULL) && resolve_blob(store, &record)) {
+            fn(&record, arg);
+        }
+    }
+    free(chain);
+    return (int)count;
+}
+
+void snapshot_store_scan(SnapshotStore *store, SnapshotRecordFn fn, void *arg) {
+    uint64_t offset = sizeof(StoreHeader);
+    SnapshotRecord record;
+    while (offset < store->file_size) {
+        uint64_t next = read_record(store, offset, &record, NULL);
+        if (!next) {
+            return;
+        }
+        if (record.kind != SNAPSHOT_TOC) {
+            fn(&record, arg);
+        }
+        offset = next;
+    }
+}
+
+typedef struct {
+    SnapshotStore *store;
+    const char *root;
+    int files;
+} ExportState;
+
+static void export_file(ExportState *state, const char *dir, const char *name, const char *data, size_t len) {
+    char path[1024];
+    if (create_directories(dir) != 0 ||
+        snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path)) {
+        fprintf(stderr, "Failed to export %s/%s\n", dir, name);
+        return;
+    }
+    if (write_file_atomic(path, data, len, 0) == 0) {
+        state->files++;
+    }
+}
+
+typedef struct {
+    ExportState *state;
+    StrBuf text;
+} HistoryText;
+
+static void append_history(const SnapshotRecord *record, void *arg) {
+    HistoryText *history = arg;
+    sb_append_len(&history->text, record->data, record->data_len);
+}
+
+static void export_migration(const SnapshotRecord *record, void *arg) {
+    ExportState *state = arg;
+    char dir[1024];
+    char name[600];
+    snprintf(dir, sizeof(dir), "%s/tables/%s/migrations", state->root, record->table);
+    snprintf(name, sizeof(name), "%s_%s_%s.sql", record->label, record->table,
+             record->kind == SNAPSHOT_MIGRATION_UP ? "up" : "down");
+    export_file(state, dir, name, record->data, record->data_len);
+}
+
+static void export_key(const char *key, void *value, void *arg) {
+    ExportState *state = arg;
+    TocEntry *entry = value;
+    SnapshotRecord record;
+    (void)key;
+    if (!read_record(state->store, entry->latest, &record, NULL) || !resolve_blob(state->store, &record)) {
+        return;
+    }
+
+    char dir[1024];
+    int live = strcmp(record.scope, SNAPSHOT_SCOPE_LIVE) == 0;
+    if (record.kind == SNAPSHOT_SCHEMA && live) {
+        snprintf(dir, sizeof(dir), "%s/tables/%s", state->root, record.table);
+        export_file(state, dir, "schema.sql", record.data, record.data_len);
+    } else if (record.kind == SNAPSHOT_SCHEMA) {
+        char name[600];
+        snprintf(dir, sizeof(dir), "%s/dbtables/%s/schemas", state->root, record.scope);
+        snprintf(name, sizeof(name), "%s.sql", record.table);
+        export_file(state, dir, name, record.data, record.data_len);
+    } else if (record.kind == SNAPSHOT_HISTORY && live) {
+        HistoryText history = { state, STR_BUF_INIT };
+        snapshot_store_history(state->store, record.kind, record.scope, record.table, append_history, &history);
+        snprintf(dir, sizeof(dir), "%s/tables/%s", state->root, record.table);
+        export_file(state, dir, "history.txt", sb_str(&history.text), history.text.len);
+        sb_free(&history.text);
+    } else if ((record.kind == SNAPSHOT_MIGRATION_UP || record.kind == SNAPSHOT_MIGRATION_DOWN) && live) {
+        snapshot_store_history(state->store, record.kind, record.scope, record.table, export_migration, state);
+    }
+}
+
+int snapshot_store_export(SnapshotStore *store, const char *root) {
+    ExportState state = { store, root, 0 };
+    // The exporter only reads, so the entries are visited without the lock;
+    // it must not run concurrently with appends.
+    hash_map_foreach(&store->toc, export_key, &state);
+    return state.files;
+}
+
+typedef struct {
+    StrBuf data;
+} TocWriter;
+
+static void write_toc_entry(const char *key, void *value, void *arg) {
+    (void)key;
+    TocWriter *writer = arg;
+    TocEntry *entry = value;
+    uint64_t pair[2] = { entry->latest, entry->versions };
+    sb_append_len(&writer->data, (const char *)pair, sizeof(pair));
+}
+
+// Appends the table of contents and points the header at it, so the next
+// open does not have to read every record.
+static void write_toc(SnapshotStore *store) {
+    TocWriter writer = { STR_BUF_INIT };
+    hash_map_foreach(&store->toc, write_toc_entry, &writer);
+    uint64_t offset = store->file_size;
+    if (writer.data.len > 0 &&
+        append_locked(store, SNAPSHOT_TOC, "", "toc", "", writer.data.data, writer.data.len, 0) == 0 &&
+        fdatasync(store->fd) == 0 &&
+        pwrite(store->fd, &offset, sizeof(offset), offsetof(StoreHeader, toc_offset)) != (ssize_t)sizeof(offset)) {
+        perror("Failed to record the snapshot store index");
+    }
+    sb_free(&writer.data);
+}
+
+void snapshot_store_close(SnapshotStore *store) {
+    // A table of contents that still covers every record is kept as is.
+    if (!store->read_only && store->fd >= 0 && store->map && store->toc.buckets &&
+        (store->appends > 0 || !store->toc_offset)) {
+        write_toc(store);
+    }
+    if (store->map) {
+        munmap(store->map, store->map_size);
+        store->map = NULL;
+    }
+    if (store->fd >= 0) {
+        close(store->fd);
+        store->fd = -1;
+    }
+    if (store->toc.buckets) {
+        hash_map_free(&store->toc, free);
+    }
+    free(store->path);
+    store->path = NULL;
+    pthread_mutex_destroy(&store->lock);
+}
@@ -0,0 +1,124 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "str_buf.h"
+
+// The slots themselves are thread-local, so getting one cannot fail; the
+// key only frees what they grew to when the thread exits.
+static __thread StrBuf g_scratch[STR_BUF_SCRATCH_SLOTS];
+static __thread int g_scratch_registered;
+static pthread_key_t g_scratch_key;
+static pthread_once_t g_scratch_once = PTHREAD_ONCE_INIT;
+
+static void free_scratch(void *arg) {
+    StrBuf *slots = arg;
+    for (int i = 0; i < STR_BUF_SCRATCH_SLOTS; i++) {
+        sb_free(&slots[i]);
+    }
+}
+
+static void create_scratch_key(void) {
+    pthread_key_create(&g_scratch_key, free_scratch);
+}
+
+void sb_init(StrBuf *sb) {
+    sb->data = NULL;
+    sb->len = 0;
+    sb->cap = 0;
+}
+
+int sb_reserve(StrBuf *sb, size_t extra) {
+    if (sb->len + extra + 1 <= sb->cap) {
+        return 0;
+    }
+
+    size_t cap = sb->cap ? sb->cap : 64;
+    while (sb->len + extra + 1 > cap) {
+        cap *= 2;
+    }
+    char *grown = realloc(sb->data, cap);
+    if (!grown) {
+        return -1;
+    }
+    sb->data = grown;
+    sb->cap = cap;
+    return 0;
+}
+
+int sb_append_len(StrBuf *sb, const char *text, size_t len) {
+    if (sb_reserve(sb, len) != 0) {
+        return -1;
+    }
+    memcpy(sb->data + sb->len, text, len);
+    sb->len += len;
+    sb->data[sb->len] = '\0';
+    return 0;
+}
+
+int sb_append(StrBuf *sb, const char *text) {
+    return sb_append_len(sb, text, strlen(text));
+}
+
+int sb_vappendf(StrBuf *sb, const char *fmt, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    size_t room = sb->cap > sb->len ? sb->cap - sb->len : 0;
+    int needed = vsnprintf(room ? sb->data + sb->len : NULL, room, fmt, copy);
+    va_end(copy);
+    if (needed < 0) {
+        return -1;
+    }
+
+    // Formatting usually fits the spare capacity; only re-run when it did not.
+    if ((size_t)needed >= room) {
+        if (sb_reserve(sb, (size_t)needed) != 0) {
+            return -1;
+        }
+        vsnprintf(sb->data + sb->len, sb->cap - sb->len, fmt, args);
+    }
+    sb->len += (size_t)needed;
+    return 0;
+}
+
+int sb_appendf(StrBuf *sb, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int rc = sb_vappendf(sb, fmt, args);
+    va_end(args);
+    return rc;
+}
+
+const char *sb_str(const StrBuf *sb) {
+    return sb->data ? sb->data : "";
+}
+
+void sb_reset(StrBuf *sb) {
+    sb->len = 0;
+    if (sb->data) {
+        sb->data[0] = '\0';
+    }
+}
+
+char *sb_detach(StrBuf *sb) {
+    char *data = sb->data;
+    sb_init(sb);
+    return data;
+}
+
+void sb_free(StrBuf *sb) {
+    free(sb->data);
+    sb_init(sb);
+}
+
+StrBuf *sb_scratch(int slot) {
+    if (!g_scratch_registered) {
+        pthread_once(&g_scratch_once, create_scratch_key);
+        pthread_setspecific(g_scratch_key, g_scratch);
+        g_scratch_registered = 1;
+    }
+
+    StrBuf *sb = &g_scratch[slot];
+    sb_reset(sb);
+    return sb;
+}
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <mysql/mysql.h>
+#include "target_scheduler.h"
+#include "poll_scheduler.h"
+#include "logger.h"
+
+#define DEFAULT_WATCH_THREADS 4
+#define MAX_WATCH_THREADS 64
+#define DEFAULT_SERVER_CONNECTIONS 2
+// Longest a scheduler thread sleeps without looking at the targets again.
+#define SCHEDULER_IDLE_MS 1000
+
+static int same_string(const char *a, const char *b) {
+    return strcmp(a ? a : "", b ? b : "") == 0;
+}
+
+static ServerPool *find_server(TargetScheduler *ts, const DBConfig *config) {
+    for (int i = 0; i < ts->server_count; i++) {
+        DBConfig *server = &ts->servers[i].config;
+        if (same_string(server->host, config->host) && server->port == config->port &&
+            same_string(server->user, config->user)) {
+            return &ts->servers[i];
+        }
+    }
+    return NULL;
+}
+
+// The pool's connections open no default database: every query of a
+// target names its own.
+static ServerPool *add_server(TargetScheduler *ts, const DBConfig *config, int size) {
+    ServerPool *server = &ts->servers[ts->server_count];
+    memset(server, 0, sizeof(*server));
+    server->config = *config;
+    server->config.name = NULL;
+    server->slots = calloc((size_t)size, sizeof(DbConnection));
+    server->busy = calloc((size_t)size, sizeof(int));
+    if (!server->slots || !server->busy) {
+        free(server->slots);
+        free(server->busy);
+        return NULL;
+    }
+    for (int i = 0; i < size; i++) {
+        db_connection_init(&server->slots[i], &server->config);
+    }
+    server->size = size;
+    ts->server_count++;
+    return server;
+}
+
+// Prefers a connection that is already open, so idle slots are only
+// connected once cycles on the server actually overlap.
+static int take_slot(ServerPool *server) {
+    int slot = -1;
+    for (int i = 0; i < server->size; i++) {
+        if (server->busy[i]) {
+            continue;
+        }
+        if (server->slots[i].state == DB_CONN_CONNECTED) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 || (server->slots[slot].state == DB_CONN_BACKOFF &&
+                         server->slots[i].state != DB_CONN_BACKOFF)) {
+            slot = i;
+        }
+    }
+    server->busy[slot] = 1;
+    server->in_use++;
+    return slot;
+}
+
+static ScheduledTarget *pick_target(TargetScheduler *ts, uint64_t now, uint64_t *wake_ms) {
+    ScheduledTarget *next = NULL;
+    for (int i = 0; i < ts->count; i++) {
+        ScheduledTarget *st = &ts->targets[i];
+        if (st->has_thread || st->running) {
+            continue;
+        }
+        if (st->due_ms > now) {
+            if (st->due_ms < *wake_ms) {
+                *wake_ms = st->due_ms;
+            }
+            continue;
+        }
+        // A busy server wakes the waiters when it hands a connection back.
+        if (st->server->in_use >= st->server->size) {
+            continue;
+        }
+        if (!next || st->due_ms < next->due_ms) {
+            next = st;
+        }
+    }
+    return next;
+}
+
+static void wait_until(TargetScheduler *ts, uint64_t wake_ms) {
+    struct timespec deadline = { (time_t)(wake_ms / 1000), (long)(wake_ms % 1000) * 1000000L };
+    pthread_cond_timedwait(&ts->cond, &ts->lock, &deadline);
+}
+
+static void *scheduler_main(void *arg) {
+    TargetScheduler *ts = arg;
+    mysql_thread_init();
+
+    pthread_mutex_lock(&ts->lock);
+    while (!ts->stopping) {
+        uint64_t now = poll_scheduler_now_ms();
+        uint64_t wake_ms = now + SCHEDULER_IDLE_MS;
+        ScheduledTarget *st = pick_target(ts, now, &wake_ms);
+        if (!st) {
+            wait_until(ts, wake_ms);
+            continue;
+        }
+
+        ServerPool *server = st->server;
+        int slot = take_slot(server);
+        st->running = 1;
+        pthread_mutex_unlock(&ts->lock);
+
+        DbConnection *dc = &server->slots[slot];
+        MYSQL *conn = db_connection_acquire(dc, ts->ctx);
+        unsigned int wait_ms = watch_target_poll(st->target, conn);
+        if (!conn && db_connection_retry_delay_ms(dc) > wait_ms) {
+            wait_ms = db_connection_retry_delay_ms(dc);
+        }
+
+        pthread_mutex_lock(&ts->lock);
+        server->busy[slot] = 0;
+        server->in_use--;
+        st->running = 0;
+        st->due_ms = poll_scheduler_now_ms() + wait_ms;
+        ts->cycles++;
+        pthread_cond_broadcast(&ts->cond);
+    }
+    pthread_mutex_unlock(&ts->lock);
+
+    mysql_thread_end();
+    return NULL;
+}
+
+static void *binlog_target_main(void *arg) {
+    ScheduledTarget *st = arg;
+    mysql_thread_init();
+    watch_target_run(st->target);
+    mysql_thread_end();
+    return NULL;
+}
+
+// A git change makes every poll target due, so the deltas of the new
+// branch are written without waiting out the poll intervals.
+static void wake_all(TargetScheduler *ts) {
+    pthread_mutex_lock(&ts->lock);
+    for (int i = 0; i < ts->count; i++) {
+        ts->targets[i].due_ms = 0;
+    }
+    pthread_cond_broadcast(&ts->cond);
+    pthread_mutex_unlock(&ts->lock);
+}
+
+static int start_targets(TargetScheduler *ts, TargetConfig *targets, int count) {
+    int polled = 0;
+    for (int i = 0; i < count; i++) {
+        ScheduledTarget *st = &ts->targets[ts->count];
+        memset(st, 0, sizeof(*st));
+        st->config = &targets[i];
+        // Cycles run one at a time on a borrowed connection; the thread
+        // pool, not per-target workers, is what overlaps them.
+        st->target = watch_target_create(targets[i].name, &targets[i].config, ts->ctx, 1);
+        if (!st->target) {
+            log_message(LOG_LEVEL_WARN, "MySQL: [%s] could not be set up, not watching it", targets[i].name);
+            continue;
+        }
+        ts->count++;
+
+        if (targets[i].config.capture_mode == CAPTURE_BINLOG) {
+            st->has_thread = pthread_create(&st->thread, NULL, binlog_target_main, st) == 0;
+            if (st->has_thread) {
+                continue;
+            }
+            log_message(LOG_LEVEL_WARN, "MySQL: [%s] no thread for the binlog, polling it instead",
+                        targets[i].name);
+        }
+        // The first target on a server sets its connection limit.
+        st->server = find_server(ts, &targets[i].config);
+        if (!st->server) {
+            int limit = targets[i].config.server_connections;
+            st->server = add_server(ts, &targets[i].config, limit > 0 ? limit : DEFAULT_SERVER_CONNECTIONS);
+        }
+        if (!st->server) {
+            ts->count--;
+            watch_target_destroy(st->target);
+            continue;
+        }
+        polled++;
+    }
+    return polled;
+}
+
+void watch_targets(TargetConfig *targets, int count, const DBConfig *defaults, AppContext *ctx) {
+    TargetScheduler ts;
+    memset(&ts, 0, sizeof(ts));
+    ts.ctx = ctx;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&ts.lock, NULL);
+    pthread_cond_init(&ts.cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    int threads = defaults->watch_threads > 0 ? defaults->watch_threads : DEFAULT_WATCH_THREADS;
+    if (threads > MAX_WATCH_THREADS) {
+        threads = MAX_WATCH_THREADS;
+    }
+    ts.targets = calloc((size_t)count, sizeof(ScheduledTarget));
+    ts.servers = calloc((size_t)count, sizeof(ServerPool));
+    if (!ts.targets || !ts.servers) {
+        fprintf(stderr, "Failed to set up %d watch targets\n", count);
+        free(ts.targets);
+        free(ts.servers);
+        return;
+    }
+
+    int polled = start_targets(&ts, targets, count);
+    if (threads > polled) {
+        threads = polled;
+    }
+    ts.threads = calloc((size_t)(threads > 0 ? threads : 1), sizeof(pthread_t));
+    for (int i = 0; ts.threads && i < threads; i++) {
+        if (pthread_create(&ts.threads[ts.thread_count], NULL, scheduler_main, &ts) != 0) {
+            fprintf(stderr, "Failed to start scheduler thread %d\n", i);
+            break;
+        }
+        ts.thread_count++;
+    }
+    printf("Watching %d target(s) on %d server(s) with %d thread(s)\n", ts.count, ts.server_count,
+           ts.thread_count);
+    app_log(ctx, "MySQL: watching %d target(s), %d polled on %d server(s) by %d thread(s)",
+            ts.count, polled, ts.server_count, ts.thread_count);
+
+    unsigned long seen = app_change_seq(ctx);
+    int rc;
+    while ((rc = app_wait_for_change(ctx, &seen, SCHEDULER_IDLE_MS)) >= 0) {
+        if (rc > 0) {
+            app_log(ctx, "MySQL: woken by a git change, rescanning every target");
+            wake_all(&ts);
+        }
+    }
+
+    pthread_mutex_lock(&ts.lock);
+    ts.stopping = 1;
+    pthread_cond_broadcast(&ts.cond);
+    pthread_mutex_unlock(&ts.lock);
+    for (int i = 0; i < ts.thread_count; i++) {
+        pthread_join(ts.threads[i], NULL);
+    }
+    for (int i = 0; i < ts.count; i++) {
+        if (ts.targets[i].has_thread) {
+            pthread_join(ts.targets[i].thread, NULL);
+        }
+    }
+
+    app_log(ctx, "MySQL: ran %lu poll cycle(s)", ts.cycles);
+    for (int i = 0; i < ts.server_count; i++) {
+        ServerPool *server = &ts.servers[i];
+        unsigned long connects = 0;
+        for (int s = 0; s < server->size; s++) {
+            connects += server->slots[s].connects;
+            db_connection_close(&server->slots[s]);
+        }
+        app_log(ctx, "MySQL: server %s:%d opened %lu connection(s), at most %d at once",
+                server->config.host ? server->config.host : "localhost", server->config.port, connects,
+                server->size);
+        free(server->slots);
+        free(server->busy);
+    }
+    for (int i = 0; i < ts.count; i++) {
+        watch_target_destroy(ts.targets[i].target);
+    }
+    report_blob_usage(ctx);
+
+    free(ts.threads);
+    free(ts.targets);
+    free(ts.servers);
+    pthread_cond_destroy(&ts.cond);
+    pthread_mutex_destroy(&ts.lock);
+}
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "worker_pool.h"
+
+static int take_job(WorkerPool *pool) {
+    int index = -1;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->next_job < pool->job_count) {
+        index = pool->next_job++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return index;
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    WorkerPool *pool = worker->pool;
+    unsigned long seen = 0;
+
+    mysql_thread_init();
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->batch == seen) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->batch;
+        WorkerJobFn fn = pool->fn;
+        void *job_arg = pool->arg;
+        pthread_mutex_unlock(&pool->lock);
+
+        // The connection is checked once per batch rather than per job; a
+        // worker that cannot connect still drains its share so the batch ends.
+        MYSQL *conn = db_connection_acquire(&worker->connection, pool->ctx);
+        int index;
+        while ((index = take_job(pool)) >= 0) {
+            fn(conn, index, job_arg);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    db_connection_close(&worker->connection);
+    mysql_thread_end();
+    return NULL;
+}
+
+int worker_pool_start(WorkerPool *pool, DBConfig *config, AppContext *ctx, int size) {
+    memset(pool, 0, sizeof(*pool));
+    pool->ctx = ctx;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    if (size < 2) {
+        return 0;
+    }
+
+    pool->workers = calloc((size_t)size, sizeof(Worker));
+    if (!pool->workers) {
+        return -1;
+    }
+    for (int i = 0; i < size; i++) {
+        Worker *worker = &pool->workers[i];
+        worker->pool = pool;
+        db_connection_init(&worker->connection, config);
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            fprintf(stderr, "Failed to start capture worker %d\n", i);
+            break;
+        }
+        worker->started = 1;
+        pool->size++;
+    }
+    if (pool->size < 2) {
+        // One worker would only add a hand-off to the serial path.
+        worker_pool_stop(pool);
+        return worker_pool_start(pool, config, ctx, 0);
+    }
+    app_log(ctx, "MySQL: started %d capture workers", pool->size);
+    return 0;
+}
+
+void worker_pool_run(WorkerPool *pool, MYSQL *conn, int count, WorkerJobFn fn, void *arg) {
+    if (count <= 0) {
+        return;
+    }
+    if (pool->size == 0) {
+        for (int i = 0; i < count; i++) {
+            fn(conn, i, arg);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->job_count = count;
+    pool->next_job = 0;
+    pool->active = pool->size;
+    pool->batch++;
+    pthread_cond_broadcast(&pool->work_ready);
+    while (pool->active > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pool->fn = NULL;
+    pool->arg = NULL;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void worker_pool_stop(WorkerPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; pool->workers && i < pool->size; i++) {
+        if (pool->workers[i].started) {
+            pthread_join(pool->workers[i].thread, NULL);
+        }
+    }
+    free(pool->workers);
+    pool->workers = NULL;
+    pool->size = 0;
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+}
@@ -0,0 +1,24 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+// Number of failed checks so far; main() exits non-zero when it is not 0.
+extern int test_failures;
+
+// Records a failure and keeps going, so one run reports every broken case.
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        test_failures++; \
+    } \
+} while (0)
+
+void test_schema_diff(void);
+void test_schema_model(void);
+void test_ddl_scan(void);
+void test_parallel(void);
+
+#endif // TEST_H
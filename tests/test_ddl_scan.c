@@ -0,0 +1,61 @@
+#include <string.h>
+#include "test.h"
+#include "ddl_scan.h"
+
+// Tables are listed as "db.table" joined by spaces; a database-level
+// statement reports "db.".
+typedef struct {
+    const char *query;
+    const char *default_db;
+    DdlResult result;
+    const char *tables;
+} ScanCase;
+
+static const ScanCase SCAN_CASES[] = {
+    { "CREATE TABLE t (id int)", "app", DDL_TABLES, "app.t" },
+    { "create table if not exists `shop`.`order items` (id int)", "app", DDL_TABLES, "shop.order items" },
+    { "CREATE TEMPORARY TABLE tmp (id int)", "app", DDL_NONE, "" },
+    { "ALTER TABLE t ADD COLUMN c int", "app", DDL_TABLES, "app.t" },
+    { "ALTER TABLE t RENAME COLUMN a TO b", "app", DDL_TABLES, "app.t" },
+    { "ALTER TABLE t RENAME TO other.u", "app", DDL_TABLES, "app.t other.u" },
+    { "ALTER TABLE t RENAME INDEX a TO b, RENAME AS u", "app", DDL_TABLES, "app.t app.u" },
+    { "DROP TABLE IF EXISTS a, b.c", "app", DDL_TABLES, "app.a b.c" },
+    { "DROP TEMPORARY TABLE tmp", "app", DDL_NONE, "" },
+    { "RENAME TABLE a TO b, c TO d", "app", DDL_TABLES, "app.a app.b app.c app.d" },
+    { "CREATE UNIQUE INDEX i ON t (c)", "app", DDL_TABLES, "app.t" },
+    { "DROP INDEX i ON db.t", "app", DDL_TABLES, "db.t" },
+    { "CREATE DATABASE IF NOT EXISTS shop", "app", DDL_TABLES, "shop." },
+    { "DROP SCHEMA shop", "app", DDL_TABLES, "shop." },
+    { "/* comment */ ALTER TABLE t ENGINE=InnoDB", "app", DDL_TABLES, "app.t" },
+    { "/*!40101 DROP TABLE t */", "app", DDL_TABLES, "app.t" },
+    { "-- note\nDROP TABLE t", "app", DDL_TABLES, "app.t" },
+    { "CREATE DEFINER=`root`@`%` TRIGGER tr BEFORE INSERT ON t FOR EACH ROW SET @a = 1", "app", DDL_NONE, "" },
+    { "CREATE ALGORITHM=MERGE VIEW v AS SELECT 1", "app", DDL_UNKNOWN, "" },
+    { "DROP PROCEDURE p", "app", DDL_NONE, "" },
+    { "INSERT INTO t VALUES (1)", "app", DDL_NONE, "" },
+    { "BEGIN", "app", DDL_NONE, "" },
+    { "CREATE TABLE t (id int)", NULL, DDL_TABLES, ".t" },
+    { "", "app", DDL_NONE, "" },
+};
+
+static void collect(const char *db, const char *table, void *arg) {
+    char *out = arg;
+    if (out[0]) {
+        strcat(out, " ");
+    }
+    strcat(out, db);
+    strcat(out, ".");
+    if (table) {
+        strcat(out, table);
+    }
+}
+
+void test_ddl_scan(void) {
+    for (size_t i = 0; i < sizeof(SCAN_CASES) / sizeof(SCAN_CASES[0]); i++) {
+        const ScanCase *c = &SCAN_CASES[i];
+        char tables[512] = "";
+        DdlResult result = ddl_scan(c->query, strlen(c->query), c->default_db, collect, tables);
+        CHECK(result == c->result, "\"%s\": result %d, want %d", c->query, result, c->result);
+        CHECK(strcmp(tables, c->tables) == 0, "\"%s\": tables \"%s\", want \"%s\"", c->query, tables, c->tables);
+    }
+}
@@ -0,0 +1,20 @@
+#include <stdio.h>
+#include "test.h"
+
+int test_failures = 0;
+
+// `make test` runs every suite; the pure modules under test need neither a
+// database nor a git repository.
+int main(void) {
+    test_schema_diff();
+    test_schema_model();
+    test_ddl_scan();
+    test_parallel();
+
+    if (test_failures > 0) {
+        fprintf(stderr, "%d check(s) failed\n", test_failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "test.h"
+#include "parallel.h"
+
+#define RUN_SIZE 1000
+
+typedef struct {
+    atomic_int runs[RUN_SIZE];
+    atomic_int opened;
+    atomic_int closed;
+    int fail_open;
+} CountState;
+
+static void count_index(void *local, int index, void *arg) {
+    CountState *state = arg;
+    CHECK(local == state, "index %d: got the wrong thread state", index);
+    atomic_fetch_add(&state->runs[index], 1);
+}
+
+static int open_state(void **local, void *arg) {
+    CountState *state = arg;
+    atomic_fetch_add(&state->opened, 1);
+    if (state->fail_open) {
+        return -1;
+    }
+    *local = state;
+    return 0;
+}
+
+static void close_state(void *local, void *arg) {
+    CountState *state = arg;
+    CHECK(local == state, "closed the wrong thread state");
+    atomic_fetch_add(&state->closed, 1);
+}
+
+// Every index in the range runs exactly once, whatever the thread count
+// and chunk size, and nothing outside it runs.
+static void test_parallel_ranges(void) {
+    static const int threads[] = { 0, 1, 2, 7 };
+    static const int chunks[] = { 0, 1, 16, 5000 };
+    static CountState state;
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+            memset(&state, 0, sizeof(state));
+            ParallelJob job = { count_index, open_state, close_state, &state, chunks[c] };
+            int rc = parallel_run(&job, threads[t], 10, RUN_SIZE - 10);
+            CHECK(rc == 0, "%d thread(s), chunk %d: returned %d", threads[t], chunks[c], rc);
+            int wrong = 0;
+            for (int i = 0; i < RUN_SIZE; i++) {
+                int want = i >= 10 && i < RUN_SIZE - 10;
+                wrong += atomic_load(&state.runs[i]) != want;
+            }
+            CHECK(wrong == 0, "%d thread(s), chunk %d: %d index(es) ran the wrong number of times",
+                  threads[t], chunks[c], wrong);
+            CHECK(atomic_load(&state.opened) == atomic_load(&state.closed),
+                  "%d thread(s), chunk %d: opened %d, closed %d", threads[t], chunks[c],
+                  atomic_load(&state.opened), atomic_load(&state.closed));
+        }
+    }
+}
+
+static void test_parallel_open_fails(void) {
+    static CountState state;
+    memset(&state, 0, sizeof(state));
+    state.fail_open = 1;
+    ParallelJob job = { count_index, open_state, close_state, &state, 8 };
+    CHECK(parallel_run(&job, 3, 0, 100) == -1, "a run no thread could open reported success");
+    CHECK(atomic_load(&state.runs[0]) == 0 && atomic_load(&state.closed) == 0, "a failed open still ran");
+    CHECK(parallel_run(&job, 3, 5, 5) == 0, "an empty range reported failure");
+}
+
+void test_parallel(void) {
+    test_parallel_ranges();
+    test_parallel_open_fails();
+}
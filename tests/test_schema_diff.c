@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "schema_diff.h"
+
+// Statuses are written one character per line: '=' same, '+' added and
+// '-' removed; the diff has to count as many of each.
+typedef struct {
+    const char *name;
+    const char *old_schema;
+    const char *new_schema;
+    const char *old_status;
+    const char *new_status;
+} DiffCase;
+
+static const DiffCase DIFF_CASES[] = {
+    { "identical", "a\nb\nc", "a\nb\nc", "===", "===" },
+    { "add", "a\nb", "a\nb\nc", "==", "==+" },
+    { "add first", "a\nb", "c\na\nb", "==", "+==" },
+    { "drop", "a\nb\nc", "a\nc", "=-=", "==" },
+    { "modify", "a\n`x` int\nb", "a\n`x` bigint\nb", "=-=", "=+=" },
+    { "reorder", "a\nb\nc", "c\na\nb", "===", "===" },
+    { "duplicate dropped", "a\na\nb", "a\nb", "===", "==" },
+    { "duplicate added", "a\nb", "a\nb\nb", "==", "===" },
+    { "duplicate of a new line", "a", "a\nb\nb", "=", "=++" },
+    { "empty old", "", "a\nb", "", "++" },
+    { "empty new", "a\nb", "", "--", "" },
+    { "both empty", "", "", "", "" },
+    { "null old", NULL, "a", "", "+" },
+    { "blank lines", "a\n\n\nb", "a\nb\n", "==", "==" },
+    { "trailing comma and indent", "  `id` int,\n)", "`id` int\n)", "==", "==" },
+};
+
+static void test_diff_cases(void) {
+    for (size_t i = 0; i < sizeof(DIFF_CASES) / sizeof(DIFF_CASES[0]); i++) {
+        const DiffCase *c = &DIFF_CASES[i];
+        SchemaLines old_lines;
+        SchemaLines new_lines;
+        SchemaLineDiff diff;
+        CHECK(schema_lines_parse(c->old_schema, &old_lines) == 0, "%s: parse old", c->name);
+        CHECK(schema_lines_parse(c->new_schema, &new_lines) == 0, "%s: parse new", c->name);
+        CHECK(schema_diff_lines(&old_lines, &new_lines, &diff) == 0, "%s: diff", c->name);
+
+        CHECK(old_lines.count == (int)strlen(c->old_status) && new_lines.count == (int)strlen(c->new_status),
+              "%s: parsed %d/%d line(s)", c->name, old_lines.count, new_lines.count);
+        int added = 0;
+        int removed = 0;
+        for (const char *p = c->new_status; *p; p++) {
+            added += *p == '+';
+        }
+        for (const char *p = c->old_status; *p; p++) {
+            removed += *p == '-';
+        }
+        CHECK(diff.added_count == added && diff.removed_count == removed,
+              "%s: counts %d/%d, want %d/%d", c->name, diff.added_count, diff.removed_count, added, removed);
+
+        schema_lines_free(&old_lines);
+        schema_lines_free(&new_lines);
+    }
+}
+
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// Builds up to 40 lines drawn from a small vocabulary, so both sides share
+// lines, repeat lines and collide in the hash index.
+static void random_schema(uint64_t *state, char *out) {
+    int count = (int)(next_random(state) % 41);
+    out[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        char line[32];
+        snprintf(line, sizeof(line), "`c%d` int\n", (int)(next_random(state) % 24));
+        strcat(out, line);
+    }
+}
+
+static int contains(const SchemaLines *lines, const SchemaLine *line) {
+    for (int i = 0; i < lines->count; i++) {
+        if (lines->lines[i].len == line->len && memcmp(lines->lines[i].text, line->text, line->len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// The hash index must agree with a plain O(n * m) membership scan.
+static void test_diff_random(void) {
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    char old_schema[1024];
+    char new_schema[1024];
+    for (int round = 0; round < 2000; round++) {
+        random_schema(&state, old_schema);
+        random_schema(&state, new_schema);
+        SchemaLines old_lines;
+        SchemaLines new_lines;
+        SchemaLineDiff diff;
+        if (schema_lines_parse(old_schema, &old_lines) != 0 || schema_lines_parse(new_schema, &new_lines) != 0 ||
+            schema_diff_lines(&old_lines, &new_lines, &diff) != 0) {
+            CHECK(0, "round %d: out of memory", round);
+            return;
+        }
+
+        int removed = 0;
+        int added = 0;
+        for (int i = 0; i < old_lines.count; i++) {
+            removed += !contains(&new_lines, &old_lines.lines[i]);
+        }
+        for (int i = 0; i < new_lines.count; i++) {
+            added += !contains(&old_lines, &new_lines.lines[i]);
+        }
+        CHECK(diff.added_count == added && diff.removed_count == removed,
+              "round %d: counts %d/%d, reference %d/%d", round, diff.added_count, diff.removed_count, added,
+              removed);
+
+        schema_lines_free(&old_lines);
+        schema_lines_free(&new_lines);
+    }
+}
+
+void test_schema_diff(void) {
+    test_diff_cases();
+    test_diff_random();
+}
@@ -0,0 +1,113 @@
+#include <string.h>
+#include "test.h"
+#include "schema_diff.h"
+
+#define TABLE(body) "CREATE TABLE `t` (\n" body "\n) ENGINE=InnoDB"
+#define BASE "  `id` int NOT NULL,\n  `name` varchar(32) DEFAULT NULL,\n  `age` int DEFAULT NULL"
+#define PK ",\n  PRIMARY KEY (`id`)"
+#define ONLINE ", ALGORITHM=INPLACE, LOCK=NONE;\n"
+
+typedef struct {
+    const char *name;
+    const char *old_schema;
+    const char *new_schema;
+    const char *up;
+    const char *down;
+} AlterCase;
+
+static const AlterCase ALTER_CASES[] = {
+    { "unchanged", TABLE(BASE PK), TABLE(BASE PK), "", "" },
+    { "reorder only",
+      TABLE(BASE PK),
+      TABLE("  `id` int NOT NULL,\n  `age` int DEFAULT NULL,\n  `name` varchar(32) DEFAULT NULL" PK),
+      "", "" },
+    { "add column in the middle",
+      TABLE(BASE PK),
+      TABLE("  `id` int NOT NULL,\n  `email` text,\n  `name` varchar(32) DEFAULT NULL,\n  `age` int DEFAULT NULL" PK),
+      "ALTER TABLE `t` ADD COLUMN `email` text AFTER `id`" ONLINE,
+      "ALTER TABLE `t` DROP COLUMN `email`" ONLINE },
+    { "add column first",
+      TABLE(BASE PK),
+      TABLE("  `uuid` char(36) DEFAULT NULL,\n" BASE PK),
+      "ALTER TABLE `t` ADD COLUMN `uuid` char(36) DEFAULT NULL FIRST" ONLINE,
+      "ALTER TABLE `t` DROP COLUMN `uuid`" ONLINE },
+    { "add column last",
+      TABLE(BASE PK),
+      TABLE(BASE ",\n  `email` text" PK),
+      "ALTER TABLE `t` ADD COLUMN `email` text" ONLINE,
+      "ALTER TABLE `t` DROP COLUMN `email`" ONLINE },
+    { "widen varchar",
+      TABLE(BASE PK),
+      TABLE("  `id` int NOT NULL,\n  `name` varchar(48) DEFAULT NULL,\n  `age` int DEFAULT NULL" PK),
+      "ALTER TABLE `t` MODIFY COLUMN `name` varchar(48) DEFAULT NULL" ONLINE,
+      "ALTER TABLE `t` MODIFY COLUMN `name` varchar(32) DEFAULT NULL;\n" },
+    { "widen varchar past a one byte length",
+      TABLE(BASE PK),
+      TABLE("  `id` int NOT NULL,\n  `name` varchar(64) DEFAULT NULL,\n  `age` int DEFAULT NULL" PK),
+      "ALTER TABLE `t` MODIFY COLUMN `name` varchar(64) DEFAULT NULL;\n",
+      "ALTER TABLE `t` MODIFY COLUMN `name` varchar(32) DEFAULT NULL;\n" },
+    { "change type",
+      TABLE(BASE PK),
+      TABLE("  `id` int NOT NULL,\n  `name` varchar(32) DEFAULT NULL,\n  `age` bigint DEFAULT NULL" PK),
+      "ALTER TABLE `t` MODIFY COLUMN `age` bigint DEFAULT NULL;\n",
+      "ALTER TABLE `t` MODIFY COLUMN `age` int DEFAULT NULL;\n" },
+    { "change default",
+      TABLE(BASE PK),
+      TABLE("  `id` int NOT NULL,\n  `name` varchar(32) DEFAULT NULL,\n  `age` int DEFAULT '0'" PK),
+      "ALTER TABLE `t` ALTER COLUMN `age` SET DEFAULT '0'" ONLINE,
+      "ALTER TABLE `t` ALTER COLUMN `age` SET DEFAULT NULL" ONLINE },
+    { "same definition in the same place is not renamed",
+      TABLE("  `id` int NOT NULL,\n  `legacy_flag` tinyint DEFAULT NULL,\n  `age` int DEFAULT NULL" PK),
+      TABLE("  `id` int NOT NULL,\n  `is_active` tinyint DEFAULT NULL,\n  `age` int DEFAULT NULL" PK),
+      "-- possible rename: ALTER TABLE `t` RENAME COLUMN `legacy_flag` TO `is_active`" ONLINE
+      "ALTER TABLE `t` DROP COLUMN `legacy_flag`" ONLINE
+      "ALTER TABLE `t` ADD COLUMN `is_active` tinyint DEFAULT NULL AFTER `id`" ONLINE,
+      "-- possible rename: ALTER TABLE `t` RENAME COLUMN `is_active` TO `legacy_flag`" ONLINE
+      "ALTER TABLE `t` DROP COLUMN `is_active`" ONLINE
+      "ALTER TABLE `t` ADD COLUMN `legacy_flag` tinyint DEFAULT NULL AFTER `id`" ONLINE },
+    { "different definition is no rename",
+      TABLE(BASE PK),
+      TABLE("  `id` int NOT NULL,\n  `title` text,\n  `age` int DEFAULT NULL" PK),
+      "ALTER TABLE `t` DROP COLUMN `name`" ONLINE
+      "ALTER TABLE `t` ADD COLUMN `title` text AFTER `id`" ONLINE,
+      "ALTER TABLE `t` DROP COLUMN `title`" ONLINE
+      "ALTER TABLE `t` ADD COLUMN `name` varchar(32) DEFAULT NULL AFTER `id`" ONLINE },
+    { "add index",
+      TABLE(BASE PK),
+      TABLE(BASE PK ",\n  KEY `idx_age` (`age`)"),
+      "ALTER TABLE `t` ADD KEY `idx_age` (`age`)" ONLINE,
+      "ALTER TABLE `t` DROP INDEX `idx_age`" ONLINE },
+    { "rename index",
+      TABLE(BASE PK ",\n  KEY `idx_age` (`age`)"),
+      TABLE(BASE PK ",\n  KEY `age_idx` (`age`)"),
+      "ALTER TABLE `t` RENAME INDEX `idx_age` TO `age_idx`" ONLINE,
+      "ALTER TABLE `t` RENAME INDEX `age_idx` TO `idx_age`" ONLINE },
+    { "fulltext index",
+      TABLE(BASE PK),
+      TABLE(BASE PK ",\n  FULLTEXT KEY `ft_name` (`name`)"),
+      "ALTER TABLE `t` ADD FULLTEXT KEY `ft_name` (`name`), ALGORITHM=INPLACE, LOCK=SHARED;\n",
+      "ALTER TABLE `t` DROP INDEX `ft_name`" ONLINE },
+    { "change primary key",
+      TABLE(BASE PK),
+      TABLE(BASE ",\n  PRIMARY KEY (`id`,`age`)"),
+      "ALTER TABLE `t` DROP PRIMARY KEY, ADD PRIMARY KEY (`id`,`age`)" ONLINE,
+      "ALTER TABLE `t` DROP PRIMARY KEY, ADD PRIMARY KEY (`id`)" ONLINE },
+    { "add foreign key",
+      TABLE(BASE PK),
+      TABLE(BASE PK ",\n  CONSTRAINT `fk_age` FOREIGN KEY (`age`) REFERENCES `ages` (`id`)"),
+      "ALTER TABLE `t` ADD CONSTRAINT `fk_age` FOREIGN KEY (`age`) REFERENCES `ages` (`id`);\n",
+      "ALTER TABLE `t` DROP FOREIGN KEY `fk_age`" ONLINE },
+};
+
+void test_schema_model(void) {
+    for (size_t i = 0; i < sizeof(ALTER_CASES) / sizeof(ALTER_CASES[0]); i++) {
+        const AlterCase *c = &ALTER_CASES[i];
+        StrBuf up = STR_BUF_INIT;
+        StrBuf down = STR_BUF_INIT;
+        generate_alter_statements("t", c->old_schema, c->new_schema, &up, &down);
+        CHECK(strcmp(sb_str(&up), c->up) == 0, "%s: up is\n%s\nwant\n%s", c->name, sb_str(&up), c->up);
+        CHECK(strcmp(sb_str(&down), c->down) == 0, "%s: down is\n%s\nwant\n%s", c->name, sb_str(&down), c->down);
+        sb_free(&up);
+        sb_free(&down);
+    }
+}